@@ -0,0 +1,283 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "adindex.h"
+#include "logreader.h"
+#include "mappedfile.h"
+#include "packetdecode.h"
+
+/*
+	AD structure parser benchmark, over the advertising payloads of a
+	capture log or, without one, of a synthetic mix of the structures
+	devices send: flags, manufacturer data, 16 and 128-bit service UUID
+	lists, service data, names and TX power, some payloads cut short.
+
+	Times building an AdIndex alone, then building one and asking it for
+	the flags, manufacturer, local name and service UUIDs, as classifying
+	a device takes, against walking the payload again for each of those
+	questions. The answers are folded into a checksum that must agree.
+
+	Usage:
+		ad_bench [--log FILE] [--payloads N] [--rounds N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct corpus_t
+{
+	std::vector<uint8_t> bytes;
+	std::vector<uint32_t> offsets;
+
+	void add(const uint8_t *data, size_t length)
+	{
+		offsets.push_back(bytes.size());
+		bytes.insert(bytes.end(), data, data + length);
+	}
+};
+
+static void synthesize(corpus_t &corpus, uint32_t count, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	static const char *names[] = {"R2-D2", "BB-8", "Droid Depot", "Savi's Workshop", "Datapad"};
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint8_t payload[64];
+		size_t length = 0;
+		auto structure = [&](uint8_t type, size_t size) {
+			payload[length] = size + 1;
+			payload[length + 1] = type;
+			for (size_t j = 0; j < size; j++)
+				payload[length + 2 + j] = rng();
+			length += size + 2;
+			return payload + length - size;
+		};
+
+		if (rng() % 4)
+			structure(AD_TYPE_FLAGS, 1)[0] = 0x06;
+
+		switch (rng() % 6)
+		{
+		case 0:
+		case 1:
+			structure(AD_TYPE_MANUFACTURER, 2 + rng() % 20);
+			break;
+		case 2:
+			structure(AD_TYPE_UUID16_COMPLETE, 2 * (1 + rng() % 3));
+			structure(AD_TYPE_SERVICE_DATA16, 2 + rng() % 6);
+			break;
+		case 3:
+			structure(AD_TYPE_UUID128_COMPLETE, 16);
+			break;
+		case 4:
+		{
+			const char *name = names[rng() % 5];
+			memcpy(structure(rng() % 2 ? AD_TYPE_NAME_COMPLETE : AD_TYPE_NAME_SHORT, strlen(name)), name, strlen(name));
+			structure(AD_TYPE_TX_POWER, 1);
+			break;
+		}
+		default:
+			structure(AD_TYPE_UUID16_INCOMPLETE, 2);
+			structure(AD_TYPE_MANUFACTURER, 4);
+			break;
+		}
+
+		if (length > 31)
+			length = 31;
+		// Now and then a payload cut short, or padded with zeros
+		if (rng() % 16 == 0)
+			length -= 1 + rng() % 3;
+		else if (rng() % 16 == 0)
+			while (length < 31)
+				payload[length++] = 0;
+
+		corpus.add(payload, length);
+	}
+}
+
+static inline uint32_t mix(uint32_t sum, uint32_t value)
+{
+	return (sum ^ value) * 16777619u;
+}
+
+/*
+	The questions classification asks, answered from an index
+*/
+static uint32_t classifyIndexed(const uint8_t *data, uint8_t length)
+{
+	AdIndex ads(data, length);
+	uint32_t sum = mix(ads.flags(), ads.truncated());
+
+	uint16_t id;
+	if (ads.manufacturer(id))
+		sum = mix(sum, id);
+
+	const char *name;
+	uint8_t nameLength;
+	if (ads.localName(name, nameLength))
+		sum = mix(sum, (uint8_t)name[0] | nameLength << 8);
+
+	uint16_t uuid;
+	if (ads.uuid16(0, uuid))
+		sum = mix(sum, uuid);
+	sum = mix(sum, ads.uuid16Count());
+
+	if (const uint8_t *uuid128 = ads.uuid128(0))
+		sum = mix(sum, uuid128[0]);
+	return sum;
+}
+
+/*
+	The same questions, walking the payload for each
+*/
+static const uint8_t *walkFind(const uint8_t *data, uint8_t length, uint8_t type, uint8_t &found)
+{
+	for (ad_structure_t ad : AdStructures(data, length))
+	{
+		if (ad.type == type)
+		{
+			found = ad.length;
+			return ad.data;
+		}
+	}
+	return nullptr;
+}
+
+static bool walkTruncated(const uint8_t *data, uint8_t length)
+{
+	uint8_t used = 0;
+	for (ad_structure_t ad : AdStructures(data, length))
+		used = ad.data - data + ad.length;
+	return used < length && data[used];
+}
+
+static uint32_t classifyWalking(const uint8_t *data, uint8_t length)
+{
+	uint8_t n;
+	const uint8_t *p = walkFind(data, length, AD_TYPE_FLAGS, n);
+	uint32_t sum = mix(p && n ? p[0] : -1, walkTruncated(data, length));
+
+	p = walkFind(data, length, AD_TYPE_MANUFACTURER, n);
+	if (p && n >= 2)
+		sum = mix(sum, p[0] | p[1] << 8);
+
+	p = walkFind(data, length, AD_TYPE_NAME_COMPLETE, n);
+	if (!p)
+		p = walkFind(data, length, AD_TYPE_NAME_SHORT, n);
+	if (p)
+		sum = mix(sum, p[0] | n << 8);
+
+	uint8_t count = 0;
+	uint16_t first = 0;
+	for (ad_structure_t ad : AdStructures(data, length))
+	{
+		if (ad.type != AD_TYPE_UUID16_INCOMPLETE && ad.type != AD_TYPE_UUID16_COMPLETE)
+			continue;
+		for (uint8_t at = 0; at + AD_UUID16_SIZE <= ad.length; at += AD_UUID16_SIZE)
+			if (!count++)
+				first = ad.data[at] | ad.data[at + 1] << 8;
+	}
+	if (count)
+		sum = mix(sum, first);
+	sum = mix(sum, count);
+
+	for (ad_structure_t ad : AdStructures(data, length))
+	{
+		if ((ad.type == AD_TYPE_UUID128_INCOMPLETE || ad.type == AD_TYPE_UUID128_COMPLETE) && ad.length >= AD_UUID128_SIZE)
+		{
+			sum = mix(sum, ad.data[0]);
+			break;
+		}
+	}
+	return sum;
+}
+
+static uint32_t buildOnly(const uint8_t *data, uint8_t length)
+{
+	AdIndex ads(data, length);
+	return ads.size();
+}
+
+template <typename F>
+static void run(const char *name, const corpus_t &corpus, uint32_t rounds, F read)
+{
+	size_t count = corpus.offsets.size() - 1;
+	uint32_t sum = 0;
+
+	auto start = bench_clock_t::now();
+	for (uint32_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < count; i++)
+			sum += read(&corpus.bytes[corpus.offsets[i]], corpus.offsets[i + 1] - corpus.offsets[i]);
+	double nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+
+	printf("%-10s %6.2f ns/payload, checksum %08x\n", name, nanos / ((double)count * rounds), sum);
+}
+
+int main(int argc, char **argv)
+{
+	const char *logPath = nullptr;
+	uint32_t payloads = 1 << 16;
+	uint32_t rounds = 50;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "--log"))
+			logPath = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "--payloads"))
+			payloads = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--rounds"))
+			rounds = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[++i], nullptr, 0);
+		else
+		{
+			fprintf(stderr, "usage: ad_bench [--log FILE] [--payloads N] [--rounds N] [--seed N]\n");
+			return 2;
+		}
+	}
+
+	corpus_t corpus;
+	if (logPath)
+	{
+		MappedFile file;
+		if (!file.open(logPath))
+		{
+			perror(logPath);
+			return 1;
+		}
+		LogReader reader(file.data(), file.size());
+		if (!reader.supported())
+		{
+			fprintf(stderr, "%s: unsupported log format\n", logPath);
+			return 1;
+		}
+
+		decodeLog(reader, [&](const log_record_t &, const decoded_packet_t *packet) {
+			if (packet && packet->data && corpus.offsets.size() < payloads)
+				corpus.add(packet->data, packet->dataLength);
+		});
+	}
+	else
+		synthesize(corpus, payloads, seed);
+
+	if (corpus.offsets.empty())
+	{
+		fprintf(stderr, "no advertising payloads\n");
+		return 1;
+	}
+	corpus.offsets.push_back(corpus.bytes.size());
+	printf("%zu payloads, %.1f bytes each\n", corpus.offsets.size() - 1,
+		   (double)corpus.bytes.size() / (corpus.offsets.size() - 1));
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		run("build", corpus, rounds, buildOnly);
+		run("indexed", corpus, rounds, classifyIndexed);
+		run("walking", corpus, rounds, classifyWalking);
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <vector>
+
+#include "advertisertable.h"
+#include "framepool.h"
+#include "traffic.h"
+
+/*
+	Advertiser table benchmark. Feeds the same kind of synthetic
+	advertising traffic the capture benchmarks use through
+	AdvertiserTable::observe(), for tables of 1k to 64k entries and for
+	populations of half, as many and four times as many devices as the
+	table has entries, the last forcing an eviction on most packets. The
+	traffic is built up front and replayed, so only processing is timed.
+	Reports the host time per packet, which includes indexing its AD
+	structures as processPacket() does, the share of packets from an
+	advertiser already in the table, how full it ended up and how many
+	entries were replaced.
+
+	Usage:
+		advertiser_bench [--packets N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+#define BENCH_TRAFFIC_PACKETS (1 << 18)
+
+int main(int argc, char **argv)
+{
+	uint64_t packets = 8000000;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "--packets"))
+			packets = strtoull(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[++i], nullptr, 0);
+		else
+		{
+			fprintf(stderr, "usage: advertiser_bench [--packets N] [--seed N]\n");
+			return 2;
+		}
+	}
+
+	static const uint32_t capacities[] = {1024, 4096, 16384, 65536};
+	static const uint32_t populations[] = {2, 4, 16}; // quarters of the capacity
+
+	printf("%8s %8s %12s %8s %8s %10s\n", "entries", "devices", "ns/packet", "hits", "full", "evicted");
+	for (uint32_t capacity : capacities)
+	{
+		std::vector<advertiser_t> entries(capacity);
+		AdvertiserTable table(entries.data(), capacity);
+
+		for (uint32_t quarters : populations)
+		{
+			uint32_t devices = capacity * quarters / 4;
+			TrafficGenerator traffic(seed, devices, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+
+			std::vector<uint8_t> corpus;
+			std::vector<uint32_t> offsets;
+			uint8_t frame[FRAME_BUFFER_SIZE];
+			for (uint32_t i = 0; i < BENCH_TRAFFIC_PACKETS; i++)
+			{
+				size_t length = traffic.nextPacket(37 + i % 3, i, frame);
+				offsets.push_back(corpus.size());
+				corpus.insert(corpus.end(), frame, frame + length);
+			}
+			offsets.push_back(corpus.size());
+
+			// Warm the table up to its steady state before timing it
+			table.reset();
+			for (uint32_t i = 0; i < BENCH_TRAFFIC_PACKETS; i++)
+			{
+				PacketView packet(&corpus[offsets[i]], offsets[i + 1] - offsets[i]);
+				table.observe(packet, AdIndex(packet), i / 4);
+			}
+			uint32_t evictionsBefore = table.evictions;
+			uint32_t sizeBefore = table.size();
+
+			// About 4000 packets a second, as in a busy place
+			uint64_t observed = 0;
+			auto start = bench_clock_t::now();
+			for (uint64_t n = 0; n < packets; n++)
+			{
+				uint32_t i = n % BENCH_TRAFFIC_PACKETS;
+				PacketView packet(&corpus[offsets[i]], offsets[i + 1] - offsets[i]);
+				observed += table.observe(packet, AdIndex(packet), (uint32_t)((BENCH_TRAFFIC_PACKETS + n) / 4));
+			}
+			double nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+
+			uint64_t inserted = (table.size() - sizeBefore) + (table.evictions - evictionsBefore);
+			printf("%8u %8u %12.1f %7.1f%% %7.1f%% %10u\n", capacity, devices, nanos / packets,
+				   observed ? 100.0 * (observed - inserted) / observed : 0.0,
+				   100.0 * table.size() / capacity, table.evictions - evictionsBefore);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,415 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "framepool.h"
+#include "framing.h"
+#include "logfiles.h"
+#include "mappedfile.h"
+#include "radio.h"
+#include "repeatcache.h"
+#include "replay.h"
+#include "traffic.h"
+
+/*
+	Capture throughput benchmark. Synthetic three-radio traffic is framed as
+	the radios send it and injected into the radio UARTs at a configurable
+	packet rate and size mix, then the firmware's setup()/loop() runs against
+	the virtual clock. Each loop() pass is charged its measured host time
+	multiplied by --cpu-scale, as an estimate of how much slower the Teensy
+	is, so a capture path that cannot keep up shows as a growing radio
+	backlog and eventually overruns. The radio ingest timer fires from the
+	virtual clock as it would interrupt the Teensy. Packets logged are
+	counted in the files written, once the firmware has finished its log.
+
+	With --replay the traffic is a recorded capture log instead, replayed
+	--speed times as fast as it was logged (0 for as fast as the firmware
+	takes it) until it has all been taken, or for --seconds if given.
+	Replaying the same log with and without --repeat-window shows what
+	repeat suppression saves in bytes/s to log.
+
+	Usage:
+		capture_bench [--rate PPS] [--mix LEN:WEIGHT,...] [--devices N]
+			[--seconds S] [--cpu-scale F] [--seed N] [--sd DIR]
+			[--sd-timing CALL_NS,COMMAND_US,SECTOR_NS,FLUSH_US]
+			[--replay LOG] [--speed F] [--repeat-window MS]
+
+	The default rate of 200 packets/s per radio is about 80% of what a
+	115200 baud radio link carries with the default mix, so frames are not
+	lost on the wire before the firmware sees them. The default card timing
+	is roughly a Teensy 4.1 SDIO card: about 20 MB/s streaming, but a few
+	hundred microseconds for every card command.
+*/
+
+void setup();
+void loop();
+void finishCapture();
+
+extern uint64_t packetCount;
+extern FramePool framePool;
+extern LogFiles logFiles;
+extern radio_state_t radio37;
+extern radio_state_t radio38;
+extern radio_state_t radio39;
+extern RepeatCache repeatCache;
+extern uint32_t repeatWindowMillis;
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct radio_port_t
+{
+	HardwareSerial *port;
+	radio_state_t *radio;
+	uint8_t channel;
+	double nextMicros;
+	uint64_t framesOffered;
+	uint64_t bytesOffered;
+	std::vector<uint64_t> frameEnds;
+	size_t backlogStart;
+	size_t backlogEnd;
+};
+
+static uint64_t elapsedNanos(bench_clock_t::time_point since)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock_t::now() - since).count();
+}
+
+static uint64_t percentile(std::vector<uint64_t> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+/*
+	Time the decode of individual frames already sitting in the receive
+	buffer, so only the decode cost is measured
+*/
+static void benchParse(TrafficGenerator &traffic, size_t frames)
+{
+	HardwareSerial port("bench");
+	port.addMemoryForRead(nullptr, 65536);
+	port.begin(115200);
+	port.setPaced(false);
+
+	uint8_t packet[256];
+	uint8_t framed[FRAME_ENCODED_SIZE_MAX(256)];
+	uint64_t encodedBytes = 0;
+	for (size_t i = 0; i < frames; i++)
+	{
+		size_t length = traffic.nextPacket(37, i, packet);
+		size_t n = encodeFrame(packet, length, framed);
+		port.inject(framed, n);
+		encodedBytes += n;
+	}
+
+	static uint8_t frameBuffer[1024];
+	FrameDecoder decoder(frameBuffer, sizeof(frameBuffer));
+
+	std::vector<uint64_t> latency;
+	latency.reserve(frames);
+
+	auto start = bench_clock_t::now();
+	for (size_t i = 0; i < frames; i++)
+	{
+		auto t0 = bench_clock_t::now();
+		while (decoder.consume(port) == FRAME_STARTED)
+			;
+		latency.push_back(elapsedNanos(t0));
+	}
+	uint64_t total = elapsedNanos(start);
+
+	std::sort(latency.begin(), latency.end());
+	printf("parse: %zu frames, %.1f MB/s, latency ns p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu\n",
+		   frames, encodedBytes * 1e3 / total,
+		   (unsigned long long)percentile(latency, 50), (unsigned long long)percentile(latency, 90),
+		   (unsigned long long)percentile(latency, 99), (unsigned long long)percentile(latency, 99.9),
+		   (unsigned long long)latency.back());
+}
+
+static void removeDirectory(const char *path)
+{
+	DIR *dir = opendir(path);
+	if (!dir)
+		return;
+
+	while (auto entry = readdir(dir))
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+		std::string file = std::string(path) + "/" + entry->d_name;
+		unlink(file.c_str());
+	}
+
+	closedir(dir);
+	rmdir(path);
+}
+
+int main(int argc, char **argv)
+{
+	double rate = 200;
+	const char *mixSpec = "8:20,20:50,31:30";
+	size_t devices = 200;
+	double seconds = 10;
+	double cpuScale = 4;
+	uint32_t seed = 1;
+	const char *sdRoot = nullptr;
+	host_sd_timing_t sdTiming = {1000, 200, 25000, 3000};
+	const char *replayPath = nullptr;
+	double replaySpeed = 1;
+	bool secondsGiven = false;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const char *arg = argv[i];
+		const char *value = argv[i + 1];
+
+		if (!strcmp(arg, "--rate"))
+			rate = atof(value);
+		else if (!strcmp(arg, "--mix"))
+			mixSpec = value;
+		else if (!strcmp(arg, "--devices"))
+			devices = strtoul(value, nullptr, 0);
+		else if (!strcmp(arg, "--seconds"))
+		{
+			seconds = atof(value);
+			secondsGiven = true;
+		}
+		else if (!strcmp(arg, "--cpu-scale"))
+			cpuScale = atof(value);
+		else if (!strcmp(arg, "--seed"))
+			seed = strtoul(value, nullptr, 0);
+		else if (!strcmp(arg, "--sd"))
+			sdRoot = value;
+		else if (!strcmp(arg, "--replay"))
+			replayPath = value;
+		else if (!strcmp(arg, "--speed"))
+			replaySpeed = atof(value);
+		else if (!strcmp(arg, "--repeat-window"))
+			repeatWindowMillis = strtoul(value, nullptr, 0);
+		else if (!strcmp(arg, "--sd-timing"))
+		{
+			sdTiming = {};
+			sscanf(value, "%u,%u,%u,%u", &sdTiming.callNanos, &sdTiming.commandMicros,
+				   &sdTiming.sectorNanos, &sdTiming.flushMicros);
+		}
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", arg);
+			return 1;
+		}
+	}
+
+	TrafficGenerator traffic(seed, devices ? devices : 1, TrafficGenerator::parseMix(mixSpec));
+
+	if (replayPath)
+		printf("replay %s at speed %.1f, cpu scale %.1f\n", replayPath, replaySpeed, cpuScale);
+	else
+		printf("rate %.0f packets/s per radio, mix %s, %zu devices, %.1f s, cpu scale %.1f\n",
+			   rate, mixSpec, devices, seconds, cpuScale);
+
+	benchParse(traffic, 100000);
+
+	char tempRoot[] = "/tmp/capture_bench.XXXXXX";
+	if (!sdRoot)
+	{
+		sdRoot = mkdtemp(tempRoot);
+		if (!sdRoot)
+		{
+			perror("mkdtemp");
+			return 1;
+		}
+	}
+	SD.setRoot(sdRoot);
+	SD.setTiming(sdTiming);
+
+	setup();
+	uint16_t firstIndex = atoi(logFiles.name());
+
+	radio_port_t radios[] = {
+		{&Serial2, &radio37, 37, 0, 0, 0, {}, 0, 0},
+		{&Serial3, &radio38, 38, 0, 0, 0, {}, 0, 0},
+		{&Serial5, &radio39, 39, 0, 0, 0, {}, 0, 0},
+	};
+
+	uint64_t startMicros = hostMicros();
+	uint64_t endMicros = startMicros + (uint64_t)(seconds * 1e6);
+
+	static LogReplay replay;
+	if (replayPath)
+	{
+		if (!replay.open(replayPath, &Serial1, &Serial2, &Serial3, &Serial5))
+		{
+			fprintf(stderr, "cannot replay %s\n", replayPath);
+			return 1;
+		}
+		if (replaySpeed <= 0)
+			for (auto port : {&Serial1, &Serial2, &Serial3, &Serial5})
+				port->setPaced(false);
+		replay.start(replaySpeed);
+		if (!secondsGiven)
+			endMicros = UINT64_MAX;
+	}
+	uint64_t startPackets = packetCount;
+	host_sd_stats_t startSd = SD.stats();
+	SD.stats().maxCallMicros = 0;
+
+	std::exponential_distribution<double> gap(rate / 1e6);
+	std::mt19937 arrivals(seed);
+
+	for (auto &r : radios)
+	{
+		r.nextMicros = startMicros + gap(arrivals);
+		r.framesOffered = 0;
+		r.bytesOffered = 0;
+		r.backlogStart = r.port->available() + r.radio->ring.available();
+	}
+
+	uint8_t packet[256];
+	uint8_t framed[FRAME_ENCODED_SIZE_MAX(256)];
+	uint64_t chargedNanos = 0;
+	uint64_t loops = 0;
+	auto wallStart = bench_clock_t::now();
+
+	while (hostMicros() < endMicros)
+	{
+		if (replayPath)
+		{
+			replay.feed([&](size_t port, uint64_t bytes) {
+				if (port == 0)
+					return;
+				radio_port_t &r = radios[port - 1];
+				r.framesOffered++;
+				r.bytesOffered = bytes;
+				r.frameEnds.push_back(bytes);
+			});
+
+			// Once everything has been taken, give the firmware 10 ms to
+			// log the last of it
+			bool drained = replay.done() && endMicros == UINT64_MAX;
+			for (auto &r : radios)
+				drained = drained && r.port->drained() && !r.radio->ring.available();
+			if (drained)
+				endMicros = hostMicros() + 10000;
+		}
+		else
+		{
+			// Keep 10 ms of traffic queued on the wire ahead of the clock
+			uint64_t horizon = hostMicros() + 10000;
+			for (auto &r : radios)
+			{
+				while (r.nextMicros < horizon && r.nextMicros < endMicros)
+				{
+					size_t length = traffic.nextPacket(r.channel, (uint32_t)r.nextMicros, packet);
+					size_t n = encodeFrame(packet, length, framed);
+					r.port->inject(framed, n, (uint64_t)r.nextMicros);
+					r.framesOffered++;
+					r.bytesOffered += n;
+					r.frameEnds.push_back(r.bytesOffered);
+					r.nextMicros += gap(arrivals);
+				}
+			}
+		}
+
+		uint64_t virtualBefore = hostMicros();
+		auto t0 = bench_clock_t::now();
+		loop();
+		loops++;
+
+		// Charge the scaled host time, less whatever the firmware already
+		// spent waiting in yield() or delay()
+		chargedNanos += (uint64_t)(elapsedNanos(t0) * cpuScale);
+		uint64_t spent = (hostMicros() - virtualBefore) * 1000;
+		chargedNanos = chargedNanos > spent ? chargedNanos - spent : 0;
+		hostAdvanceMicros(chargedNanos / 1000);
+		chargedNanos %= 1000;
+	}
+
+	double wallSeconds = elapsedNanos(wallStart) / 1e9;
+	double virtualSeconds = (hostMicros() - startMicros) / 1e6;
+
+	// Let the firmware take the frames still on their way at the end, for
+	// at most 100 ms more, so they are not counted as lost
+	uint64_t drainEnd = hostMicros() + 100000;
+	while (hostMicros() < drainEnd)
+	{
+		bool idle = true;
+		for (auto &r : radios)
+			idle = idle && r.port->drained() && !r.radio->ring.available() && !r.radio->frameWaiting;
+		if (idle)
+			break;
+
+		loop();
+		hostAdvanceMicros(10);
+	}
+
+	// Frames offered beyond what 115200 baud can carry never leave the wire,
+	// so the drop rate is taken against frames that fully arrived, and how
+	// many of the generated frames that is shown next to it
+	uint64_t delivered = 0;
+	uint64_t offered = 0;
+	for (auto &r : radios)
+	{
+		delivered += std::upper_bound(r.frameEnds.begin(), r.frameEnds.end(), r.port->stats().bytesArrived) - r.frameEnds.begin();
+		offered += r.framesOffered;
+	}
+
+	uint64_t taken = packetCount - startPackets;
+
+	// Logged means in the files once the writer has finished, not merely
+	// taken by the firmware
+	finishCapture();
+	uint64_t packets = 0;
+	for (uint16_t index = firstIndex; index <= atoi(logFiles.name()); index++)
+	{
+		char name[LOG_FILENAME_SIZE];
+		sprintf(name, "%04u.bin", index);
+		MappedFile log;
+		if (log.open(SD.hostPath(name).c_str()))
+			packets += countRadioPackets(log.data(), log.size());
+	}
+
+	printf("capture: %llu/%llu delivered packets logged (%.2f%%), %llu/%llu offered frames delivered (%.2f%%), %.0f packets/s, %.0f bytes/s to log, %llu loops, %.2f s host time\n",
+		   (unsigned long long)packets, (unsigned long long)delivered, delivered ? 100.0 * packets / delivered : 0.0,
+		   (unsigned long long)delivered, (unsigned long long)offered, offered ? 100.0 * delivered / offered : 0.0,
+		   packets / virtualSeconds, (SD.stats().bytesWritten - startSd.bytesWritten) / virtualSeconds,
+		   (unsigned long long)loops, wallSeconds);
+
+	for (auto &r : radios)
+	{
+		auto &stats = r.port->stats();
+		r.backlogEnd = r.port->available() + r.radio->ring.available();
+		printf("radio %d: %llu frames offered, %llu/%llu bytes arrived, %llu overruns, backlog %zu -> %zu bytes (%+.0f bytes/s), uart high watermark %zu/%zu, ring high watermark %u/%u, %u ring overflows\n",
+			   r.channel, (unsigned long long)r.framesOffered, (unsigned long long)stats.bytesArrived,
+			   (unsigned long long)r.bytesOffered,
+			   (unsigned long long)stats.overruns, r.backlogStart, r.backlogEnd,
+			   ((double)r.backlogEnd - r.backlogStart) / virtualSeconds,
+			   stats.highWatermark, r.port->rxCapacity(),
+			   r.radio->ring.highWatermark, r.radio->ring.capacity(), r.radio->ring.overflows);
+	}
+
+	auto &sd = SD.stats();
+	uint64_t sdBytes = sd.bytesWritten - startSd.bytesWritten;
+	printf("sd: %llu write calls, %llu sector writes, %llu flushes, %.1f metadata writes/MB, busy %.1f%%, longest call %u us\n",
+		   (unsigned long long)(sd.writeCalls - startSd.writeCalls),
+		   (unsigned long long)(sd.sectorWrites - startSd.sectorWrites),
+		   (unsigned long long)(sd.flushCalls - startSd.flushCalls),
+		   sdBytes ? (sd.metadataWrites - startSd.metadataWrites) / (sdBytes / 1048576.0) : 0.0,
+		   (sd.busyMicros - startSd.busyMicros) / 1e4 / virtualSeconds, sd.maxCallMicros);
+
+	printf("frame pool: high watermark %zu, %u stalls\n", framePool.highWatermark, framePool.stalls);
+
+	if (repeatCache.enabled())
+		printf("repeats: %.1f%% of packets counted in %u summaries, %u frames replaced in the cache\n",
+			   taken ? 100.0 * repeatCache.repeats / taken : 0.0, repeatCache.summaries, repeatCache.evictions);
+
+	if (sdRoot == tempRoot)
+		removeDirectory(tempRoot);
+
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "logchunks.h"
+#include "logreader.h"
+#include "logwriter.h"
+#include "mappedfile.h"
+#include "packetdecode.h"
+#include "traffic.h"
+#include "workpool.h"
+
+/*
+	Host log decoder benchmark. Writes a capture log of synthetic traffic
+	through LogWriter, then reads it back in stages against the host
+	clock: plain read() of the file as the bandwidth a reader cannot beat,
+	then through a memory mapping the blocks alone (CRC checks and any
+	decompression), every record, and every record with its radio frame
+	decoded. Each pass is repeated and the best kept, so the file is in
+	the page cache and the figures are the decoder's own speed.
+
+	Last, the decoded stage is repeated split into chunks on a
+	work-stealing pool of 1, 2, 4... up to --threads threads (default one
+	per core), for the scaling of a parallel decode. The host's core count
+	is printed with the figures: more threads than cores show only what
+	the pool costs, not a speedup.
+
+	Usage:
+		decode_bench [--megabytes N] [--devices N] [--compress] [--addresses]
+			[--passes N] [--threads N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static double elapsedSeconds(bench_clock_t::time_point since)
+{
+	return std::chrono::duration<double>(bench_clock_t::now() - since).count();
+}
+
+template <typename F>
+static double best(int passes, F pass)
+{
+	double fastest = 1e30;
+	for (int i = 0; i < passes; i++)
+	{
+		auto start = bench_clock_t::now();
+		pass();
+		double seconds = elapsedSeconds(start);
+		if (seconds < fastest)
+			fastest = seconds;
+	}
+	return fastest;
+}
+
+static void report(const char *name, double seconds, uint64_t fileBytes, uint64_t records)
+{
+	printf("%-8s %8.0f MB/s of file, %6.1f M records/s\n", name, fileBytes / seconds / 1e6, records / seconds / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t megabytes = 256;
+	size_t deviceCount = 200;
+	bool compress = false;
+	bool addresses = false;
+	int passes = 3;
+	size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--compress"))
+			compress = true;
+		else if (!strcmp(argv[i], "--addresses"))
+			addresses = true;
+		else if (i + 1 < argc && !strcmp(argv[i], "--megabytes"))
+			megabytes = strtoull(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--devices"))
+			deviceCount = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--passes"))
+			passes = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--threads"))
+			maxThreads = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[++i], nullptr, 0);
+	}
+
+	char root[] = "/tmp/decode_bench.XXXXXX";
+	if (!mkdtemp(root))
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+
+	SD.setRoot(root);
+	SD.begin(BUILTIN_SDCARD);
+
+	// Write the log, as the firmware would
+	static uint8_t blocks[8192 * 4];
+	static uint8_t staging[8192];
+	static uint16_t hashTable[BLOCK_COMPRESS_HASH_SIZE];
+	static AddressTable addressTable;
+	LogWriter writer(blocks, 8192, 4);
+	if (compress)
+		writer.setCompression(staging, hashTable);
+	if (addresses)
+		writer.setAddressTable(&addressTable, 16);
+
+	FsFile file = SD.sdfs.open("decode.bin", O_RDWR | O_CREAT | O_TRUNC);
+	log_file_header_t header = {};
+	memcpy(header.magic, LOG_FILE_MAGIC, sizeof(header.magic));
+	header.version = LOG_FORMAT_VERSION;
+	header.headerSize = LOG_FILE_HEADER_SIZE;
+	header.blockSize = writer.getBlockSize();
+	header.addressResetBlocks = writer.getAddressResetBlocks();
+	uint8_t sector[LOG_FILE_HEADER_SIZE];
+	buildFileHeaderSector(sector, header);
+	file.write(sector, sizeof(sector));
+	writer.begin(file);
+
+	TrafficGenerator traffic(seed, deviceCount, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	uint8_t frame[256];
+	uint64_t time = 0;
+	uint64_t written = 0;
+	for (uint32_t i = 0; writer.recordBytes < megabytes * 1000000; i++)
+	{
+		time += 1 + traffic.random() % 1333;
+		if (i % 400 == 0)
+			writer.beginRecord(OUTPUT_TYPE_SYSTEM_TIMESTAMP, time / 1000, time % 1000, 0);
+
+		size_t length = traffic.nextPacket(37 + i % 3, time, frame);
+		writer.writePacket(OUTPUT_TYPE_RADIO_PACKET_37 + i % 3, time / 1000, time % 1000, frame, length);
+		writer.service();
+		written++;
+	}
+	writer.finish();
+	file.close();
+
+	char path[64];
+	snprintf(path, sizeof(path), "%s/decode.bin", root);
+
+	MappedFile mapped;
+	if (!mapped.open(path))
+	{
+		perror(path);
+		return 1;
+	}
+	uint64_t fileBytes = mapped.size();
+	printf("%.0f MB log, %llu packets, %s, %s, %zu advertisers\n", fileBytes / 1e6, (unsigned long long)written,
+		   compress ? "compressed" : "uncompressed", addresses ? "address table" : "no address table", deviceCount);
+
+	// The ceiling: copying the file out of the page cache
+	std::vector<uint8_t> chunk(1 << 20);
+	double seconds = best(passes, [&] {
+		int fd = open(path, O_RDONLY);
+		while (read(fd, chunk.data(), chunk.size()) > 0)
+			;
+		close(fd);
+	});
+	report("read", seconds, fileBytes, 0);
+
+	uint64_t blocksRead = 0;
+	seconds = best(passes, [&] {
+		LogReader reader(mapped.data(), mapped.size());
+		log_block_t block;
+		blocksRead = 0;
+		while (reader.nextBlock(block))
+			blocksRead++;
+	});
+	report("blocks", seconds, fileBytes, 0);
+
+	uint64_t records = 0;
+	seconds = best(passes, [&] {
+		LogReader reader(mapped.data(), mapped.size());
+		log_record_t record;
+		records = 0;
+		while (reader.next(record))
+			records++;
+	});
+	report("records", seconds, fileBytes, records);
+
+	uint64_t rssiSum = 0;
+	seconds = best(passes, [&] {
+		LogReader reader(mapped.data(), mapped.size());
+		rssiSum = 0;
+		decodeLog(reader, [&](const log_record_t &, const decoded_packet_t *packet) {
+			if (packet && packet->tag == TAG_DATA)
+				rssiSum += packet->rssi + packet->channel + packet->pduType + (packet->address ? packet->address[0] : 0);
+		});
+	});
+	report("decoded", seconds, fileBytes, records);
+	printf("%llu blocks, %llu records (checksum %llu)\n", (unsigned long long)blocksRead, (unsigned long long)records,
+		   (unsigned long long)rssiSum);
+
+	printf("parallel decode on %u cores\n", std::thread::hardware_concurrency());
+	double oneThread = 0;
+	std::vector<size_t> threadCounts;
+	for (size_t threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	for (size_t threads : threadCounts)
+	{
+		std::atomic<uint64_t> parallelRecords(0);
+		std::atomic<uint64_t> parallelSum(0);
+		uint64_t steals = 0;
+		seconds = best(passes, [&] {
+			parallelRecords = 0;
+			parallelSum = 0;
+			std::vector<log_chunk_t> chunks = splitLog(mapped.data(), mapped.size(), threads * 4);
+			WorkStealingPool pool(threads);
+			for (const log_chunk_t &chunk : chunks)
+			{
+				pool.submit([&, chunk] {
+					LogReader reader = chunkReader(mapped.data(), mapped.size(), chunk);
+					decoded_packet_t packet;
+					uint64_t count = 0;
+					uint64_t sum = 0;
+					readChunk(reader, chunk, [&](const log_record_t &record) {
+						count++;
+						bool radio = record.type >= OUTPUT_TYPE_RADIO_PACKET_37 && record.type <= OUTPUT_TYPE_RADIO_PACKET_39;
+						if (radio && decodePacket(record.payload, record.length, packet) && packet.tag == TAG_DATA)
+							sum += packet.rssi + packet.channel + packet.pduType + (packet.address ? packet.address[0] : 0);
+					});
+					parallelRecords += count;
+					parallelSum += sum;
+				});
+			}
+			pool.wait();
+			steals = pool.steals;
+		});
+		if (threads == 1)
+			oneThread = seconds;
+
+		char name[16];
+		snprintf(name, sizeof(name), "%zu thr", threads);
+		report(name, seconds, fileBytes, parallelRecords);
+		printf("         %.2fx, %llu steals%s\n", oneThread / seconds, (unsigned long long)steals,
+			   parallelRecords == records && parallelSum == rssiSum ? "" : ", MISMATCH");
+	}
+
+	mapped.close();
+	SD.remove("decode.bin");
+	rmdir(root);
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "framepool.h"
+#include "packetfilter.h"
+#include "traffic.h"
+
+/*
+	Packet filter benchmark. Compiles rule sets of 1, 10 and 100 rules,
+	each a random mix of manufacturer, address prefix, AD pattern, RSSI,
+	channel and type conditions, some taken from the traffic so they
+	match now and then, with "default drop" so most packets run through
+	every rule as they would when only a few devices are of interest.
+	Then times PacketFilter::keep() over synthetic advertising traffic,
+	including the AdIndex it needs, and reports the share of packets
+	kept and the size of the compiled program.
+
+	Usage:
+		filter_bench [--packets N] [--devices N] [--rounds N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static std::string makeRules(uint32_t count, std::mt19937 &rng, const std::vector<uint8_t> &corpus,
+							 const std::vector<uint32_t> &offsets)
+{
+	std::string text = "# generated\n";
+	char line[FILTER_LINE_SIZE];
+	for (uint32_t r = 0; r < count; r++)
+	{
+		// A packet of the traffic for the rule to be about
+		uint32_t i = rng() % (offsets.size() - 1);
+		PacketView packet(&corpus[offsets[i]], offsets[i + 1] - offsets[i]);
+		const uint8_t *address = packet.address();
+		AdIndex ads(packet);
+		uint16_t company = rng();
+		bool real = rng() % 4 == 0;
+		if (real)
+			ads.manufacturer(company);
+
+		switch (rng() % 5)
+		{
+		case 0:
+			snprintf(line, sizeof(line), "keep manufacturer 0x%04X\n", company);
+			break;
+		case 1:
+			snprintf(line, sizeof(line), "keep address %02X:%02X:%02X:00:00:00/24 random\n",
+					 real ? address[5] : (uint8_t)rng(), real ? address[4] : (uint8_t)rng(), address[3]);
+			break;
+		case 2:
+			snprintf(line, sizeof(line), "keep ad 0xFF@2 %02X%02X\n", (uint8_t)rng(), (uint8_t)rng());
+			break;
+		case 3:
+			snprintf(line, sizeof(line), "drop rssi < -%u channel %u manufacturer 0x%04X\n", (unsigned)(60 + rng() % 40),
+					 (unsigned)(37 + rng() % 3), company);
+			break;
+		default:
+			snprintf(line, sizeof(line), "keep type scan_rsp rssi >= -%u address %02X:%02X:00:00:00:00/16\n",
+					 (unsigned)(40 + rng() % 20), (uint8_t)rng(), (uint8_t)rng());
+			break;
+		}
+		text += line;
+	}
+	return text + "default drop\n";
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t packets = 1 << 16;
+	uint32_t devices = 2000;
+	uint32_t rounds = 20;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "--packets"))
+			packets = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--devices"))
+			devices = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--rounds"))
+			rounds = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[++i], nullptr, 0);
+		else
+		{
+			fprintf(stderr, "usage: filter_bench [--packets N] [--devices N] [--rounds N] [--seed N]\n");
+			return 2;
+		}
+	}
+
+	TrafficGenerator traffic(seed, devices, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	std::vector<uint8_t> corpus;
+	std::vector<uint32_t> offsets;
+	uint8_t frame[FRAME_BUFFER_SIZE];
+	for (uint32_t i = 0; i < packets; i++)
+	{
+		size_t length = traffic.nextPacket(37 + i % 3, i * 250, frame);
+		offsets.push_back(corpus.size());
+		corpus.insert(corpus.end(), frame, frame + length);
+	}
+	offsets.push_back(corpus.size());
+
+	std::mt19937 rng(seed);
+	static PacketFilter filter;
+	static const uint32_t ruleCounts[] = {0, 1, 10, 100};
+
+	printf("%6s %8s %12s %8s\n", "rules", "bytes", "ns/packet", "kept");
+	for (uint32_t rules : ruleCounts)
+	{
+		std::string text = rules ? makeRules(rules, rng, corpus, offsets) : "";
+		if (!filter.compile(&text[0]))
+		{
+			fprintf(stderr, "line %u: %s\n", filter.errorLine(), filter.error());
+			return 1;
+		}
+
+		uint64_t kept = 0;
+		auto start = bench_clock_t::now();
+		for (uint32_t r = 0; r < rounds; r++)
+		{
+			for (uint32_t i = 0; i < packets; i++)
+			{
+				PacketView packet(&corpus[offsets[i]], offsets[i + 1] - offsets[i]);
+				kept += filter.keep(packet, AdIndex(packet));
+			}
+		}
+		double nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+
+		printf("%6u %8u %12.1f %7.1f%%\n", filter.rules(), filter.size(), nanos / ((double)packets * rounds),
+			   100.0 * kept / ((double)packets * rounds));
+	}
+	return 0;
+}
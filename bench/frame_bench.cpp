@@ -0,0 +1,219 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <vector>
+
+#include "framing.h"
+#include "traffic.h"
+
+/*
+	Frame decoder microbenchmark: the original byte-at-a-time consumeFrame()
+	(a virtual read() per byte through timedRead()) against FrameDecoder's
+	bulk path, both fed from memory so only the decode cost is compared.
+
+	Usage:
+		frame_bench [--frames N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+/*
+	In-memory stream, readBytes() copies in bulk like the host UART does
+*/
+class MemoryStream : public Stream
+{
+private:
+	const std::vector<uint8_t> &data;
+	size_t pos;
+
+public:
+	MemoryStream(const std::vector<uint8_t> &data) : data(data), pos(0) {}
+
+	int available() override { return data.size() - pos; }
+	int read() override { return pos < data.size() ? data[pos++] : -1; }
+	int peek() override { return pos < data.size() ? data[pos] : -1; }
+	size_t write(uint8_t) override { return 0; }
+
+	size_t readBytes(char *buffer, size_t length) override
+	{
+		if (length > data.size() - pos)
+			length = data.size() - pos;
+		memcpy(buffer, data.data() + pos, length);
+		pos += length;
+		return length;
+	}
+	using Stream::readBytes;
+};
+
+/*
+	The decoder as it was before FrameDecoder, kept as the baseline
+*/
+static uint8_t referenceBuffer[65536];
+
+static int referenceTimedRead(Stream &stream, uint32_t timeout)
+{
+	int c;
+	unsigned long startMillis = millis();
+	do
+	{
+		c = stream.read();
+		if (c >= 0)
+			return c;
+		yield();
+	} while (millis() - startMillis < timeout);
+	return -1;
+}
+
+static int32_t referenceConsumeFrame(Stream &radio)
+{
+	uint16_t length = 0;
+	uint8_t checksum = BYTE_SEED;
+
+	while (true)
+	{
+		int32_t data = referenceTimedRead(radio, 100);
+		if (data == -1)
+			return -1;
+
+		if (data == BYTE_ESC)
+		{
+			data = referenceTimedRead(radio, 100);
+			if (data == -1)
+				return -1;
+			data ^= BYTE_XOR;
+		}
+		else if (data == BYTE_END)
+			break;
+
+		referenceBuffer[length] = data;
+		checksum ^= data;
+
+		length++;
+	}
+
+	length--;
+
+	if (checksum != 0)
+		return -1;
+
+	return length;
+}
+
+struct result_t
+{
+	uint64_t frames;
+	uint64_t payloadSum;
+	double nanos;
+};
+
+static result_t runReference(const std::vector<uint8_t> &corpus)
+{
+	MemoryStream stream(corpus);
+	result_t result = {};
+
+	auto start = bench_clock_t::now();
+	while (stream.available())
+	{
+		if (stream.read() != BYTE_START)
+			continue;
+
+		int32_t length = referenceConsumeFrame(stream);
+		if (length < 0)
+			continue;
+
+		result.frames++;
+		result.payloadSum += length + referenceBuffer[length - 1];
+	}
+	result.nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+	return result;
+}
+
+static result_t runBulk(const std::vector<uint8_t> &corpus)
+{
+	static uint8_t buffer[1024];
+	FrameDecoder decoder(buffer, sizeof(buffer));
+	MemoryStream stream(corpus);
+	result_t result = {};
+
+	auto start = bench_clock_t::now();
+	int32_t length;
+	while ((length = decoder.consume(stream)) != FRAME_INCOMPLETE)
+	{
+		if (length < 0)
+			continue;
+
+		result.frames++;
+		result.payloadSum += length + decoder.frame()[length - 1];
+	}
+	result.nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+	return result;
+}
+
+static void report(const char *corpusName, const std::vector<uint8_t> &corpus)
+{
+	// Best of several runs to keep scheduler noise out of the comparison
+	result_t reference = runReference(corpus);
+	result_t bulk = runBulk(corpus);
+	for (int i = 0; i < 4; i++)
+	{
+		result_t r = runReference(corpus);
+		if (r.nanos < reference.nanos)
+			reference = r;
+		r = runBulk(corpus);
+		if (r.nanos < bulk.nanos)
+			bulk = r;
+	}
+
+	if (reference.frames != bulk.frames || reference.payloadSum != bulk.payloadSum)
+		printf("%s: MISMATCH reference %llu frames, bulk %llu frames\n", corpusName,
+			   (unsigned long long)reference.frames, (unsigned long long)bulk.frames);
+
+	printf("%-12s %8.2f MB, %llu frames\n", corpusName, corpus.size() / 1e6, (unsigned long long)bulk.frames);
+	printf("  reference  %7.2f ns/byte %8.1f ns/frame %8.1f MB/s\n",
+		   reference.nanos / corpus.size(), reference.nanos / reference.frames, corpus.size() * 1e3 / reference.nanos);
+	printf("  bulk       %7.2f ns/byte %8.1f ns/frame %8.1f MB/s (%.1fx)\n",
+		   bulk.nanos / corpus.size(), bulk.nanos / bulk.frames, corpus.size() * 1e3 / bulk.nanos,
+		   reference.nanos / bulk.nanos);
+}
+
+int main(int argc, char **argv)
+{
+	size_t frames = 200000;
+	uint32_t seed = 1;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--frames"))
+			frames = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[i + 1], nullptr, 0);
+	}
+
+	uint8_t packet[256];
+	uint8_t framed[FRAME_ENCODED_SIZE_MAX(256)];
+
+	// Advertising traffic as the radios deliver it
+	TrafficGenerator traffic(seed, 500, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	std::vector<uint8_t> advertising;
+	for (size_t i = 0; i < frames; i++)
+	{
+		size_t length = traffic.nextPacket(37 + i % 3, i * 1000, packet);
+		size_t n = encodeFrame(packet, length, framed);
+		advertising.insert(advertising.end(), framed, framed + n);
+	}
+
+	// Worst case: every other payload byte needs escaping
+	std::vector<uint8_t> escapes;
+	for (size_t i = 0; i < frames; i++)
+	{
+		size_t length = 16 + traffic.random() % 32;
+		for (size_t j = 0; j < length; j++)
+			packet[j] = j % 2 ? BYTE_START - traffic.random() % 3 : traffic.random();
+		size_t n = encodeFrame(packet, length, framed);
+		escapes.insert(escapes.end(), framed, framed + n);
+	}
+
+	report("advertising", advertising);
+	report("escape-heavy", escapes);
+	return 0;
+}
@@ -0,0 +1,308 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <vector>
+
+#include "logreader.h"
+#include "logwriter.h"
+#include "traffic.h"
+
+/*
+	SD log write benchmark. Writes the same stream of radio packet records
+	to the card stand-in twice: straight through File, five write() calls
+	per record and a flush() every sync interval as loop() used to, then
+	through LogWriter with one service() per record and a sync() every
+	interval, once letting the file grow cluster by cluster and once into a
+	preallocated extent. Only the card timing moves the virtual clock, so the results
+	are the card-limited bandwidth and the time each record held up the
+	capture loop. The direct run writes version 0 records, the buffered
+	runs a version 3 log, so comparing their bytes/packet shows what the
+	delta timestamps save; the framing figure is the share of the file
+	taken by its header, block headers and block padding.
+
+	A compressed run compresses the preallocated log's blocks, then the
+	blocks it wrote are decompressed and compressed again against the host
+	clock to give the CPU cost of each per MB of records, also scaled by
+	--cpu-scale as an estimate for the Teensy. The last runs replace
+	advertiser addresses with address table slots, without and with
+	compression, followed by the host time of one table lookup per
+	packet.
+
+	Usage:
+		log_bench [--records N] [--devices N] [--sync-ms MS] [--seed N] [--cpu-scale F]
+			[--sd-timing CALL_NS,COMMAND_US,SECTOR_NS,FLUSH_US]
+*/
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t millis;
+	uint16_t microsFraction;
+	uint32_t length;
+	uint8_t data[256];
+} __packed record_t;
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static char root[] = "/tmp/log_bench.XXXXXX";
+static double cpuScale = 4.0;
+
+static uint64_t percentile(std::vector<uint64_t> &sorted, double p)
+{
+	size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+static void report(const char *name, std::vector<uint64_t> &latency, uint64_t bytes, uint64_t virtualMicros, uint64_t metadataWrites)
+{
+	std::sort(latency.begin(), latency.end());
+	auto &sd = SD.stats();
+	printf("%-12s %6.2f MB/s, %.0f packets/s, %.1f bytes/packet, record latency us p50 %llu p99 %llu p99.9 %llu max %llu, %llu write calls, %llu sector writes, %.1f metadata writes/MB\n",
+		   name, bytes / (double)virtualMicros, latency.size() * 1e6 / virtualMicros, bytes / (double)latency.size(),
+		   (unsigned long long)percentile(latency, 50), (unsigned long long)percentile(latency, 99),
+		   (unsigned long long)percentile(latency, 99.9), (unsigned long long)latency.back(),
+		   (unsigned long long)sd.writeCalls, (unsigned long long)sd.sectorWrites,
+		   metadataWrites / (bytes / 1048576.0));
+}
+
+static double elapsedMillis(bench_clock_t::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock_t::now() - since).count();
+}
+
+static void measureCompression(const char *filename)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", root, filename);
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return;
+	std::vector<uint8_t> contents(SD.open(filename).size());
+	contents.resize(fread(contents.data(), 1, contents.size(), f));
+	fclose(f);
+
+	std::vector<std::vector<uint8_t>> blocks;
+	uint64_t storedBytes = 0;
+	{
+		LogReader reader(contents.data(), contents.size());
+		log_block_t block;
+		while (reader.nextBlock(block))
+			blocks.emplace_back(block.records, block.records + block.length);
+		storedBytes = reader.storedBytes;
+	}
+
+	auto start = bench_clock_t::now();
+	LogReader reader(contents.data(), contents.size());
+	log_block_t block;
+	uint64_t recordBytes = 0;
+	while (reader.nextBlock(block))
+		recordBytes += block.length;
+	double decompressMillis = elapsedMillis(start);
+
+	static uint16_t hashTable[BLOCK_COMPRESS_HASH_SIZE];
+	std::vector<uint8_t> out(BLOCK_COMPRESS_BOUND(65536));
+	uint64_t compressedBytes = 0;
+	start = bench_clock_t::now();
+	for (auto &b : blocks)
+		compressedBytes += blockCompress(b.data(), b.size(), out.data(), hashTable);
+	double compressMillis = elapsedMillis(start);
+
+	double megabytes = recordBytes / 1048576.0;
+	printf("             %.2f:1 records to file blocks, %.2f:1 LZ4 alone; compress %.2f ms/MB, decompress and check %.2f ms/MB on this host, compress ~%.1f ms/MB at cpu scale %.1f\n",
+		   recordBytes / (double)storedBytes, recordBytes / (double)compressedBytes,
+		   compressMillis / megabytes, decompressMillis / megabytes, compressMillis / megabytes * cpuScale, cpuScale);
+}
+
+static void measureAddressLookups(const std::vector<record_t> &records)
+{
+	static AddressTable table;
+	uint32_t hits = 0;
+	uint32_t lookups = 0;
+	uint8_t slot;
+
+	auto start = bench_clock_t::now();
+	for (auto &r : records)
+	{
+		const uint8_t *address = frameAddress(r.data, r.length);
+		if (address)
+		{
+			hits += table.lookup(address, slot);
+			lookups++;
+		}
+	}
+	double millis = elapsedMillis(start);
+
+	printf("             address lookup %.1f ns/packet on this host, ~%.1f ns at cpu scale %.1f, %.1f%% hits\n",
+		   millis * 1e6 / lookups, millis * 1e6 / lookups * cpuScale, cpuScale, 100.0 * hits / lookups);
+}
+
+static void runBuffered(const char *name, const char *filename, const std::vector<record_t> &records, uint32_t syncMillis, uint64_t preallocate, bool compress, bool addresses)
+{
+	static uint8_t blocks[8192 * 4];
+	static uint8_t staging[8192];
+	static uint16_t hashTable[BLOCK_COMPRESS_HASH_SIZE];
+	static AddressTable addressTable;
+	LogWriter writer(blocks, 8192, 4);
+	if (compress)
+		writer.setCompression(staging, hashTable);
+	if (addresses)
+		writer.setAddressTable(&addressTable, 16);
+	std::vector<uint64_t> latency;
+	latency.reserve(records.size());
+
+	SD.stats() = {};
+	FsFile file = SD.sdfs.open(filename, O_RDWR | O_CREAT);
+	if (preallocate)
+		file.preAllocate(preallocate);
+
+	log_file_header_t header = {};
+	memcpy(header.magic, LOG_FILE_MAGIC, sizeof(header.magic));
+	header.version = LOG_FORMAT_VERSION;
+	header.headerSize = LOG_FILE_HEADER_SIZE;
+	header.blockSize = writer.getBlockSize();
+	header.addressResetBlocks = writer.getAddressResetBlocks();
+	uint8_t sector[LOG_FILE_HEADER_SIZE];
+	buildFileHeaderSector(sector, header);
+	file.write(sector, sizeof(sector));
+	writer.begin(file);
+	uint64_t setupMetadata = SD.stats().metadataWrites;
+
+	uint64_t start = hostMicros();
+	uint64_t lastSync = start;
+	uint64_t bytes = 0;
+
+	for (auto &r : records)
+	{
+		uint64_t t0 = hostMicros();
+		bytes += writer.writePacket(r.type, r.millis, r.microsFraction, r.data, r.length);
+		writer.service();
+
+		if (hostMicros() - lastSync > syncMillis * 1000ull)
+		{
+			writer.sync();
+			lastSync = hostMicros();
+		}
+		latency.push_back(hostMicros() - t0);
+	}
+
+	uint64_t virtualMicros = hostMicros() - start;
+	uint64_t captureMetadata = SD.stats().metadataWrites - setupMetadata;
+
+	writer.sync();
+	file.truncate(file.size());
+	report(name, latency, bytes, virtualMicros, captureMetadata);
+	printf("             %u blocks, %u stalls, longest block write %u us, %llu metadata writes to allocate and trim, %.2f%% framing, %.1f file bytes/packet\n",
+		   writer.blockWrites, writer.stalls, writer.maxWriteMicros,
+		   (unsigned long long)(SD.stats().metadataWrites - captureMetadata),
+		   100.0 * (file.size() - writer.storedBytes) / file.size(), file.size() / (double)records.size());
+	file.close();
+
+	if (compress)
+		measureCompression(filename);
+	SD.remove(filename);
+}
+
+int main(int argc, char **argv)
+{
+	size_t recordCount = 200000;
+	uint32_t syncMillis = 10000;
+	uint32_t seed = 1;
+	size_t deviceCount = 500;
+	host_sd_timing_t sdTiming = {1000, 200, 25000, 3000};
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--records"))
+			recordCount = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--devices"))
+			deviceCount = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--sync-ms"))
+			syncMillis = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--cpu-scale"))
+			cpuScale = strtod(argv[i + 1], nullptr);
+		else if (!strcmp(argv[i], "--sd-timing"))
+		{
+			sdTiming = {};
+			sscanf(argv[i + 1], "%u,%u,%u,%u", &sdTiming.callNanos, &sdTiming.commandMicros,
+				   &sdTiming.sectorNanos, &sdTiming.flushMicros);
+		}
+	}
+
+	TrafficGenerator traffic(seed, deviceCount, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	std::vector<record_t> records(recordCount);
+	uint64_t time = 0;
+	for (size_t i = 0; i < recordCount; i++)
+	{
+		// About 1500 packets/s across the three radios, as captured
+		time += 1 + traffic.random() % 1333;
+
+		record_t &r = records[i];
+		r.type = 2 + i % 3;
+		r.millis = time / 1000;
+		r.microsFraction = time % 1000;
+		r.length = traffic.nextPacket(37 + i % 3, i, r.data);
+	}
+
+	if (!mkdtemp(root))
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+
+	SD.setRoot(root);
+	SD.begin(BUILTIN_SDCARD);
+	SD.setTiming(sdTiming);
+
+	// Straight through File, as loop() used to write
+	{
+		std::vector<uint64_t> latency;
+		latency.reserve(recordCount);
+
+		SD.stats() = {};
+		File file = SD.open("direct.bin", FILE_WRITE_BEGIN);
+		uint64_t start = hostMicros();
+		uint64_t lastSync = start;
+		uint64_t bytes = 0;
+
+		for (auto &r : records)
+		{
+			uint64_t t0 = hostMicros();
+			file.write(r.type);
+			file.write((uint8_t *)&r.millis, 4);
+			file.write((uint8_t *)&r.microsFraction, 2);
+			file.write((uint8_t *)&r.length, 4);
+			file.write(r.data, r.length);
+			bytes += r.length + 11;
+
+			if (hostMicros() - lastSync > syncMillis * 1000ull)
+			{
+				file.flush();
+				lastSync = hostMicros();
+			}
+			latency.push_back(hostMicros() - t0);
+		}
+
+		report("direct", latency, bytes, hostMicros() - start, SD.stats().metadataWrites);
+		file.close();
+		SD.remove("direct.bin");
+	}
+
+	runBuffered("buffered", "buffered.bin", records, syncMillis, 0, false, false);
+
+	// Generously sized, as the firmware does, then trimmed back
+	runBuffered("preallocated", "prealloc.bin", records, syncMillis, 1024ull * 1024 * 1024, false, false);
+
+	runBuffered("compressed", "compressed.bin", records, syncMillis, 1024ull * 1024 * 1024, true, false);
+
+	runBuffered("addresses", "addresses.bin", records, syncMillis, 1024ull * 1024 * 1024, false, true);
+	runBuffered("both", "both.bin", records, syncMillis, 1024ull * 1024 * 1024, true, true);
+	measureAddressLookups(records);
+
+	rmdir(root);
+	return 0;
+}
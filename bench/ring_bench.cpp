@@ -0,0 +1,178 @@
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "framing.h"
+#include "spscring.h"
+#include "traffic.h"
+
+/*
+	Radio ring check and benchmark. A thread stands in for the ingest
+	interrupt and pushes framed traffic into an SpscRing in small bursts,
+	while the main thread decodes frames out of it with FrameDecoder, the
+	same way loop() does.
+
+	The first run is flow controlled: the producer waits for space, so every
+	frame must come out intact. The second lets the producer run free
+	against a consumer that sleeps between passes, so the ring overflows;
+	every byte must then be accounted for as either consumed or counted as
+	an overflow.
+
+	Usage:
+		ring_bench [--frames N] [--ring BYTES] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+/*
+	Consumer view of the ring that counts what the decoder takes out
+*/
+struct counting_reader_t
+{
+	SpscRing &ring;
+	uint64_t bytes;
+
+	int available() { return ring.available(); }
+
+	size_t readBytes(uint8_t *dst, size_t length)
+	{
+		size_t n = ring.readBytes(dst, length);
+		bytes += n;
+		return n;
+	}
+};
+
+struct run_result_t
+{
+	uint64_t frames;
+	uint64_t payloadSum;
+	uint64_t bytesConsumed;
+	uint32_t badChecksums;
+	double seconds;
+};
+
+static run_result_t run(SpscRing &ring, const std::vector<uint8_t> &corpus, uint32_t seed, bool flowControl)
+{
+	static uint8_t frameBuffer[1024];
+	FrameDecoder decoder(frameBuffer, sizeof(frameBuffer));
+	counting_reader_t reader = {ring, 0};
+	std::atomic<bool> done(false);
+	run_result_t result = {};
+
+	auto start = bench_clock_t::now();
+
+	std::thread producer([&]() {
+		std::mt19937 rng(seed);
+		size_t pos = 0;
+		while (pos < corpus.size())
+		{
+			// A UART interrupt hands over a handful of bytes at a time
+			size_t n = 1 + rng() % 64;
+			if (n > corpus.size() - pos)
+				n = corpus.size() - pos;
+
+			if (flowControl)
+			{
+				while (ring.space() < n)
+					std::this_thread::yield();
+			}
+
+			ring.push(corpus.data() + pos, n);
+			pos += n;
+		}
+		done = true;
+	});
+
+	while (true)
+	{
+		bool finished = done;
+
+		int32_t length;
+		while ((length = decoder.consume(reader)) != FRAME_INCOMPLETE)
+		{
+			if (length < 0)
+				continue;
+
+			result.frames++;
+			result.payloadSum += length + decoder.frame()[length - 1];
+		}
+
+		if (finished && ring.available() == 0)
+			break;
+
+		if (!flowControl)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	producer.join();
+	result.seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+	result.bytesConsumed = reader.bytes;
+	result.badChecksums = decoder.badChecksums;
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	size_t frames = 200000;
+	uint32_t ringSize = 65536;
+	uint32_t seed = 1;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--frames"))
+			frames = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--ring"))
+			ringSize = strtoul(argv[i + 1], nullptr, 0);
+		else if (!strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[i + 1], nullptr, 0);
+	}
+
+	if (ringSize < 64 || (ringSize & (ringSize - 1)))
+	{
+		fprintf(stderr, "ring size must be a power of two, at least 64\n");
+		return 1;
+	}
+
+	TrafficGenerator traffic(seed, 500, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	uint8_t packet[256];
+	uint8_t framed[FRAME_ENCODED_SIZE_MAX(256)];
+	std::vector<uint8_t> corpus;
+	uint64_t expectedSum = 0;
+	for (size_t i = 0; i < frames; i++)
+	{
+		size_t length = traffic.nextPacket(37 + i % 3, i * 1000, packet);
+		size_t n = encodeFrame(packet, length, framed);
+		corpus.insert(corpus.end(), framed, framed + n);
+		expectedSum += length + packet[length - 1];
+	}
+
+	std::vector<uint8_t> storage(ringSize);
+	int status = 0;
+
+	{
+		SpscRing ring(storage.data(), ringSize);
+		run_result_t r = run(ring, corpus, seed, true);
+		bool ok = r.frames == frames && r.payloadSum == expectedSum && ring.overflows == 0;
+		printf("flow controlled: %llu/%zu frames intact, %.1f MB/s, high watermark %u/%u, %u overflows: %s\n",
+			   (unsigned long long)r.frames, frames, corpus.size() / r.seconds / 1e6,
+			   ring.highWatermark, ring.capacity(), ring.overflows, ok ? "ok" : "FAILED");
+		if (!ok)
+			status = 1;
+	}
+
+	{
+		SpscRing ring(storage.data(), ringSize);
+		run_result_t r = run(ring, corpus, seed, false);
+		bool ok = r.bytesConsumed + ring.overflows == corpus.size() && r.frames <= frames;
+		printf("free running: %llu/%zu frames decoded, %u bytes overflowed (%.1f%%), %u bad checksums, high watermark %u/%u: %s\n",
+			   (unsigned long long)r.frames, frames, ring.overflows, 100.0 * ring.overflows / corpus.size(),
+			   r.badChecksums, ring.highWatermark, ring.capacity(), ok ? "ok" : "FAILED");
+		if (!ok)
+			status = 1;
+	}
+
+	return status;
+}
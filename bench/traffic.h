@@ -0,0 +1,146 @@
+#ifndef __TRAFFIC_H_
+#define __TRAFFIC_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "packet.h"
+
+#define ADVERTISING_RADIO_ACCESS_ADDRESS (0x8E89BED6)
+
+/*
+	Synthetic advertising traffic: a fixed population of advertisers, each
+	with its own address, PDU type and AD payload, picked at random for every
+	packet. Payload lengths follow a weighted mix such as "8:20,20:50,31:30"
+	(AD length:weight). Like real devices, an advertiser sends the same
+	payload every time, with an occasional changing byte for some of them.
+*/
+class TrafficGenerator
+{
+private:
+	struct advertiser_t
+	{
+		uint8_t type;
+		uint8_t addr[BDADDR_SIZE];
+		std::vector<uint8_t> data;
+		bool rolling;
+		uint8_t counter;
+	};
+
+	std::mt19937 rng;
+	std::vector<advertiser_t> advertisers;
+
+public:
+	TrafficGenerator(uint32_t seed, size_t deviceCount, const std::vector<std::pair<int, int>> &mix)
+		: rng(seed)
+	{
+		std::vector<int> weights;
+		for (auto &m : mix)
+			weights.push_back(m.second);
+		std::discrete_distribution<int> pickLength(weights.begin(), weights.end());
+
+		static const uint8_t types[] = {
+			PDU_ADV_TYPE_ADV_IND,
+			PDU_ADV_TYPE_ADV_IND,
+			PDU_ADV_TYPE_NONCONN_IND,
+			PDU_ADV_TYPE_SCAN_RSP,
+			PDU_ADV_TYPE_SCAN_IND,
+		};
+
+		for (size_t i = 0; i < deviceCount; i++)
+		{
+			advertiser_t a;
+			a.type = types[rng() % sizeof(types)];
+			for (auto &b : a.addr)
+				b = rng();
+
+			int length = mix.empty() ? 20 : mix[pickLength(rng)].first;
+			if (length > 31)
+				length = 31;
+
+			// Flags AD structure followed by manufacturer data, as most devices send
+			if (length >= 3)
+			{
+				a.data.insert(a.data.end(), {0x02, 0x01, 0x06});
+				if (length > 5)
+				{
+					a.data.push_back(length - 4);
+					a.data.push_back(0xFF);
+					while ((int)a.data.size() < length)
+						a.data.push_back(rng());
+				}
+			}
+			while ((int)a.data.size() < length)
+				a.data.push_back(0);
+
+			a.rolling = rng() % 4 == 0;
+			a.counter = 0;
+			advertisers.push_back(a);
+		}
+	}
+
+	/*
+		Parse a mix specification like "8:20,20:50,31:30"
+	*/
+	static std::vector<std::pair<int, int>> parseMix(const char *spec)
+	{
+		std::vector<std::pair<int, int>> mix;
+		while (*spec)
+		{
+			char *end;
+			int length = strtol(spec, &end, 10);
+			if (end == spec)
+				break;
+
+			int weight = 1;
+			if (*end == ':')
+				weight = strtol(end + 1, &end, 10);
+
+			mix.push_back({length, weight});
+			spec = *end == ',' ? end + 1 : end;
+		}
+		return mix;
+	}
+
+	/*
+		Build the packet_t bytes a radio would send for one received PDU.
+		Returns the packet length.
+	*/
+	size_t nextPacket(uint8_t channel, uint32_t timestamp, uint8_t *out)
+	{
+		advertiser_t &a = advertisers[rng() % advertisers.size()];
+		if (a.rolling && !a.data.empty())
+			a.data.back() = a.counter++;
+
+		packet_t *packet = (packet_t *)out;
+		radio_t *radio = &packet->payload;
+
+		radio->timestamp = timestamp;
+		radio->channel = channel;
+		radio->flags = 0x04;
+		radio->rssi_negative = 40 + rng() % 55;
+		radio->_reserved = 0;
+		radio->aa = ADVERTISING_RADIO_ACCESS_ADDRESS;
+
+		struct pdu_adv *pdu = &radio->pdu.adv;
+		memset(pdu, 0, 2);
+		pdu->type = a.type;
+		pdu->tx_addr = 1;
+		pdu->len = BDADDR_SIZE + a.data.size();
+		memcpy(pdu->adv_ind.addr, a.addr, BDADDR_SIZE);
+		memcpy(pdu->adv_ind.data, a.data.data(), a.data.size());
+
+		size_t radioLength = offsetof(radio_t, pdu) + 2 + pdu->len;
+		packet->header.tag = TAG_DATA;
+		packet->header.length = radioLength;
+
+		return sizeof(packet_header_t) + radioLength;
+	}
+
+	uint32_t random() { return rng(); }
+};
+
+#endif // __TRAFFIC_H_
@@ -0,0 +1,182 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <vector>
+
+#include "framepool.h"
+#include "packetview.h"
+#include "traffic.h"
+
+/*
+	PacketView microbenchmark. Reads the same fields of every frame of a
+	synthetic corpus three ways: through the packed packet_t and pdu_adv
+	bitfields as processPacket() used to, by hand at fixed byte offsets,
+	and through PacketView, including a walk of the AD structures. Each
+	way folds what it read into a checksum, which must agree across all
+	three, and should take the same time per packet as the others.
+
+	Usage:
+		view_bench [--packets N] [--devices N] [--rounds N] [--seed N]
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct corpus_t
+{
+	std::vector<uint8_t> bytes;
+	std::vector<uint32_t> offsets;
+};
+
+static inline uint32_t mix(uint32_t sum, uint32_t value)
+{
+	return (sum ^ value) * 16777619u;
+}
+
+static uint32_t readStruct(const uint8_t *frame, size_t length)
+{
+	const packet_t *packet = (const packet_t *)frame;
+	if (length < VIEW_PDU_OFFSET || packet->header.tag != TAG_DATA)
+		return 0;
+
+	const radio_t &radio = packet->payload;
+	const struct pdu_adv &adv = radio.pdu.adv;
+	if (length - VIEW_PDU_OFFSET < adv.len)
+		return 0;
+
+	uint32_t sum = mix(radio.timestamp, radio.channel);
+	sum = mix(sum, radio.flags & RADIO_FLAG_CRC_OK);
+	sum = mix(sum, -(int)radio.rssi_negative);
+	sum = mix(sum, radio.aa);
+	sum = mix(sum, adv.type);
+	sum = mix(sum, adv.tx_addr);
+	if (adv.len >= BDADDR_SIZE)
+	{
+		sum = mix(sum, adv.adv_ind.addr[0] | adv.adv_ind.addr[5] << 8);
+
+		const uint8_t *p = adv.adv_ind.data;
+		const uint8_t *end = adv.payload + adv.len;
+		while (p < end && p[0] && p[0] <= end - p - 1)
+		{
+			sum = mix(sum, p[1] << 8 | (p[0] - 1));
+			p += p[0] + 1;
+		}
+	}
+	return sum;
+}
+
+static uint32_t readOffsets(const uint8_t *frame, size_t length)
+{
+	if (length < 17 || frame[0] != TAG_DATA)
+		return 0;
+
+	uint8_t pduLength = frame[16];
+	if (length - 17 < pduLength)
+		return 0;
+
+	uint32_t timestamp, aa;
+	memcpy(&timestamp, frame + 3, 4);
+	memcpy(&aa, frame + 11, 4);
+
+	uint32_t sum = mix(timestamp, frame[7]);
+	sum = mix(sum, frame[8] & RADIO_FLAG_CRC_OK);
+	sum = mix(sum, -(int)frame[9]);
+	sum = mix(sum, aa);
+	sum = mix(sum, frame[15] & 0x0F);
+	sum = mix(sum, (frame[15] >> 6) & 1);
+	if (pduLength >= BDADDR_SIZE)
+	{
+		sum = mix(sum, frame[17] | frame[22] << 8);
+
+		const uint8_t *p = frame + 23;
+		const uint8_t *end = frame + 17 + pduLength;
+		while (p < end && p[0] && p[0] <= end - p - 1)
+		{
+			sum = mix(sum, p[1] << 8 | (p[0] - 1));
+			p += p[0] + 1;
+		}
+	}
+	return sum;
+}
+
+static uint32_t readView(const uint8_t *frame, size_t length)
+{
+	PacketView packet(frame, length);
+	if (!packet.isAdvertising())
+		return 0;
+
+	uint32_t sum = mix(packet.timestamp(), packet.channel());
+	sum = mix(sum, packet.crcOk() ? RADIO_FLAG_CRC_OK : 0);
+	sum = mix(sum, packet.rssi());
+	sum = mix(sum, packet.accessAddress());
+	sum = mix(sum, packet.advType());
+	sum = mix(sum, packet.txAddrRandom());
+	if (const uint8_t *address = packet.address())
+	{
+		sum = mix(sum, address[0] | address[5] << 8);
+
+		// Every generated type carries AD data after the address
+		for (ad_structure_t ad : AdStructures(address + BDADDR_SIZE, packet.pduLength() - BDADDR_SIZE))
+			sum = mix(sum, ad.type << 8 | ad.length);
+	}
+	return sum;
+}
+
+template <typename F>
+static void run(const char *name, const corpus_t &corpus, uint32_t rounds, F read)
+{
+	size_t count = corpus.offsets.size() - 1;
+	uint32_t sum = 0;
+
+	auto start = bench_clock_t::now();
+	for (uint32_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < count; i++)
+			sum += read(&corpus.bytes[corpus.offsets[i]], corpus.offsets[i + 1] - corpus.offsets[i]);
+	double nanos = std::chrono::duration<double, std::nano>(bench_clock_t::now() - start).count();
+
+	printf("%-8s %6.2f ns/packet, checksum %08x\n", name, nanos / ((double)count * rounds), sum);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t packets = 1 << 16;
+	uint32_t devices = 200;
+	uint32_t rounds = 100;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "--packets"))
+			packets = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--devices"))
+			devices = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--rounds"))
+			rounds = strtoul(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--seed"))
+			seed = strtoul(argv[++i], nullptr, 0);
+		else
+		{
+			fprintf(stderr, "usage: view_bench [--packets N] [--devices N] [--rounds N] [--seed N]\n");
+			return 2;
+		}
+	}
+
+	TrafficGenerator traffic(seed, devices, TrafficGenerator::parseMix("8:20,20:50,31:30"));
+	corpus_t corpus;
+	uint8_t frame[FRAME_BUFFER_SIZE];
+	for (uint32_t i = 0; i < packets; i++)
+	{
+		size_t length = traffic.nextPacket(37 + i % 3, i * 250, frame);
+		corpus.offsets.push_back(corpus.bytes.size());
+		corpus.bytes.insert(corpus.bytes.end(), frame, frame + length);
+	}
+	corpus.offsets.push_back(corpus.bytes.size());
+
+	// Twice over, so each one runs warm at least once
+	for (int pass = 0; pass < 2; pass++)
+	{
+		run("struct", corpus, rounds, readStruct);
+		run("offsets", corpus, rounds, readOffsets);
+		run("view", corpus, rounds, readView);
+	}
+	return 0;
+}
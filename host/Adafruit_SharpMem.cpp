@@ -0,0 +1,50 @@
+#include "Adafruit_SharpMem.h"
+
+Adafruit_SharpMem::Adafruit_SharpMem(uint8_t, uint8_t, uint8_t, uint16_t w,
+									 uint16_t h, uint32_t)
+	: Adafruit_GFX(w, h), buffer((w * h + 7) / 8, 0xFF), refreshes(0)
+{
+}
+
+boolean Adafruit_SharpMem::begin()
+{
+	return true;
+}
+
+void Adafruit_SharpMem::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+	if (x < 0 || x >= width() || y < 0 || y >= height())
+		return;
+
+	// Rotation is not used by the firmware, pixels are stored unrotated
+	size_t bit = (size_t)y * WIDTH + x;
+	if (color)
+		buffer[bit / 8] |= 1 << (bit % 8);
+	else
+		buffer[bit / 8] &= ~(1 << (bit % 8));
+}
+
+uint8_t Adafruit_SharpMem::getPixel(uint16_t x, uint16_t y)
+{
+	if (x >= WIDTH || y >= HEIGHT)
+		return 0;
+
+	size_t bit = (size_t)y * WIDTH + x;
+	return (buffer[bit / 8] >> (bit % 8)) & 1;
+}
+
+void Adafruit_SharpMem::clearDisplay()
+{
+	clearDisplayBuffer();
+	refresh();
+}
+
+void Adafruit_SharpMem::refresh(void)
+{
+	refreshes++;
+}
+
+void Adafruit_SharpMem::clearDisplayBuffer()
+{
+	std::fill(buffer.begin(), buffer.end(), 0xFF);
+}
@@ -0,0 +1,34 @@
+#ifndef __ADAFRUIT_SHARPMEM_H_
+#define __ADAFRUIT_SHARPMEM_H_
+
+#include <algorithm>
+#include <vector>
+
+#include <Adafruit_GFX.h>
+
+/*
+	Host stand-in for the SHARP memory display: drawing goes to an in-memory
+	1bpp framebuffer and refresh() only counts frames
+*/
+class Adafruit_SharpMem : public Adafruit_GFX
+{
+private:
+	std::vector<uint8_t> buffer;
+	uint32_t refreshes;
+
+public:
+	Adafruit_SharpMem(uint8_t clk, uint8_t mosi, uint8_t cs, uint16_t w = 96,
+					  uint16_t h = 96, uint32_t freq = 2000000);
+
+	boolean begin();
+	void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+	uint8_t getPixel(uint16_t x, uint16_t y);
+	void clearDisplay();
+	void refresh(void);
+	void clearDisplayBuffer();
+
+	// Host only
+	uint32_t refreshCount() { return refreshes; }
+};
+
+#endif // __ADAFRUIT_SHARPMEM_H_
@@ -0,0 +1,131 @@
+#ifndef __ARDUINO_H_
+#define __ARDUINO_H_
+
+/*
+	Host stand-in for the subset of the Teensy 4.1 Arduino core used by the
+	capture firmware. Time is virtual: millis() and micros() only move when
+	the host runner, delay() or yield() advance the clock, so a run over the
+	same input is reproducible regardless of the speed of the build machine.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+
+#define DMAMEM
+#define FASTRUN
+#define PROGMEM
+#define F(s) ((const __FlashStringHelper *)(s))
+
+#define HIGH (1)
+#define LOW (0)
+#define INPUT (0)
+#define OUTPUT (1)
+#define INPUT_PULLUP (2)
+
+#define LED_BUILTIN (13)
+
+#define DEC (10)
+#define HEX (16)
+#define OCT (8)
+#define BIN (2)
+
+#define SERIAL_8N1 (0)
+
+// Unique chip ID fuses, fixed on the host
+#define HW_OCOTP_CFG0 (0x484F5354)
+#define HW_OCOTP_CFG1 (0x00000001)
+
+#define PI (3.1415926535897932384626433832795)
+#define DEG_TO_RAD (0.017453292519943295769236907684886)
+#define RAD_TO_DEG (57.295779513082320876798154814105)
+
+enum BitOrder
+{
+	LSBFIRST = 0,
+	MSBFIRST = 1,
+};
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class __FlashStringHelper;
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "IntervalTimer.h"
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void delayNanoseconds(uint32_t ns);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+
+template <class A, class B>
+constexpr auto min(A a, B b) -> decltype(a < b ? a : b)
+{
+	return b < a ? b : a;
+}
+
+template <class A, class B>
+constexpr auto max(A a, B b) -> decltype(a < b ? a : b)
+{
+	return a < b ? b : a;
+}
+
+inline bool isDigit(int c)
+{
+	return isdigit(c);
+}
+
+inline bool isAlpha(int c)
+{
+	return isalpha(c);
+}
+
+inline void digitalWriteFast(uint8_t pin, uint8_t value)
+{
+	digitalWrite(pin, value);
+}
+
+inline uint8_t digitalReadFast(uint8_t pin)
+{
+	return digitalRead(pin);
+}
+
+class CrashReportClass : public Printable
+{
+public:
+	size_t printTo(Print &p) const override;
+	operator bool() { return false; }
+};
+
+extern CrashReportClass CrashReport;
+
+/*
+	Virtual clock, host only. The clock starts at zero and never moves on its
+	own; yield() advances it by hostYieldQuantum so that the firmware's
+	busy-wait loops terminate.
+*/
+uint64_t hostMicros();
+void hostAdvanceMicros(uint64_t us);
+void hostSetMicros(uint64_t us);
+
+extern uint32_t hostYieldQuantum;
+
+#endif // __ARDUINO_H_
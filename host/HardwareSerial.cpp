@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+
+// Size of the ring built into the Teensy UART driver before addMemoryForRead
+#define HOST_SERIAL_RX_SIZE (64)
+#define HOST_SERIAL_REFILL_SIZE (4096)
+
+HardwareSerial Serial("Serial");
+HardwareSerial Serial1("Serial1");
+HardwareSerial Serial2("Serial2");
+HardwareSerial Serial3("Serial3");
+HardwareSerial Serial4("Serial4");
+HardwareSerial Serial5("Serial5");
+HardwareSerial Serial6("Serial6");
+HardwareSerial Serial7("Serial7");
+HardwareSerial Serial8("Serial8");
+
+HardwareSerial::HardwareSerial(const char *name)
+	: name(name), rx(HOST_SERIAL_RX_SIZE), rxHead(0), rxTail(0), rxCount(0),
+	  wireNanos(0), byteNanos(0), paced(true), inFd(-1), inIsStream(false),
+	  inEof(false), inStartNanos(0), outFd(-1), counters()
+{
+}
+
+HardwareSerial::~HardwareSerial()
+{
+	if (inFd >= 0)
+		close(inFd);
+}
+
+void HardwareSerial::begin(uint32_t baud, uint16_t)
+{
+	// 8N1: one start bit, eight data bits, one stop bit
+	byteNanos = baud ? 10000000000ull / baud : 0;
+}
+
+void HardwareSerial::addMemoryForRead(void *, size_t length)
+{
+	clear();
+	rx.assign(HOST_SERIAL_RX_SIZE + length, 0);
+}
+
+void HardwareSerial::clear()
+{
+	pump();
+	rxHead = rxTail = rxCount = 0;
+}
+
+void HardwareSerial::pushRx(uint8_t c)
+{
+	counters.bytesArrived++;
+
+	if (rxCount == rx.size())
+	{
+		counters.overruns++;
+		return;
+	}
+
+	rx[rxHead] = c;
+	rxHead = (rxHead + 1) % rx.size();
+	rxCount++;
+
+	if (rxCount > counters.highWatermark)
+		counters.highWatermark = rxCount;
+}
+
+void HardwareSerial::refill()
+{
+	if (inFd < 0 || inEof)
+		return;
+
+	chunk_t chunk;
+	chunk.data.resize(HOST_SERIAL_REFILL_SIZE);
+	chunk.offset = 0;
+
+	// Regular files are streamed back to back at line rate from the moment
+	// they were attached, pipes deliver whatever the writer has produced by now
+	chunk.atNanos = inIsStream ? hostMicros() * 1000 : inStartNanos;
+
+	ssize_t n = ::read(inFd, chunk.data.data(), chunk.data.size());
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		inEof = true;
+		return;
+	}
+	if (n < 0)
+		return;
+
+	chunk.data.resize(n);
+	wire.push_back(std::move(chunk));
+}
+
+void HardwareSerial::pump()
+{
+	// Nothing is received until begin() has set the baud rate
+	if (byteNanos == 0)
+		return;
+
+	uint64_t nowNanos = hostMicros() * 1000;
+	uint64_t step = paced ? byteNanos : 0;
+
+	while (true)
+	{
+		if (wire.empty())
+		{
+			refill();
+			if (wire.empty())
+				return;
+		}
+
+		chunk_t &chunk = wire.front();
+		while (chunk.offset < chunk.data.size())
+		{
+			uint64_t arrival = (chunk.atNanos > wireNanos ? chunk.atNanos : wireNanos) + step;
+			if (arrival > nowNanos)
+				return;
+
+			// Without pacing the wire behaves as if flow controlled
+			if (!paced && rxCount == rx.size())
+				return;
+
+			pushRx(chunk.data[chunk.offset++]);
+			wireNanos = arrival;
+		}
+
+		wire.pop_front();
+	}
+}
+
+int HardwareSerial::available()
+{
+	pump();
+	return rxCount;
+}
+
+int HardwareSerial::peek()
+{
+	pump();
+	if (rxCount == 0)
+		return -1;
+	return rx[rxTail];
+}
+
+int HardwareSerial::read()
+{
+	pump();
+	if (rxCount == 0)
+		return -1;
+
+	uint8_t c = rx[rxTail];
+	rxTail = (rxTail + 1) % rx.size();
+	rxCount--;
+	counters.bytesRead++;
+	return c;
+}
+
+size_t HardwareSerial::readBytes(char *buffer, size_t length)
+{
+	// Only what has already arrived is copied in bulk, the rest waits out
+	// the timeout byte by byte like Stream::readBytes
+	pump();
+
+	size_t n = length < rxCount ? length : rxCount;
+	size_t first = rx.size() - rxTail < n ? rx.size() - rxTail : n;
+	memcpy(buffer, rx.data() + rxTail, first);
+	memcpy(buffer + first, rx.data(), n - first);
+	rxTail = (rxTail + n) % rx.size();
+	rxCount -= n;
+	counters.bytesRead += n;
+
+	if (n < length)
+		n += Stream::readBytes(buffer + n, length - n);
+	return n;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+	counters.bytesWritten += size;
+	if (outFd >= 0 && ::write(outFd, buffer, size) < 0)
+		return 0;
+	return size;
+}
+
+bool HardwareSerial::attachInput(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	attachInput(fd);
+	return true;
+}
+
+void HardwareSerial::attachInput(int fd)
+{
+	struct stat st;
+	inIsStream = fstat(fd, &st) == 0 && !S_ISREG(st.st_mode);
+	if (inIsStream)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	inFd = fd;
+	inEof = false;
+	inStartNanos = hostMicros() * 1000;
+}
+
+void HardwareSerial::inject(const uint8_t *data, size_t length, uint64_t atMicros)
+{
+	chunk_t chunk;
+	chunk.atNanos = atMicros * 1000;
+	chunk.data.assign(data, data + length);
+	chunk.offset = 0;
+	wire.push_back(std::move(chunk));
+}
+
+bool HardwareSerial::drained()
+{
+	pump();
+	return rxCount == 0 && wire.empty() && (inFd < 0 || inEof);
+}
+
+uint64_t HardwareSerial::nextArrivalMicros()
+{
+	pump();
+
+	if (wire.empty())
+		return (inFd < 0 || inEof) ? UINT64_MAX : hostMicros();
+
+	const chunk_t &chunk = wire.front();
+	uint64_t arrival = (chunk.atNanos > wireNanos ? chunk.atNanos : wireNanos) + (paced ? byteNanos : 0);
+	return (arrival + 999) / 1000;
+}
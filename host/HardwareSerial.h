@@ -0,0 +1,107 @@
+#ifndef __HARDWARESERIAL_H_
+#define __HARDWARESERIAL_H_
+
+#include <deque>
+#include <vector>
+
+#include "Stream.h"
+
+/*
+	Counters kept by the host UART, readable from benchmarks and the runner
+*/
+typedef struct
+{
+	uint64_t bytesArrived;
+	uint64_t bytesRead;
+	uint64_t bytesWritten;
+	uint64_t overruns;
+	size_t highWatermark;
+} host_serial_stats_t;
+
+/*
+	Host stand-in for a Teensy UART. The "wire" side is fed from a file, a
+	pipe or injected buffers; bytes are moved into the receive ring at the
+	configured baud rate against the virtual clock, so a slow consumer sees
+	the ring fill up and overrun exactly like the real driver would.
+*/
+class HardwareSerial : public Stream
+{
+private:
+	struct chunk_t
+	{
+		uint64_t atNanos;
+		std::vector<uint8_t> data;
+		size_t offset;
+	};
+
+	const char *name;
+
+	std::vector<uint8_t> rx;
+	size_t rxHead;
+	size_t rxTail;
+	size_t rxCount;
+
+	std::deque<chunk_t> wire;
+	uint64_t wireNanos;
+	uint64_t byteNanos;
+	bool paced;
+
+	int inFd;
+	bool inIsStream;
+	bool inEof;
+	uint64_t inStartNanos;
+	int outFd;
+
+	host_serial_stats_t counters;
+
+	void pump();
+	void refill();
+	void pushRx(uint8_t c);
+
+public:
+	HardwareSerial(const char *name);
+	~HardwareSerial();
+
+	void begin(uint32_t baud, uint16_t format = 0);
+	void end() {}
+	void addMemoryForRead(void *buffer, size_t length);
+	void addMemoryForWrite(void *, size_t) {}
+	void clear();
+
+	int available() override;
+	int peek() override;
+	int read() override;
+	size_t readBytes(char *buffer, size_t length) override;
+	using Stream::readBytes;
+	size_t write(uint8_t c) override;
+	size_t write(const uint8_t *buffer, size_t size) override;
+	using Print::write;
+	void flush() override {}
+
+	operator bool() { return true; }
+
+	// Host side of the wire
+	bool attachInput(const char *path);
+	void attachInput(int fd);
+	void attachOutput(int fd) { outFd = fd; }
+	void inject(const uint8_t *data, size_t length, uint64_t atMicros = 0);
+	void setPaced(bool paced) { this->paced = paced; }  // unpaced input is flow controlled, never overruns
+
+	bool drained();
+	uint64_t nextArrivalMicros();
+	size_t rxCapacity() { return rx.size(); }
+	const char *portName() { return name; }
+	const host_serial_stats_t &stats() { return counters; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+extern HardwareSerial Serial4;
+extern HardwareSerial Serial5;
+extern HardwareSerial Serial6;
+extern HardwareSerial Serial7;
+extern HardwareSerial Serial8;
+
+#endif // __HARDWARESERIAL_H_
@@ -0,0 +1,51 @@
+#include "Arduino.h"
+
+static IntervalTimer *activeTimers = nullptr;
+static bool running = false;
+
+bool IntervalTimer::begin(void (*callback)(), uint32_t microseconds)
+{
+	if (!callback || microseconds == 0)
+		return false;
+
+	end();
+
+	this->callback = callback;
+	periodMicros = microseconds;
+	nextMicros = hostMicros() + microseconds;
+	nextActive = activeTimers;
+	activeTimers = this;
+	return true;
+}
+
+void IntervalTimer::end()
+{
+	for (IntervalTimer **t = &activeTimers; *t; t = &(*t)->nextActive)
+	{
+		if (*t == this)
+		{
+			*t = nextActive;
+			break;
+		}
+	}
+
+	callback = nullptr;
+	nextActive = nullptr;
+}
+
+void IntervalTimer::run(uint64_t nowMicros)
+{
+	if (running)
+		return;
+
+	running = true;
+	for (IntervalTimer *t = activeTimers; t; t = t->nextActive)
+	{
+		while (t->callback && t->nextMicros <= nowMicros)
+		{
+			t->nextMicros += t->periodMicros;
+			t->callback();
+		}
+	}
+	running = false;
+}
@@ -0,0 +1,32 @@
+#ifndef __INTERVALTIMER_H_
+#define __INTERVALTIMER_H_
+
+#include <stdint.h>
+
+/*
+	Host stand-in for the Teensy periodic timer interrupt. Callbacks run
+	from the virtual clock: whenever it advances past a timer's next
+	deadline the callback fires, once per elapsed period, before the
+	advancing call returns. Like an interrupt it never nests with itself.
+*/
+class IntervalTimer
+{
+private:
+	void (*callback)();
+	uint32_t periodMicros;
+	uint64_t nextMicros;
+	IntervalTimer *nextActive;
+
+public:
+	IntervalTimer() : callback(nullptr), periodMicros(0), nextMicros(0), nextActive(nullptr) {}
+	~IntervalTimer() { end(); }
+
+	bool begin(void (*callback)(), uint32_t microseconds);
+	void end();
+	void priority(uint8_t) {}
+
+	// Host only, called by the virtual clock
+	static void run(uint64_t nowMicros);
+};
+
+#endif // __INTERVALTIMER_H_
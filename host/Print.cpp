@@ -0,0 +1,50 @@
+#include "Arduino.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t count = 0;
+	while (size--)
+		count += write(*buffer++);
+	return count;
+}
+
+size_t Print::println()
+{
+	uint8_t buf[2] = {'\r', '\n'};
+	return write(buf, 2);
+}
+
+size_t Print::printSigned(long long n, int base)
+{
+	if (n < 0 && base == 10)
+		return printNumber((unsigned long long)-n, base, true);
+	return printNumber((unsigned long long)n, base, false);
+}
+
+size_t Print::printNumber(unsigned long long n, uint8_t base, bool sign)
+{
+	char buf[66];
+	char *p = buf + sizeof(buf);
+
+	if (base < 2)
+		base = 10;
+
+	do
+	{
+		uint8_t digit = n % base;
+		*--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+		n /= base;
+	} while (n);
+
+	if (sign)
+		*--p = '-';
+
+	return write((const uint8_t *)p, buf + sizeof(buf) - p);
+}
+
+size_t Print::print(double n, int digits)
+{
+	char buf[64];
+	int len = snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return write((const uint8_t *)buf, len);
+}
@@ -0,0 +1,69 @@
+#ifndef __PRINT_H_
+#define __PRINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "WString.h"
+
+class Print;
+
+class Printable
+{
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t b) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+	size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+	size_t write(unsigned long n) { return write((uint8_t)n); }
+	size_t write(long n) { return write((uint8_t)n); }
+	size_t write(unsigned int n) { return write((uint8_t)n); }
+	size_t write(int n) { return write((uint8_t)n); }
+
+	size_t print(const char *s) { return write(s); }
+	size_t print(const String &s) { return write(s.c_str()); }
+	size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = 10) { return printNumber(n, base, false); }
+	size_t print(int n, int base = 10) { return printSigned(n, base); }
+	size_t print(unsigned int n, int base = 10) { return printNumber(n, base, false); }
+	size_t print(long n, int base = 10) { return printSigned(n, base); }
+	size_t print(unsigned long n, int base = 10) { return printNumber(n, base, false); }
+	size_t print(long long n, int base = 10) { return printSigned(n, base); }
+	size_t print(unsigned long long n, int base = 10) { return printNumber(n, base, false); }
+	size_t print(double n, int digits = 2);
+	size_t print(const Printable &obj) { return obj.printTo(*this); }
+
+	size_t println();
+	template <typename T>
+	size_t println(const T &value)
+	{
+		size_t n = print(value);
+		return n + println();
+	}
+	template <typename T>
+	size_t println(const T &value, int format)
+	{
+		size_t n = print(value, format);
+		return n + println();
+	}
+
+private:
+	size_t printSigned(long long n, int base);
+	size_t printNumber(unsigned long long n, uint8_t base, bool sign);
+};
+
+#endif // __PRINT_H_
@@ -0,0 +1,463 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+
+#include "SD.h"
+
+SDClass SD;
+
+// Clusters each file holds on the card, remembered across open and close
+static std::map<std::string, uint64_t> allocations;
+
+static host_sd_stats_t sdStats = {};
+static host_sd_timing_t sdTiming = {};
+static uint64_t sdChargedNanos = 0;
+
+static void chargeNanos(uint64_t nanos)
+{
+	sdChargedNanos += nanos;
+	uint64_t us = sdChargedNanos / 1000;
+	sdChargedNanos %= 1000;
+
+	if (us)
+	{
+		sdStats.busyMicros += us;
+		hostAdvanceMicros(us);
+	}
+}
+
+static void chargeCommand(uint64_t sectors)
+{
+	chargeNanos(sdTiming.commandMicros * 1000ull + sectors * sdTiming.sectorNanos);
+}
+
+static void chargeMetadataWrites(uint64_t sectors)
+{
+	sdStats.metadataWrites += sectors;
+	for (uint64_t i = 0; i < sectors; i++)
+		chargeCommand(1);
+}
+
+static uint64_t roundToCluster(uint64_t size)
+{
+	return (size + HOST_SD_CLUSTER_SIZE - 1) / HOST_SD_CLUSTER_SIZE * HOST_SD_CLUSTER_SIZE;
+}
+
+// FAT sectors touched by changing the allocation of a run of clusters
+static uint64_t fatSectors(uint64_t bytes)
+{
+	uint64_t clusters = bytes / HOST_SD_CLUSTER_SIZE;
+	uint64_t perSector = HOST_SD_SECTOR_SIZE / 4;
+	return (clusters + perSector - 1) / perSector;
+}
+
+// Longest single call as seen by the caller, interrupts included
+static void noteCall(uint64_t startMicros)
+{
+	uint64_t elapsed = hostMicros() - startMicros;
+	if (elapsed > sdStats.maxCallMicros)
+		sdStats.maxCallMicros = elapsed;
+}
+
+class HostFileImpl
+{
+public:
+	int fd;
+	std::string filename;
+	uint64_t pos;
+	uint64_t fileSize;
+	uint64_t allocatedSize;
+
+	uint8_t cache[HOST_SD_SECTOR_SIZE];
+	int64_t cacheSector;
+	bool cacheDirty;
+
+	HostFileImpl(int fd, const char *filename)
+		: fd(fd), filename(filename), pos(0), fileSize(0), allocatedSize(0), cacheSector(-1), cacheDirty(false)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0)
+			fileSize = st.st_size;
+
+		auto allocation = allocations.find(SD.hostPath(filename));
+		allocatedSize = allocation != allocations.end() ? allocation->second : 0;
+		if (allocatedSize < roundToCluster(fileSize))
+			allocatedSize = roundToCluster(fileSize);
+	}
+
+	~HostFileImpl()
+	{
+		close();
+	}
+
+	void syncCache(bool partial)
+	{
+		if (!cacheDirty)
+			return;
+
+		uint64_t base = (uint64_t)cacheSector * HOST_SD_SECTOR_SIZE;
+		uint64_t length = fileSize - base < HOST_SD_SECTOR_SIZE ? fileSize - base : HOST_SD_SECTOR_SIZE;
+		if (pwrite(fd, cache, length, base) < 0)
+			perror("pwrite");
+
+		sdStats.sectorWrites++;
+		chargeCommand(1);
+		if (partial)
+			sdStats.partialSectorWrites++;
+		cacheDirty = false;
+	}
+
+	void fetchCache(int64_t sector)
+	{
+		if (cacheSector == sector)
+			return;
+
+		syncCache(false);
+
+		memset(cache, 0, sizeof(cache));
+		uint64_t base = (uint64_t)sector * HOST_SD_SECTOR_SIZE;
+		if (base < fileSize)
+		{
+			if (pread(fd, cache, HOST_SD_SECTOR_SIZE, base) < 0)
+				perror("pread");
+			chargeCommand(1);
+		}
+		cacheSector = sector;
+	}
+
+	size_t write(const uint8_t *buffer, size_t size)
+	{
+		uint64_t start = hostMicros();
+		chargeNanos(sdTiming.callNanos);
+
+		// A growing file takes one cluster at a time, each a FAT update
+		while (allocatedSize < pos + size)
+		{
+			allocatedSize += HOST_SD_CLUSTER_SIZE;
+			chargeMetadataWrites(1);
+		}
+
+		size_t remaining = size;
+		while (remaining)
+		{
+			int64_t sector = pos / HOST_SD_SECTOR_SIZE;
+			size_t offset = pos % HOST_SD_SECTOR_SIZE;
+
+			// Whole aligned sectors bypass the cache, as in SdFat
+			if (offset == 0 && remaining >= HOST_SD_SECTOR_SIZE && cacheSector != sector)
+			{
+				size_t n = remaining - remaining % HOST_SD_SECTOR_SIZE;
+				if (pwrite(fd, buffer, n, pos) < 0)
+					perror("pwrite");
+
+				int64_t lastSector = sector + n / HOST_SD_SECTOR_SIZE;
+				if (cacheSector >= sector && cacheSector < lastSector)
+					cacheSector = -1;
+
+				sdStats.sectorWrites += n / HOST_SD_SECTOR_SIZE;
+				chargeCommand(n / HOST_SD_SECTOR_SIZE);
+				advance(n);
+				buffer += n;
+				remaining -= n;
+				continue;
+			}
+
+			fetchCache(sector);
+
+			size_t n = HOST_SD_SECTOR_SIZE - offset;
+			if (n > remaining)
+				n = remaining;
+
+			memcpy(cache + offset, buffer, n);
+			cacheDirty = true;
+			advance(n);
+			buffer += n;
+			remaining -= n;
+
+			// A completed sector is written out immediately
+			if (offset + n == HOST_SD_SECTOR_SIZE)
+				syncCache(false);
+		}
+
+		sdStats.writeCalls++;
+		sdStats.bytesWritten += size;
+		noteCall(start);
+		return size;
+	}
+
+	void advance(uint64_t n)
+	{
+		pos += n;
+		if (pos > fileSize)
+			fileSize = pos;
+	}
+
+	size_t read(uint8_t *buffer, size_t size)
+	{
+		syncCache(false);
+
+		ssize_t n = pread(fd, buffer, size, pos);
+		if (n <= 0)
+			return 0;
+
+		pos += n;
+		return n;
+	}
+
+	void flush()
+	{
+		uint64_t start = hostMicros();
+		syncCache(true);
+		chargeNanos(sdTiming.flushMicros * 1000ull);
+		sdStats.metadataWrites++;
+		sdStats.flushCalls++;
+		noteCall(start);
+	}
+
+	/*
+		Allocate a contiguous extent to an empty file, as SdFat does: the
+		FAT chain is written in one go and the file size stays zero
+	*/
+	bool preAllocate(uint64_t length)
+	{
+		if (fileSize != 0 || allocatedSize != 0 || length == 0)
+			return false;
+
+		allocatedSize = roundToCluster(length);
+		chargeMetadataWrites(fatSectors(allocatedSize) + 1);
+		return true;
+	}
+
+	bool truncate(uint64_t size)
+	{
+		syncCache(true);
+		cacheSector = -1;
+
+		if (ftruncate(fd, size) != 0)
+			return false;
+
+		// Clusters past the new end go back to the free list
+		uint64_t allocation = roundToCluster(size);
+		if (allocation < allocatedSize)
+		{
+			chargeMetadataWrites(fatSectors(allocatedSize - allocation) + 1);
+			allocatedSize = allocation;
+		}
+
+		fileSize = size;
+		if (pos > size)
+			pos = size;
+		return true;
+	}
+
+	void close()
+	{
+		if (fd < 0)
+			return;
+
+		syncCache(true);
+		::close(fd);
+		fd = -1;
+
+		allocations[SD.hostPath(filename.c_str())] = allocatedSize;
+	}
+};
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+	if (!impl)
+		return 0;
+	return impl->write(buffer, size);
+}
+
+int File::available()
+{
+	if (!impl)
+		return 0;
+
+	uint64_t n = impl->fileSize - impl->pos;
+	return n > INT32_MAX ? INT32_MAX : (int)n;
+}
+
+int File::read()
+{
+	uint8_t c;
+	return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek()
+{
+	if (!impl)
+		return -1;
+
+	uint64_t pos = impl->pos;
+	int c = read();
+	impl->pos = pos;
+	return c;
+}
+
+size_t File::read(void *buffer, size_t size)
+{
+	if (!impl)
+		return 0;
+	return impl->read((uint8_t *)buffer, size);
+}
+
+void File::flush()
+{
+	if (impl)
+		impl->flush();
+}
+
+bool File::preAllocate(uint64_t length)
+{
+	return impl && impl->preAllocate(length);
+}
+
+bool File::seek(uint64_t pos, int mode)
+{
+	if (!impl)
+		return false;
+
+	if (mode == SeekCur)
+		pos += impl->pos;
+	else if (mode == SeekEnd)
+		pos += impl->fileSize;
+
+	impl->pos = pos;
+	return true;
+}
+
+uint64_t File::position()
+{
+	return impl ? impl->pos : 0;
+}
+
+uint64_t File::size()
+{
+	return impl ? impl->fileSize : 0;
+}
+
+bool File::truncate(uint64_t size)
+{
+	return impl && impl->truncate(size);
+}
+
+void File::close()
+{
+	impl.reset();
+}
+
+const char *File::name()
+{
+	if (!impl)
+		return "";
+
+	size_t slash = impl->filename.rfind('/');
+	return impl->filename.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+bool SDClass::begin(uint8_t)
+{
+	if (root.empty())
+	{
+		const char *env = getenv("HOST_SD_ROOT");
+		root = env ? env : "sdcard";
+	}
+
+	struct stat st;
+	mounted = stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+	return mounted;
+}
+
+std::string SDClass::hostPath(const char *filepath)
+{
+	while (*filepath == '/')
+		filepath++;
+	return root + "/" + filepath;
+}
+
+File SDClass::open(const char *filepath, uint8_t mode)
+{
+	if (!mounted)
+		return File();
+
+	int flags = O_RDONLY;
+	if (mode == FILE_WRITE)
+		flags = O_RDWR | O_CREAT;
+	else if (mode == FILE_WRITE_BEGIN)
+		flags = O_RDWR | O_CREAT;
+
+	std::string path = hostPath(filepath);
+	int fd = ::open(path.c_str(), flags, 0644);
+	if (fd < 0)
+		return File();
+
+	sdStats.filesOpened++;
+
+	auto impl = std::make_shared<HostFileImpl>(fd, filepath);
+	if (mode == FILE_WRITE)
+		impl->pos = impl->fileSize;
+	return File(impl);
+}
+
+FsFile SdFs::open(const char *path, int oflag)
+{
+	if (!(oflag & O_CREAT) && !SD.exists(path))
+		return FsFile();
+
+	uint8_t mode = FILE_READ;
+	if ((oflag & O_ACCMODE) != O_RDONLY)
+		mode = oflag & O_APPEND ? FILE_WRITE : FILE_WRITE_BEGIN;
+
+	FsFile file = SD.open(path, mode);
+	if (file && (oflag & O_TRUNC))
+		file.truncate(0);
+	return file;
+}
+
+bool SDClass::exists(const char *filepath)
+{
+	struct stat st;
+	return mounted && stat(hostPath(filepath).c_str(), &st) == 0;
+}
+
+bool SDClass::mkdir(const char *filepath)
+{
+	return mounted && ::mkdir(hostPath(filepath).c_str(), 0755) == 0;
+}
+
+bool SDClass::rename(const char *oldfilepath, const char *newfilepath)
+{
+	if (!mounted || ::rename(hostPath(oldfilepath).c_str(), hostPath(newfilepath).c_str()) != 0)
+		return false;
+
+	auto allocation = allocations.find(hostPath(oldfilepath));
+	if (allocation != allocations.end())
+	{
+		allocations[hostPath(newfilepath)] = allocation->second;
+		allocations.erase(allocation);
+	}
+	return true;
+}
+
+bool SDClass::remove(const char *filepath)
+{
+	if (!mounted || ::unlink(hostPath(filepath).c_str()) != 0)
+		return false;
+
+	allocations.erase(hostPath(filepath));
+	return true;
+}
+
+host_sd_stats_t &SDClass::stats()
+{
+	return sdStats;
+}
+
+void SDClass::setTiming(const host_sd_timing_t &timing)
+{
+	sdTiming = timing;
+}
@@ -0,0 +1,152 @@
+#ifndef __SD_H_
+#define __SD_H_
+
+#include <fcntl.h>
+
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+
+#define FILE_READ (0)
+#define FILE_WRITE (1)
+#define FILE_WRITE_BEGIN (2)
+
+#define BUILTIN_SDCARD (254)
+
+#define HOST_SD_SECTOR_SIZE (512)
+
+// Cluster size of a typical FAT32 formatted card
+#define HOST_SD_CLUSTER_SIZE (32768)
+
+enum SeekMode
+{
+	SeekSet = 0,
+	SeekCur = 1,
+	SeekEnd = 2,
+};
+
+/*
+	Card traffic as SdFat would see it. Writes are cached per 512-byte sector
+	the same way SdFat's single-sector cache behaves, so the sector counters
+	reflect what the card would have been asked to do. Files are allocated
+	in clusters: each cluster a growing file allocates, each preallocation
+	or truncation and each directory entry update on flush() counts as a
+	metadata write, charged one card command like any other sector write.
+*/
+typedef struct
+{
+	uint64_t writeCalls;
+	uint64_t bytesWritten;
+	uint64_t flushCalls;
+	uint64_t sectorWrites;
+	uint64_t partialSectorWrites;
+	uint64_t filesOpened;
+	uint64_t metadataWrites;
+	uint64_t busyMicros;
+	uint32_t maxCallMicros;
+} host_sd_stats_t;
+
+/*
+	Card timing, charged to the virtual clock while a File call runs so the
+	firmware is stalled exactly as long as it would be on the card. All
+	zero by default, which makes the card infinitely fast.
+*/
+typedef struct
+{
+	uint32_t callNanos; // File::write() bookkeeping in SdFat
+	uint32_t commandMicros; // each card command: one per cached sector, one per multi-sector run
+	uint32_t sectorNanos; // transferring one sector
+	uint32_t flushMicros; // directory entry update on flush()
+} host_sd_timing_t;
+
+class HostFileImpl;
+
+class File : public Stream
+{
+private:
+	std::shared_ptr<HostFileImpl> impl;
+
+public:
+	File() {}
+	File(std::shared_ptr<HostFileImpl> impl) : impl(impl) {}
+
+	size_t write(uint8_t b) override { return write(&b, 1); }
+	size_t write(const uint8_t *buffer, size_t size) override;
+	size_t write(const void *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+	using Print::write;
+
+	int available() override;
+	int read() override;
+	int peek() override;
+	size_t read(void *buffer, size_t size);
+	void flush() override;
+	bool preAllocate(uint64_t length);
+
+	bool seek(uint64_t pos, int mode = SeekSet);
+	uint64_t position();
+	uint64_t size();
+	bool truncate(uint64_t size = 0);
+	void close();
+	const char *name();
+	bool isDirectory() { return false; }
+
+	operator bool() { return impl != nullptr; }
+};
+
+// SdFat's own file type, which exposes what the SD wrapper does not
+typedef File FsFile;
+
+/*
+	The SdFat volume behind SD, reached through SD.sdfs
+*/
+class SdFs
+{
+public:
+	FsFile open(const char *path, int oflag = O_RDONLY);
+};
+
+class SDClass
+{
+private:
+	std::string root;
+	bool mounted = false;
+
+public:
+	SdFs sdfs;
+
+	bool begin(uint8_t csPin = 10);
+	File open(const char *filepath, uint8_t mode = FILE_READ);
+	bool exists(const char *filepath);
+	bool mkdir(const char *filepath);
+	bool rename(const char *oldfilepath, const char *newfilepath);
+	bool remove(const char *filepath);
+
+	// Host only: directory standing in for the card
+	void setRoot(const char *path) { root = path; }
+	std::string hostPath(const char *filepath);
+	host_sd_stats_t &stats();
+	void setTiming(const host_sd_timing_t &timing);
+};
+
+extern SDClass SD;
+
+class Sd2Card
+{
+public:
+	bool init(uint32_t, uint8_t csPin) { return SD.begin(csPin); }
+	uint8_t type() { return 3; }
+};
+
+class SdVolume
+{
+public:
+	bool init(Sd2Card &) { return true; }
+	uint8_t fatType() { return 64; }
+};
+
+class SdFile
+{
+};
+
+#endif // __SD_H_
@@ -0,0 +1,31 @@
+#ifndef __SPI_H_
+#define __SPI_H_
+
+#include "Arduino.h"
+
+#define SPI_MODE0 (0x00)
+#define SPI_MODE1 (0x04)
+#define SPI_MODE2 (0x08)
+#define SPI_MODE3 (0x0C)
+
+class SPISettings
+{
+public:
+	SPISettings() {}
+	SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass
+{
+public:
+	void begin() {}
+	void end() {}
+	void beginTransaction(SPISettings) {}
+	void endTransaction() {}
+	uint8_t transfer(uint8_t) { return 0xFF; }
+	void transfer(void *, size_t) {}
+};
+
+extern SPIClass SPI;
+
+#endif // __SPI_H_
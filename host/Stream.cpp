@@ -0,0 +1,28 @@
+#include "Arduino.h"
+
+int Stream::timedRead()
+{
+	uint32_t startMillis = millis();
+	do
+	{
+		int c = read();
+		if (c >= 0)
+			return c;
+		yield();
+	} while (millis() - startMillis < _timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+	size_t count = 0;
+	while (count < length)
+	{
+		int c = timedRead();
+		if (c < 0)
+			break;
+		*buffer++ = (char)c;
+		count++;
+	}
+	return count;
+}
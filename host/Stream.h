@@ -0,0 +1,26 @@
+#ifndef __STREAM_H_
+#define __STREAM_H_
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+	Stream() : _timeout(1000) {}
+
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	void setTimeout(unsigned long timeout) { _timeout = timeout; }
+	unsigned long getTimeout() { return _timeout; }
+
+	virtual size_t readBytes(char *buffer, size_t length);
+	size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+protected:
+	unsigned long _timeout;
+	int timedRead();
+};
+
+#endif // __STREAM_H_
@@ -0,0 +1,34 @@
+#ifndef __WSTRING_H_
+#define __WSTRING_H_
+
+#include <string>
+
+/*
+	Minimal Arduino String, only what the vendored libraries reference
+*/
+class String
+{
+private:
+	std::string s;
+
+public:
+	String() {}
+	String(const char *cstr) : s(cstr ? cstr : "") {}
+
+	const char *c_str() const { return s.c_str(); }
+	unsigned int length() const { return s.length(); }
+
+	String &operator+=(const char *cstr)
+	{
+		s += cstr;
+		return *this;
+	}
+
+	String &operator+=(char c)
+	{
+		s += c;
+		return *this;
+	}
+};
+
+#endif // __WSTRING_H_
@@ -0,0 +1,23 @@
+#ifndef __WIRE_H_
+#define __WIRE_H_
+
+#include "Arduino.h"
+
+class TwoWire : public Stream
+{
+public:
+	void begin() {}
+	void beginTransmission(uint8_t) {}
+	uint8_t endTransmission(bool = true) { return 2; }
+	uint8_t requestFrom(uint8_t, uint8_t, uint8_t = 1) { return 0; }
+
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+	size_t write(uint8_t) override { return 1; }
+	using Print::write;
+};
+
+extern TwoWire Wire;
+
+#endif // __WIRE_H_
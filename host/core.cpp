@@ -0,0 +1,84 @@
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+
+static uint64_t clockMicros = 0;
+static uint8_t pinState[64] = {0};
+
+uint32_t hostYieldQuantum = 1;
+
+CrashReportClass CrashReport;
+SPIClass SPI;
+TwoWire Wire;
+
+uint64_t hostMicros()
+{
+	return clockMicros;
+}
+
+// Every clock movement goes through here so timer callbacks fire on time
+static void advanceClock(uint64_t us)
+{
+	clockMicros += us;
+	IntervalTimer::run(clockMicros);
+}
+
+void hostAdvanceMicros(uint64_t us)
+{
+	advanceClock(us);
+}
+
+void hostSetMicros(uint64_t us)
+{
+	clockMicros = us;
+	IntervalTimer::run(clockMicros);
+}
+
+uint32_t millis()
+{
+	return (uint32_t)(clockMicros / 1000);
+}
+
+uint32_t micros()
+{
+	return (uint32_t)clockMicros;
+}
+
+void delay(uint32_t ms)
+{
+	advanceClock((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+	advanceClock(us);
+}
+
+void delayNanoseconds(uint32_t ns)
+{
+	advanceClock(ns / 1000);
+}
+
+void yield()
+{
+	advanceClock(hostYieldQuantum);
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	pinState[pin % sizeof(pinState)] = value;
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+	return pinState[pin % sizeof(pinState)];
+}
+
+size_t CrashReportClass::printTo(Print &p) const
+{
+	return p.println("No Crash Data To Report");
+}
@@ -0,0 +1,272 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include "advertisertable.h"
+#include "logfiles.h"
+#include "packetfilter.h"
+#include "radio.h"
+#include "mappedfile.h"
+#include "repeatcache.h"
+#include "replay.h"
+
+/*
+	Host runner for the capture firmware. Feeds the radio and GPS UARTs from
+	files or pipes, points the SD card at a host directory and runs setup()
+	and loop() against the virtual clock until every input has been drained.
+
+	With --replay the inputs come from a capture log instead, its frames
+	framed again and sent at the times they were logged, --speed times as
+	fast, or as fast as the firmware takes them for a speed of 0 (see
+	replay.h).
+
+	--repeat-window MS turns on repeat suppression with that window, as
+	building with LOG_REPEAT_WINDOW_MILLIS would.
+
+	Once the inputs are drained the firmware finishes its log. After a
+	replay that ran to the end, the radio packets logged are checked
+	against those in the replayed log, less any the filter left out or
+	that replay could not put back, and the exit status is 1 if they
+	differ.
+
+	Usage:
+		inspector_host [--sd DIR] [--radio37 PATH] [--radio38 PATH]
+			[--radio39 PATH] [--gps PATH] [--replay LOG] [--speed F]
+			[--unpaced] [--loop-us N] [--duration-ms N] [--repeat-window MS]
+*/
+
+void setup();
+void loop();
+void finishCapture();
+
+extern radio_state_t radio37;
+extern radio_state_t radio38;
+extern radio_state_t radio39;
+extern AdvertiserTable advertiserTable;
+extern PacketFilter packetFilter;
+extern uint64_t filteredPacketCount;
+extern RepeatCache repeatCache;
+extern uint32_t repeatWindowMillis;
+extern LogFiles logFiles;
+
+static HardwareSerial *const inputs[] = {&Serial1, &Serial2, &Serial3, &Serial5};
+
+static LogReplay replay;
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--sd DIR] [--radio37 PATH] [--radio38 PATH] [--radio39 PATH] [--gps PATH] [--replay LOG] [--speed F] [--unpaced] [--loop-us N] [--duration-ms N] [--repeat-window MS]\n", argv0);
+}
+
+static bool attach(HardwareSerial &port, const char *path)
+{
+	if (!path || port.attachInput(path))
+		return true;
+
+	fprintf(stderr, "%s: cannot open %s\n", port.portName(), path);
+	return false;
+}
+
+/*
+	Compare the radio packets in the replayed log with those in the
+	logs written from firstIndex on
+*/
+static bool checkReplay(const char *replayPath, uint16_t firstIndex)
+{
+	uint64_t logged = 0;
+	for (uint16_t index = firstIndex; index <= atoi(logFiles.name()); index++)
+	{
+		char name[LOG_FILENAME_SIZE];
+		sprintf(name, "%04u.bin", index);
+		MappedFile log;
+		if (log.open(SD.hostPath(name).c_str()))
+			logged += countRadioPackets(log.data(), log.size());
+	}
+
+	MappedFile source;
+	source.open(replayPath);
+	uint64_t replayed = countRadioPackets(source.data(), source.size());
+	uint64_t expected = replayed - replay.lostRepeats - filteredPacketCount;
+	fprintf(stderr, "replay check: %llu radio packets replayed, %llu logged, %llu expected\n",
+			(unsigned long long)replayed, (unsigned long long)logged, (unsigned long long)expected);
+	return logged == expected;
+}
+
+static void printStats(bool replaying)
+{
+	fprintf(stderr, "virtual time: %llu us\n", (unsigned long long)hostMicros());
+
+	if (replaying)
+		fprintf(stderr, "replay: %llu sentences, %llu/%llu/%llu radio frames put on the wire\n",
+				(unsigned long long)replay.records[0], (unsigned long long)replay.records[1],
+				(unsigned long long)replay.records[2], (unsigned long long)replay.records[3]);
+
+	if (replay.expandedRepeats || replay.lostRepeats)
+		fprintf(stderr, "replay: %llu radio frames put back from repeat records, %llu repeats with no frame to copy\n",
+				(unsigned long long)replay.expandedRepeats, (unsigned long long)replay.lostRepeats);
+
+	for (auto port : inputs)
+	{
+		auto &stats = port->stats();
+		fprintf(stderr, "%s: %llu bytes arrived, %llu read, %llu overrun, high watermark %zu/%zu\n",
+				port->portName(), (unsigned long long)stats.bytesArrived,
+				(unsigned long long)stats.bytesRead, (unsigned long long)stats.overruns,
+				stats.highWatermark, port->rxCapacity());
+	}
+
+	for (auto radio : {&radio37, &radio38, &radio39})
+	{
+		fprintf(stderr, "%s ring: high watermark %u/%u, %u overflows\n", radio->port.portName(),
+				radio->ring.highWatermark, radio->ring.capacity(), radio->ring.overflows);
+	}
+
+	fprintf(stderr, "advertisers: %u of %u entries in use, %u evicted\n",
+			advertiserTable.size(), advertiserTable.capacity(), advertiserTable.evictions);
+
+	if (packetFilter.rules() || packetFilter.dropsByDefault())
+		fprintf(stderr, "filter: %u rules, %llu packets left out of the log\n", packetFilter.rules(),
+				(unsigned long long)filteredPacketCount);
+
+	if (repeatCache.enabled())
+		fprintf(stderr, "repeats: %llu frames counted in %u summaries, %u replaced in a %u frame cache\n",
+				(unsigned long long)repeatCache.repeats, repeatCache.summaries, repeatCache.evictions,
+				repeatCache.capacity());
+
+	if (logFiles.rotations || logFiles.preallocationFailures)
+		fprintf(stderr, "log files: %u rotations, %u not preallocated\n", logFiles.rotations,
+				logFiles.preallocationFailures);
+
+	auto &sd = SD.stats();
+	fprintf(stderr, "sd: %llu write calls, %llu bytes, %llu flushes, %llu sector writes (%llu partial), %llu metadata writes\n",
+			(unsigned long long)sd.writeCalls, (unsigned long long)sd.bytesWritten,
+			(unsigned long long)sd.flushCalls, (unsigned long long)sd.sectorWrites,
+			(unsigned long long)sd.partialSectorWrites, (unsigned long long)sd.metadataWrites);
+}
+
+int main(int argc, char **argv)
+{
+	const char *inputPaths[4] = {nullptr};
+	const char *replayPath = nullptr;
+	double replaySpeed = 1;
+	uint32_t loopMicros = 1;
+	uint64_t durationMicros = 0;
+	bool paced = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (!strcmp(arg, "--unpaced"))
+		{
+			paced = false;
+			continue;
+		}
+
+		if (!value)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		i++;
+
+		if (!strcmp(arg, "--sd"))
+			SD.setRoot(value);
+		else if (!strcmp(arg, "--gps"))
+			inputPaths[0] = value;
+		else if (!strcmp(arg, "--radio37"))
+			inputPaths[1] = value;
+		else if (!strcmp(arg, "--radio38"))
+			inputPaths[2] = value;
+		else if (!strcmp(arg, "--radio39"))
+			inputPaths[3] = value;
+		else if (!strcmp(arg, "--replay"))
+			replayPath = value;
+		else if (!strcmp(arg, "--speed"))
+			replaySpeed = atof(value);
+		else if (!strcmp(arg, "--loop-us"))
+			loopMicros = strtoul(value, nullptr, 0);
+		else if (!strcmp(arg, "--duration-ms"))
+			durationMicros = strtoull(value, nullptr, 0) * 1000;
+		else if (!strcmp(arg, "--repeat-window"))
+			repeatWindowMillis = strtoul(value, nullptr, 0);
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (replayPath && (inputPaths[0] || inputPaths[1] || inputPaths[2] || inputPaths[3]))
+	{
+		fprintf(stderr, "--replay takes the place of the other inputs\n");
+		return 1;
+	}
+
+	// Firmware status output goes to stderr so stdout stays clean for pipes
+	Serial.attachOutput(2);
+
+	setup();
+	uint16_t firstIndex = atoi(logFiles.name());
+
+	// Inputs start streaming once the radios have been started, as they
+	// would on the device
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+	{
+		inputs[i]->setPaced(paced && (!replayPath || replaySpeed > 0));
+		if (!attach(*inputs[i], inputPaths[i]))
+			return 1;
+	}
+
+	if (replayPath)
+	{
+		if (!replay.open(replayPath, inputs[0], inputs[1], inputs[2], inputs[3]))
+		{
+			fprintf(stderr, "cannot replay %s\n", replayPath);
+			return 1;
+		}
+		replay.start(replaySpeed);
+	}
+
+	while (durationMicros == 0 || hostMicros() < durationMicros)
+	{
+		if (replayPath)
+			replay.feed();
+		loop();
+		hostAdvanceMicros(loopMicros);
+
+		// Skip idle stretches, but not past the firmware's 250 ms timestamp cadence
+		bool idle = true;
+		uint64_t next = replayPath ? replay.nextMicros() : UINT64_MAX;
+		for (auto port : inputs)
+		{
+			if (port->available())
+				idle = false;
+			uint64_t arrival = port->nextArrivalMicros();
+			if (arrival < next)
+				next = arrival;
+		}
+		// Bytes the ingest timer moved on since loop() last looked
+		for (auto radio : {&radio37, &radio38, &radio39})
+			if (radio->ring.available() || radio->frameWaiting)
+				idle = false;
+
+		if (!idle)
+			continue;
+
+		if (next == UINT64_MAX && durationMicros == 0)
+			break;
+
+		uint64_t now = hostMicros();
+		if (next > now + 1000)
+			next = now + 1000;
+		if (next > now)
+			hostSetMicros(next);
+	}
+
+	finishCapture();
+	printStats(replayPath);
+
+	if (replayPath && replay.done() && !checkReplay(replayPath, firstIndex))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,324 @@
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Arduino.h"
+#include "framing.h"
+#include "logreader.h"
+#include "mappedfile.h"
+#include "packetview.h"
+
+/*
+	Recorded traffic for the host UARTs: the records of a capture log,
+	read back in order, with radio frames framed again as the radios
+	sent them and NMEA sentences as the GPS sent them, each put on the
+	wire of its port at the time it was logged. Replaying a log into the
+	firmware should log the same packets again, which makes real captures
+	usable as repeatable input for the whole capture path.
+
+	Time can run as recorded (speed 1), compressed (speed 10 sends ten
+	seconds of traffic every second) or not at all (speed 0), when
+	everything is on the wire from the start and the ports should be
+	unpaced, so they deliver as fast as the firmware reads. Frames go on
+	the wire a little ahead of the clock, a bounded amount at a time, so
+	logs of any length replay in the same memory.
+
+	Repeat records (log format version 5) are expanded back into the
+	frames they counted: copies of the last frame logged whole with the
+	same address, PDU header, length and frame hash, on each channel the summary has
+	a count for, spread evenly over its span. The first copy on a channel
+	gets the minimum RSSI, the last the maximum and the rest the mean, so
+	summarising them again gives the same figures. Their radio
+	timestamps are those of the frame copied. As a summary is logged up
+	to a window after the repeats it counts, records are read
+	REPLAY_REORDER_MICROS ahead and put on the wire in time order. A
+	summary with no earlier frame to copy, as at the start of a log cut
+	out of a longer one, cannot be expanded; its packets are counted in
+	lostRepeats.
+*/
+
+// How far ahead of the clock frames are put on the wire, and how many
+// bytes a port may have waiting there when time does not run
+#define REPLAY_HORIZON_MICROS (10000)
+#define REPLAY_BACKLOG_BYTES (65536)
+
+// How far behind the records around it a repeat record may come
+#define REPLAY_REORDER_MICROS ((uint64_t)LOG_REPEAT_LATENESS_MAX_MILLIS * 1000)
+
+/*
+	A sentence or frame waiting to go on the wire, port being 0 for the
+	GPS and 1 to 3 for radios 37 to 39
+*/
+typedef struct
+{
+	uint8_t port;
+	std::vector<uint8_t> bytes;
+} replay_item_t;
+
+class LogReplay
+{
+private:
+	MappedFile file;
+	LogReader *reader;
+	log_record_t record;
+	HardwareSerial *gps;
+	HardwareSerial *radios[3];
+	double speed;
+
+	uint64_t startMicros;
+	uint64_t firstTime;
+	bool started;
+	uint64_t arrivedBefore[4];
+
+	bool readerDone;
+	uint64_t readTime;
+	// By time; equal times keep the order they were read in
+	std::multimap<uint64_t, replay_item_t> queue;
+	// Last frame logged whole for each address, PDU header and length,
+	// and frame hash
+	std::map<std::pair<uint64_t, uint32_t>, std::vector<uint8_t>> lastFrames;
+	std::vector<uint8_t> framed;
+
+	int portFor(uint8_t type) const
+	{
+		if (type == OUTPUT_TYPE_NMEA_SENTENCE)
+			return gps ? 0 : -1;
+		if (type >= OUTPUT_TYPE_RADIO_PACKET_37 && type <= OUTPUT_TYPE_RADIO_PACKET_39)
+			return radios[type - OUTPUT_TYPE_RADIO_PACKET_37] ? type - OUTPUT_TYPE_RADIO_PACKET_37 + 1 : -1;
+		return -1;
+	}
+
+	static std::pair<uint64_t, uint32_t> frameKey(const uint8_t *address, uint8_t pduHeader, uint8_t pduLength, uint32_t frameHash)
+	{
+		uint64_t key = 0;
+		memcpy(&key, address, BDADDR_SIZE);
+		return {key | (uint64_t)pduHeader << 48 | (uint64_t)pduLength << 56, frameHash};
+	}
+
+	void enqueue(uint64_t time, uint8_t index, const uint8_t *data, size_t length)
+	{
+		queue.insert({time, {index, std::vector<uint8_t>(data, data + length)}});
+	}
+
+	/*
+		Queue copies of the frame a repeat summary stands for
+	*/
+	void expandRepeat(uint64_t time)
+	{
+		log_repeat_t repeat;
+		if (!decodeRepeat(record.payload, record.length, repeat))
+			return;
+
+		auto frame = lastFrames.find(frameKey(repeat.address, repeat.pduHeader, repeat.pduLength, repeat.frameHash));
+		for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+		{
+			const log_repeat_channel_t &channel = repeat.channels[i];
+			if (!channel.count)
+				continue;
+			if (frame == lastFrames.end() || !radios[i])
+			{
+				lostRepeats += channel.count;
+				continue;
+			}
+
+			std::vector<uint8_t> copy = frame->second;
+			copy[VIEW_CHANNEL_OFFSET] = 37 + i;
+			uint64_t span = (uint64_t)repeat.spanMillis * 1000;
+			for (uint8_t n = 0; n < channel.count; n++)
+			{
+				int8_t rssi = n == 0 ? channel.rssiMin : n == channel.count - 1 ? channel.rssiMax : channel.rssiMean;
+				copy[VIEW_RSSI_OFFSET] = -rssi;
+				uint64_t offset = channel.count > 1 ? span * (channel.count - 1 - n) / (channel.count - 1) : 0;
+				enqueue(time > offset ? time - offset : 0, i + 1, copy.data(), copy.size());
+				expandedRepeats++;
+			}
+		}
+	}
+
+	/*
+		Read ahead until the first record queued can no longer be
+		preceded by a repeat read later
+	*/
+	void fill()
+	{
+		while (!readerDone && (queue.empty() || readTime < queue.begin()->first + REPLAY_REORDER_MICROS))
+		{
+			if (!reader->next(record))
+			{
+				readerDone = true;
+				break;
+			}
+
+			uint64_t time = logTime(record.millis, record.microsFraction);
+			if (time > readTime)
+				readTime = time;
+
+			if (record.type == OUTPUT_TYPE_RADIO_REPEAT)
+			{
+				expandRepeat(time);
+				continue;
+			}
+
+			int index = portFor(record.type);
+			if (index < 0)
+				continue;
+			if (index)
+			{
+				PacketView packet(record.payload, record.length);
+				if (packet.isAdvertising() && packet.address())
+				{
+					const uint8_t *pdu = packet.pdu() - 2;
+					uint32_t hash = (uint32_t)repeatFrameHash(pdu, 2 + packet.pduLength());
+					auto &frame = lastFrames[frameKey(packet.address(), pdu[0], pdu[1], hash)];
+					frame.assign(record.payload, record.payload + record.length);
+				}
+			}
+			enqueue(time, index, record.payload, record.length);
+		}
+
+		if (!started && !queue.empty())
+		{
+			firstTime = queue.begin()->first;
+			started = true;
+		}
+	}
+
+	uint64_t dueMicros() const
+	{
+		uint64_t time = queue.begin()->first;
+		uint64_t offset = time > firstTime ? time - firstTime : 0;
+		return speed > 0 ? startMicros + (uint64_t)(offset / speed) : startMicros;
+	}
+
+	HardwareSerial *port(size_t index) const
+	{
+		return index ? radios[index - 1] : gps;
+	}
+
+	uint64_t backlog(size_t index) const
+	{
+		return injected[index] - (port(index)->stats().bytesArrived - arrivedBefore[index]);
+	}
+
+public:
+	// Per port, GPS then radios 37 to 39
+	uint64_t records[4];
+	uint64_t injected[4];
+	// Frames put back from repeat records, and repeats with no frame to copy
+	uint64_t expandedRepeats;
+	uint64_t lostRepeats;
+
+	LogReplay() : reader(nullptr), gps(nullptr), radios(), speed(1), startMicros(0), firstTime(0),
+				  started(false), arrivedBefore(), readerDone(true), readTime(0), records(), injected(),
+				  expandedRepeats(0), lostRepeats(0)
+	{
+	}
+
+	~LogReplay() { delete reader; }
+
+	/*
+		Open a log to replay onto the given ports, any of which may be
+		nullptr to leave its records out
+	*/
+	bool open(const char *path, HardwareSerial *gpsPort, HardwareSerial *radio37, HardwareSerial *radio38, HardwareSerial *radio39)
+	{
+		if (!file.open(path))
+			return false;
+
+		delete reader;
+		reader = new LogReader(file.data(), file.size());
+		if (!reader->supported())
+			return false;
+
+		gps = gpsPort;
+		radios[0] = radio37;
+		radios[1] = radio38;
+		radios[2] = radio39;
+		readerDone = false;
+		readTime = 0;
+		queue.clear();
+		lastFrames.clear();
+		return true;
+	}
+
+	/*
+		Start replaying at the current virtual time, speed times as fast
+		as recorded, or as fast as possible for 0
+	*/
+	void start(double replaySpeed)
+	{
+		speed = replaySpeed;
+		startMicros = hostMicros();
+		started = false;
+		for (size_t i = 0; i < 4; i++)
+			if (port(i))
+				arrivedBefore[i] = port(i)->stats().bytesArrived;
+		fill();
+	}
+
+	/*
+		Put what is due by the horizon on the wire, calling
+		onFrame(port, bytes) after each frame or sentence with the bytes
+		put on that port so far, port being 0 for
+		the GPS and 1 to 3 for radios 37 to 39. Call before every loop()
+		pass.
+	*/
+	template <typename F>
+	void feed(F onFrame)
+	{
+		uint64_t horizon = hostMicros() + REPLAY_HORIZON_MICROS;
+		while (!queue.empty())
+		{
+			const replay_item_t &item = queue.begin()->second;
+			size_t index = item.port;
+			uint64_t due = dueMicros();
+			if (speed > 0 ? due > horizon : backlog(index) >= REPLAY_BACKLOG_BYTES)
+				return;
+
+			if (index == 0)
+			{
+				port(index)->inject(item.bytes.data(), item.bytes.size(), due);
+				injected[index] += item.bytes.size();
+			}
+			else
+			{
+				framed.resize(FRAME_ENCODED_SIZE_MAX(item.bytes.size()));
+				size_t n = encodeFrame(item.bytes.data(), item.bytes.size(), framed.data());
+				port(index)->inject(framed.data(), n, due);
+				injected[index] += n;
+			}
+			records[index]++;
+			queue.erase(queue.begin());
+			onFrame(index, injected[index]);
+			fill();
+		}
+	}
+
+	void feed()
+	{
+		feed([](size_t, uint64_t) {});
+	}
+
+	/*
+		Whether every record has been put on the wire
+	*/
+	bool done() const { return queue.empty(); }
+
+	/*
+		Virtual time the next record is due, UINT64_MAX once done
+	*/
+	uint64_t nextMicros() const
+	{
+		if (queue.empty())
+			return UINT64_MAX;
+		return speed > 0 ? dueMicros() : hostMicros();
+	}
+};
+
+#endif // __REPLAY_H_
@@ -0,0 +1,125 @@
+#ifndef __ADDRESSTABLE_H_
+#define __ADDRESSTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ADDRESS_SIZE (6)
+
+// Slot numbers are logged as a single byte
+#define ADDRESS_TABLE_SLOTS (256)
+#define ADDRESS_TABLE_BUCKET_BITS (9)
+#define ADDRESS_TABLE_BUCKETS (1 << ADDRESS_TABLE_BUCKET_BITS)
+#define ADDRESS_TABLE_NONE (0xFFFF)
+
+/*
+	The ADDRESS_TABLE_SLOTS most recently seen advertiser addresses. A hash
+	table finds an address's slot, and a list through every slot in use
+	order picks the least recently used one to give to a new address.
+*/
+class AddressTable
+{
+private:
+	uint8_t addresses[ADDRESS_TABLE_SLOTS][ADDRESS_SIZE];
+	bool used[ADDRESS_TABLE_SLOTS];
+	// Next slot in the same bucket
+	uint16_t chain[ADDRESS_TABLE_SLOTS];
+	uint16_t buckets[ADDRESS_TABLE_BUCKETS];
+
+	// Use order as a ring, so the slot newer than the newest is the oldest
+	uint8_t newer[ADDRESS_TABLE_SLOTS];
+	uint8_t older[ADDRESS_TABLE_SLOTS];
+	uint8_t newest;
+
+	static uint32_t hash(const uint8_t *address)
+	{
+		uint32_t low;
+		uint16_t high;
+		memcpy(&low, address, 4);
+		memcpy(&high, address + 4, 2);
+		return ((low ^ (high * 0x9E3779B1u)) * 2654435761u) >> (32 - ADDRESS_TABLE_BUCKET_BITS);
+	}
+
+	void unlink(uint8_t slot)
+	{
+		newer[older[slot]] = newer[slot];
+		older[newer[slot]] = older[slot];
+	}
+
+	void makeNewest(uint8_t slot)
+	{
+		if (slot == newest)
+			return;
+
+		unlink(slot);
+		uint8_t oldest = newer[newest];
+		older[slot] = newest;
+		newer[slot] = oldest;
+		newer[newest] = slot;
+		older[oldest] = slot;
+		newest = slot;
+	}
+
+	void removeFromBucket(uint8_t slot)
+	{
+		uint16_t *link = &buckets[hash(addresses[slot])];
+		while (*link != slot)
+			link = &chain[*link];
+		*link = chain[slot];
+	}
+
+public:
+	AddressTable()
+	{
+		reset();
+	}
+
+	/*
+		Forget every address
+	*/
+	void reset()
+	{
+		memset(used, 0, sizeof(used));
+		for (uint16_t i = 0; i < ADDRESS_TABLE_BUCKETS; i++)
+			buckets[i] = ADDRESS_TABLE_NONE;
+
+		for (uint16_t i = 0; i < ADDRESS_TABLE_SLOTS; i++)
+		{
+			newer[i] = i - 1;
+			older[i] = i + 1;
+		}
+		newest = 0;
+	}
+
+	/*
+		Find the slot holding address, or give it the least recently used
+		slot. Returns whether it was already there.
+	*/
+	bool lookup(const uint8_t *address, uint8_t &slot)
+	{
+		uint32_t bucket = hash(address);
+		for (uint16_t i = buckets[bucket]; i != ADDRESS_TABLE_NONE; i = chain[i])
+		{
+			if (!memcmp(addresses[i], address, ADDRESS_SIZE))
+			{
+				slot = i;
+				makeNewest(slot);
+				return true;
+			}
+		}
+
+		slot = newer[newest];
+		if (used[slot])
+			removeFromBucket(slot);
+
+		memcpy(addresses[slot], address, ADDRESS_SIZE);
+		used[slot] = true;
+		chain[slot] = buckets[bucket];
+		buckets[bucket] = slot;
+		makeNewest(slot);
+		return false;
+	}
+};
+
+#endif // __ADDRESSTABLE_H_
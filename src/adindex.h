@@ -0,0 +1,259 @@
+#ifndef __ADINDEX_H_
+#define __ADINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "packetview.h"
+
+// AD types, from the Bluetooth Assigned Numbers
+#define AD_TYPE_FLAGS (0x01)
+#define AD_TYPE_UUID16_INCOMPLETE (0x02)
+#define AD_TYPE_UUID16_COMPLETE (0x03)
+#define AD_TYPE_UUID32_INCOMPLETE (0x04)
+#define AD_TYPE_UUID32_COMPLETE (0x05)
+#define AD_TYPE_UUID128_INCOMPLETE (0x06)
+#define AD_TYPE_UUID128_COMPLETE (0x07)
+#define AD_TYPE_NAME_SHORT (0x08)
+#define AD_TYPE_NAME_COMPLETE (0x09)
+#define AD_TYPE_TX_POWER (0x0A)
+#define AD_TYPE_SERVICE_DATA16 (0x16)
+#define AD_TYPE_APPEARANCE (0x19)
+#define AD_TYPE_MANUFACTURER (0xFF)
+
+// A legacy payload of 31 bytes holds at most 15 structures
+#define AD_INDEX_ENTRIES (16)
+
+#define AD_UUID16_SIZE (2)
+#define AD_UUID128_SIZE (16)
+
+/*
+	Where an AD structure's data is in the payload
+*/
+typedef struct
+{
+	uint8_t type;
+	uint8_t offset;
+	uint8_t length;
+} ad_index_entry_t;
+
+/*
+	The AD structures of one advertising payload by type, from a single
+	walk over it. Built on the stack for every packet: no allocation, and
+	the index points into the payload, which has to outlive it.
+
+	A 64-bit mask of the types present (type mod 64) rejects most
+	lookups for types the payload lacks without looking at the entries.
+	Where a type appears more than once, find() gives the first; any()
+	and the UUID helpers go through every structure of their kind.
+*/
+class AdIndex
+{
+private:
+	const uint8_t *payload;
+	uint8_t payloadLength;
+	uint8_t entryCount;
+	bool damaged;
+	uint64_t present;
+	ad_index_entry_t entries[AD_INDEX_ENTRIES];
+
+	static uint64_t bit(uint8_t type) { return 1ull << (type & 63); }
+
+	template <typename F>
+	uint8_t eachUuid(uint8_t incomplete, uint8_t complete, uint8_t size, F callback) const
+	{
+		uint8_t n = 0;
+		if (!(present & (bit(incomplete) | bit(complete))))
+			return 0;
+
+		for (uint8_t i = 0; i < entryCount; i++)
+		{
+			const ad_index_entry_t &entry = entries[i];
+			if (entry.type != incomplete && entry.type != complete)
+				continue;
+			for (uint8_t at = 0; at + size <= entry.length; at += size)
+				if (callback(n++, payload + entry.offset + at))
+					return n;
+		}
+		return n;
+	}
+
+public:
+	AdIndex() : payload(nullptr), payloadLength(0), entryCount(0), damaged(false), present(0) {}
+
+	AdIndex(const uint8_t *data, uint8_t length) { build(data, length); }
+
+	explicit AdIndex(const PacketView &packet) { build(packet.adData(), packet.adLength()); }
+
+	/*
+		Index the AD structures of a payload. Stops at the first zero
+		length, which pads the rest, and at a structure that would run past
+		the end, which marks the payload damaged; what came before it is
+		still indexed.
+	*/
+	void build(const uint8_t *data, uint8_t length)
+	{
+		payload = data;
+		payloadLength = length;
+		entryCount = 0;
+		present = 0;
+
+		uint8_t used = 0;
+		for (ad_structure_t ad : AdStructures(data, length))
+		{
+			if (entryCount == AD_INDEX_ENTRIES)
+				break;
+			entries[entryCount++] = {ad.type, (uint8_t)(ad.data - data), ad.length};
+			present |= bit(ad.type);
+			used = ad.data - data + ad.length;
+		}
+		damaged = used < length && data[used] && entryCount < AD_INDEX_ENTRIES;
+	}
+
+	/*
+		Whether a structure ran past the end of the payload
+	*/
+	bool truncated() const { return damaged; }
+
+	uint8_t size() const { return entryCount; }
+	const ad_index_entry_t &entry(uint8_t i) const { return entries[i]; }
+
+	bool has(uint8_t type) const { return find(type) != nullptr; }
+
+	/*
+		The data of the first structure of a type, or nullptr, with its
+		length in length
+	*/
+	const uint8_t *find(uint8_t type, uint8_t *length = nullptr) const
+	{
+		if (!(present & bit(type)))
+			return nullptr;
+
+		for (uint8_t i = 0; i < entryCount; i++)
+		{
+			if (entries[i].type == type)
+			{
+				if (length)
+					*length = entries[i].length;
+				return payload + entries[i].offset;
+			}
+		}
+		return nullptr;
+	}
+
+	/*
+		Whether match(data, length) holds for any structure of a type
+	*/
+	template <typename F>
+	bool any(uint8_t type, F match) const
+	{
+		if (!(present & bit(type)))
+			return false;
+
+		for (uint8_t i = 0; i < entryCount; i++)
+			if (entries[i].type == type && match(payload + entries[i].offset, entries[i].length))
+				return true;
+		return false;
+	}
+
+	/*
+		The flags byte, or -1 without one
+	*/
+	int16_t flags() const
+	{
+		uint8_t length;
+		const uint8_t *data = find(AD_TYPE_FLAGS, &length);
+		return data && length ? data[0] : -1;
+	}
+
+	/*
+		The company identifier that starts the manufacturer specific data,
+		and the data after it
+	*/
+	bool manufacturer(uint16_t &id, const uint8_t **data = nullptr, uint8_t *length = nullptr) const
+	{
+		uint8_t dataLength;
+		const uint8_t *p = find(AD_TYPE_MANUFACTURER, &dataLength);
+		if (!p || dataLength < 2)
+			return false;
+
+		id = p[0] | p[1] << 8;
+		if (data)
+			*data = p + 2;
+		if (length)
+			*length = dataLength - 2;
+		return true;
+	}
+
+	/*
+		The local name, complete if there is one, else shortened. Not
+		terminated.
+	*/
+	bool localName(const char *&name, uint8_t &length, bool *complete = nullptr) const
+	{
+		const uint8_t *p = find(AD_TYPE_NAME_COMPLETE, &length);
+		if (complete)
+			*complete = p != nullptr;
+		if (!p)
+			p = find(AD_TYPE_NAME_SHORT, &length);
+		name = (const char *)p;
+		return p != nullptr;
+	}
+
+	/*
+		Advertised 16-bit service UUIDs, complete and incomplete lists
+		alike: how many there are, and the one at index
+	*/
+	uint8_t uuid16Count() const
+	{
+		return eachUuid(AD_TYPE_UUID16_INCOMPLETE, AD_TYPE_UUID16_COMPLETE, AD_UUID16_SIZE,
+						[](uint8_t, const uint8_t *) { return false; });
+	}
+
+	bool uuid16(uint8_t index, uint16_t &uuid) const
+	{
+		bool found = false;
+		eachUuid(AD_TYPE_UUID16_INCOMPLETE, AD_TYPE_UUID16_COMPLETE, AD_UUID16_SIZE,
+				 [&](uint8_t n, const uint8_t *p) {
+					 if (n != index)
+						 return false;
+					 uuid = p[0] | p[1] << 8;
+					 found = true;
+					 return true;
+				 });
+		return found;
+	}
+
+	bool hasUuid16(uint16_t uuid) const
+	{
+		bool found = false;
+		eachUuid(AD_TYPE_UUID16_INCOMPLETE, AD_TYPE_UUID16_COMPLETE, AD_UUID16_SIZE,
+				 [&](uint8_t, const uint8_t *p) { return found = (p[0] | p[1] << 8) == uuid; });
+		return found;
+	}
+
+	/*
+		Advertised 128-bit service UUIDs, as the 16 bytes sent, least
+		significant first
+	*/
+	uint8_t uuid128Count() const
+	{
+		return eachUuid(AD_TYPE_UUID128_INCOMPLETE, AD_TYPE_UUID128_COMPLETE, AD_UUID128_SIZE,
+						[](uint8_t, const uint8_t *) { return false; });
+	}
+
+	const uint8_t *uuid128(uint8_t index) const
+	{
+		const uint8_t *uuid = nullptr;
+		eachUuid(AD_TYPE_UUID128_INCOMPLETE, AD_TYPE_UUID128_COMPLETE, AD_UUID128_SIZE,
+				 [&](uint8_t n, const uint8_t *p) {
+					 if (n == index)
+						 uuid = p;
+					 return uuid != nullptr;
+				 });
+		return uuid;
+	}
+};
+
+#endif // __ADINDEX_H_
@@ -0,0 +1,224 @@
+#ifndef __ADVERTISERTABLE_H_
+#define __ADVERTISERTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "packet.h"
+#include "adindex.h"
+#include "packetview.h"
+
+// Slots looked at for an address, so the cost per packet stays the same
+// however full the table is
+#define ADVERTISER_TABLE_PROBES (8)
+
+// The RSSI average moves 1/2^ADVERTISER_RSSI_SHIFT of the way to each new
+// reading, and is kept in 1/ADVERTISER_RSSI_SCALE dBm
+#define ADVERTISER_RSSI_SHIFT (3)
+#define ADVERTISER_RSSI_SCALE (16)
+
+#define ADVERTISER_USED (0x01)
+#define ADVERTISER_RANDOM (0x02)
+
+// Company or service not advertised (yet)
+#define ADVERTISER_NONE (0xFFFF)
+
+/*
+	What has been seen of one advertiser, 36 bytes
+*/
+typedef struct
+{
+	uint8_t address[BDADDR_SIZE];
+	uint8_t advType;
+	uint8_t flags;
+	uint32_t firstMillis;
+	uint32_t lastMillis;
+	// Channels 37 to 39
+	uint32_t packets[3];
+	int8_t rssiMin;
+	int8_t rssiMax;
+	int16_t rssiAverage;
+	// Last advertised, from any of its PDUs
+	uint16_t manufacturer;
+	uint16_t service;
+} advertiser_t;
+
+/*
+	The advertisers heard recently, by address, in a fixed number of
+	entries supplied by the caller. Open addressing with linear probing,
+	an address only ever being looked for in the ADVERTISER_TABLE_PROBES
+	slots from its hash. Once those are all taken a new address replaces
+	the one there that has gone longest without being heard, so a crowd of
+	passing devices cycles through the table in constant time per packet
+	while the ones still advertising stay.
+
+	Entries are never removed otherwise, so the first empty slot ends a
+	search.
+*/
+class AdvertiserTable
+{
+private:
+	advertiser_t *entries;
+	uint32_t mask;
+	uint8_t shift;
+	uint32_t used;
+
+	uint32_t hash(const uint8_t *address) const
+	{
+		uint32_t low;
+		uint16_t high;
+		memcpy(&low, address, 4);
+		memcpy(&high, address + 4, 2);
+		return ((low ^ (high * 0x9E3779B1u)) * 2654435761u) >> shift;
+	}
+
+public:
+	uint32_t evictions;
+
+	/*
+		capacity must be a power of two, at least ADVERTISER_TABLE_PROBES
+	*/
+	AdvertiserTable(advertiser_t *entries, uint32_t capacity)
+		: entries(entries), mask(capacity - 1), shift(32), used(0), evictions(0)
+	{
+		while ((1ul << (32 - shift)) < capacity)
+			shift--;
+		reset();
+	}
+
+	/*
+		Forget every advertiser
+	*/
+	void reset()
+	{
+		memset(entries, 0, sizeof(advertiser_t) * (mask + 1));
+		used = 0;
+		evictions = 0;
+	}
+
+	uint32_t capacity() const { return mask + 1; }
+
+	uint32_t size() const { return used; }
+
+	const advertiser_t &entry(uint32_t index) const { return entries[index]; }
+
+	/*
+		The entry for address, or nullptr if it is not in the table
+	*/
+	const advertiser_t *find(const uint8_t *address) const
+	{
+		uint32_t index = hash(address);
+		for (uint8_t i = 0; i < ADVERTISER_TABLE_PROBES; i++, index = (index + 1) & mask)
+		{
+			const advertiser_t &entry = entries[index];
+			if (!(entry.flags & ADVERTISER_USED))
+				return nullptr;
+			if (!memcmp(entry.address, address, BDADDR_SIZE))
+				return &entry;
+		}
+		return nullptr;
+	}
+
+	/*
+		Count one packet from address, making room for it if it is new
+	*/
+	advertiser_t &update(const uint8_t *address, bool random, uint8_t advType, uint8_t channel, int8_t rssi, uint32_t nowMillis)
+	{
+		uint32_t index = hash(address);
+		advertiser_t *oldest = nullptr;
+		advertiser_t *entry = nullptr;
+		bool known = false;
+		for (uint8_t i = 0; i < ADVERTISER_TABLE_PROBES; i++, index = (index + 1) & mask)
+		{
+			advertiser_t &candidate = entries[index];
+			if (!(candidate.flags & ADVERTISER_USED))
+			{
+				entry = &candidate;
+				used++;
+				break;
+			}
+			if (!memcmp(candidate.address, address, BDADDR_SIZE))
+			{
+				entry = &candidate;
+				known = true;
+				break;
+			}
+			if (!oldest || nowMillis - candidate.lastMillis > nowMillis - oldest->lastMillis)
+				oldest = &candidate;
+		}
+
+		if (!entry)
+		{
+			entry = oldest;
+			evictions++;
+		}
+
+		if (!known)
+		{
+			memcpy(entry->address, address, BDADDR_SIZE);
+			entry->flags = ADVERTISER_USED;
+			entry->advType = advType;
+			entry->firstMillis = nowMillis;
+			memset(entry->packets, 0, sizeof(entry->packets));
+			entry->rssiMin = rssi;
+			entry->rssiMax = rssi;
+			entry->rssiAverage = rssi * ADVERTISER_RSSI_SCALE;
+			entry->manufacturer = ADVERTISER_NONE;
+			entry->service = ADVERTISER_NONE;
+		}
+
+		if (random)
+			entry->flags |= ADVERTISER_RANDOM;
+		else
+			entry->flags &= ~ADVERTISER_RANDOM;
+
+		// A scan response says less about the device than what it advertises with
+		if (advType != PDU_ADV_TYPE_SCAN_RSP)
+			entry->advType = advType;
+
+		entry->lastMillis = nowMillis;
+		if (channel >= 37 && channel <= 39)
+			entry->packets[channel - 37]++;
+		if (rssi < entry->rssiMin)
+			entry->rssiMin = rssi;
+		if (rssi > entry->rssiMax)
+			entry->rssiMax = rssi;
+		entry->rssiAverage += (rssi * ADVERTISER_RSSI_SCALE - entry->rssiAverage) >> ADVERTISER_RSSI_SHIFT;
+		return *entry;
+	}
+
+	/*
+		Count a radio packet if it is an intact advertising PDU sent by an
+		advertiser, ads being the index of its AD structures. Returns
+		whether it did.
+	*/
+	bool observe(const PacketView &packet, const AdIndex &ads, uint32_t nowMillis)
+	{
+		if (!packet.isAdvertising() || !packet.crcOk() || !packet.address())
+			return false;
+
+		switch (packet.advType())
+		{
+		case PDU_ADV_TYPE_ADV_IND:
+		case PDU_ADV_TYPE_DIRECT_IND:
+		case PDU_ADV_TYPE_NONCONN_IND:
+		case PDU_ADV_TYPE_SCAN_RSP:
+		case PDU_ADV_TYPE_SCAN_IND:
+		{
+			// Anything weaker than an int8_t holds is noise anyway
+			advertiser_t &entry = update(packet.address(), packet.txAddrRandom(), packet.advType(), packet.channel(),
+										 packet.rssi() < -128 ? -128 : packet.rssi(), nowMillis);
+			uint16_t id;
+			if (ads.manufacturer(id))
+				entry.manufacturer = id;
+			if (ads.uuid16(0, id))
+				entry.service = id;
+			return true;
+		}
+		}
+		return false;
+	}
+};
+
+#endif // __ADVERTISERTABLE_H_
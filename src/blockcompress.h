@@ -0,0 +1,214 @@
+#ifndef __BLOCKCOMPRESS_H_
+#define __BLOCKCOMPRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+	LZ4 block format compression, small enough to run on every log block
+	in loop(). Output is standard LZ4 block data, so anything that reads
+	LZ4 blocks can check it. The compressor is greedy with a single hash
+	probe per position, trading some ratio for speed; advertising traffic
+	repeats whole addresses and AD structures, which is what it finds.
+
+	Inputs are at most 64 KiB, so the hash table holds 16-bit positions.
+*/
+
+#define BLOCK_COMPRESS_HASH_BITS (12)
+#define BLOCK_COMPRESS_HASH_SIZE (1 << BLOCK_COMPRESS_HASH_BITS)
+
+// Worst case output for length bytes of input
+#define BLOCK_COMPRESS_BOUND(length) ((length) + (length) / 255 + 16)
+
+// Largest input whose worst case fits in capacity bytes
+#define BLOCK_COMPRESS_INPUT_MAX(capacity) (((capacity) - 16) * 255 / 256)
+
+#define BLOCK_COMPRESS_MIN_MATCH (4)
+// The format ends every block with at least this many literals
+#define BLOCK_COMPRESS_LAST_LITERALS (5)
+// and starts no match closer than this to the end
+#define BLOCK_COMPRESS_MATCH_LIMIT (12)
+
+inline uint32_t blockCompressRead32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+inline uint32_t blockCompressHash(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - BLOCK_COMPRESS_HASH_BITS);
+}
+
+inline uint8_t *blockCompressLength(uint8_t *op, size_t length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+/*
+	Compress length bytes of src into dst, which must hold
+	BLOCK_COMPRESS_BOUND(length). hashTable is BLOCK_COMPRESS_HASH_SIZE
+	scratch entries. Returns the compressed size.
+*/
+inline size_t blockCompress(const uint8_t *src, size_t length, uint8_t *dst, uint16_t *hashTable)
+{
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *end = src + length;
+	uint8_t *op = dst;
+
+	if (length > BLOCK_COMPRESS_MATCH_LIMIT)
+	{
+		const uint8_t *matchStartLimit = end - BLOCK_COMPRESS_MATCH_LIMIT;
+		const uint8_t *matchEndLimit = end - BLOCK_COMPRESS_LAST_LITERALS;
+		memset(hashTable, 0, BLOCK_COMPRESS_HASH_SIZE * sizeof(uint16_t));
+
+		// Step faster through data that is not matching
+		uint32_t misses = 0;
+
+		while (ip < matchStartLimit)
+		{
+			uint32_t sequence = blockCompressRead32(ip);
+			uint32_t h = blockCompressHash(sequence);
+			const uint8_t *ref = src + hashTable[h];
+			hashTable[h] = (uint16_t)(ip - src);
+
+			if (ref >= ip || blockCompressRead32(ref) != sequence)
+			{
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			// Take in matching bytes before the probe as well
+			while (ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+
+			size_t matchLength = BLOCK_COMPRESS_MIN_MATCH;
+			while (ip + matchLength < matchEndLimit && ip[matchLength] == ref[matchLength])
+				matchLength++;
+
+			size_t literalLength = ip - anchor;
+			uint8_t *token = op++;
+			*token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+			if (literalLength >= 15)
+				op = blockCompressLength(op, literalLength - 15);
+			memcpy(op, anchor, literalLength);
+			op += literalLength;
+
+			uint16_t offset = (uint16_t)(ip - ref);
+			*op++ = (uint8_t)offset;
+			*op++ = (uint8_t)(offset >> 8);
+
+			size_t extra = matchLength - BLOCK_COMPRESS_MIN_MATCH;
+			*token |= (uint8_t)(extra >= 15 ? 15 : extra);
+			if (extra >= 15)
+				op = blockCompressLength(op, extra - 15);
+
+			ip += matchLength;
+			anchor = ip;
+
+			// Remember a position inside the match, which finds repeats of
+			// the same record shifted by a few bytes
+			if (ip < matchStartLimit)
+				hashTable[blockCompressHash(blockCompressRead32(ip - 2))] = (uint16_t)(ip - 2 - src);
+		}
+	}
+
+	size_t literalLength = end - anchor;
+	*op++ = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+	if (literalLength >= 15)
+		op = blockCompressLength(op, literalLength - 15);
+	memcpy(op, anchor, literalLength);
+	op += literalLength;
+
+	return op - dst;
+}
+
+/*
+	Decompress an LZ4 block into at most capacity bytes of dst. Returns
+	the decompressed size, or -1 if src is malformed or does not fit.
+*/
+inline int32_t blockDecompress(const uint8_t *src, size_t length, uint8_t *dst, size_t capacity)
+{
+	const uint8_t *ip = src;
+	const uint8_t *end = src + length;
+	uint8_t *op = dst;
+	uint8_t *outEnd = dst + capacity;
+
+	while (ip < end)
+	{
+		uint8_t token = *ip++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15)
+		{
+			uint8_t b;
+			do
+			{
+				if (ip == end)
+					return -1;
+				b = *ip++;
+				literalLength += b;
+			} while (b == 255);
+		}
+
+		if (literalLength > (size_t)(end - ip) || literalLength > (size_t)(outEnd - op))
+			return -1;
+		memcpy(op, ip, literalLength);
+		op += literalLength;
+		ip += literalLength;
+
+		// The last sequence has no match
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return -1;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return -1;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15)
+		{
+			uint8_t b;
+			do
+			{
+				if (ip == end)
+					return -1;
+				b = *ip++;
+				matchLength += b;
+			} while (b == 255);
+		}
+		matchLength += BLOCK_COMPRESS_MIN_MATCH;
+
+		if (matchLength > (size_t)(outEnd - op))
+			return -1;
+
+		// Byte by byte only when a match overlaps its own output
+		const uint8_t *ref = op - offset;
+		if (offset >= matchLength)
+			memcpy(op, ref, matchLength);
+		else
+			for (size_t i = 0; i < matchLength; i++)
+				op[i] = ref[i];
+		op += matchLength;
+	}
+
+	return op - dst;
+}
+
+#endif // __BLOCKCOMPRESS_H_
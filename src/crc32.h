@@ -0,0 +1,70 @@
+#ifndef __CRC32_H_
+#define __CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+	CRC-32 (IEEE 802.3, as zlib), one table lookup per byte. The table is
+	built at compile time and lives in flash.
+
+	Host tools that check whole logs define CRC32_SLICES as 8 to process
+	eight bytes per step with eight tables (8 KiB), which is several times
+	faster on a desktop CPU.
+*/
+#ifndef CRC32_SLICES
+#define CRC32_SLICES (1)
+#endif
+
+struct crc32_table_t
+{
+	uint32_t entries[CRC32_SLICES][256];
+
+	constexpr crc32_table_t() : entries()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			entries[0][i] = c;
+		}
+
+		// Table n is the CRC of a byte followed by n zero bytes
+		for (int n = 1; n < CRC32_SLICES; n++)
+			for (uint32_t i = 0; i < 256; i++)
+				entries[n][i] = entries[0][entries[n - 1][i] & 0xFF] ^ (entries[n - 1][i] >> 8);
+	}
+};
+
+static constexpr crc32_table_t CRC32_TABLE;
+
+/*
+	Continue a CRC over more data; start with crc = 0
+*/
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	crc = ~crc;
+
+#if CRC32_SLICES == 8
+	// Little endian only, as every host the tools run on
+	const uint32_t(*t)[256] = CRC32_TABLE.entries;
+	for (; length >= 8; length -= 8, p += 8)
+	{
+		uint32_t low, high;
+		memcpy(&low, p, 4);
+		memcpy(&high, p + 4, 4);
+		low ^= crc;
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+			  t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+	}
+#endif
+
+	while (length--)
+		crc = CRC32_TABLE.entries[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+#endif // __CRC32_H_
@@ -22,11 +22,14 @@ public:
 
         d.setCursor(1, 1);
         d.setTextColor(0, 1);
-        d.print("Packets\n\nPacket rate\n\nData rate");
+        d.print("Packets\n\nPacket rate\n\nData rate\n\nFiltered");
         d.refresh();
     }
 
-    void setDetailsCount(uint64_t packets, uint64_t packetsPerSec, uint64_t baud)
+    /*
+        The filtered count shares its label's line, clear of the status bar
+    */
+    void setDetailsCount(uint64_t packets, uint64_t packetsPerSec, uint64_t baud, uint64_t filtered)
     {
         d.setCursor(1, 1);
         d.setTextColor(0, 1);
@@ -42,6 +45,10 @@ public:
         d.print("  ");
         d.print(baud >> 10);
         d.println(" kbps  ");
+        d.println();
+        d.print("Filtered ");
+        d.print(filtered);
+        d.print("  ");
         d.refresh();
     }
 
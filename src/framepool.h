@@ -0,0 +1,87 @@
+#ifndef __FRAMEPOOL_H_
+#define __FRAMEPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Largest frame accepted from a radio, comfortably above packet_t with a
+// maximum length PDU
+#define FRAME_BUFFER_SIZE (1024)
+
+/*
+	A completed frame waiting to be logged, with the fields of its radio
+	packet log record
+*/
+typedef struct
+{
+	uint8_t outputType;
+	uint32_t millis;
+	uint16_t microsFraction;
+	uint32_t length;
+	uint8_t data[FRAME_BUFFER_SIZE];
+} __packed frame_slot_t;
+
+/*
+	Fixed pool of completed-frame slots, handed out and drained in FIFO
+	order so frames reach the log in the order they were decoded. Decoding
+	stops when the pool is full, leaving the rest of the frames in the
+	radio buffers until the writer catches up.
+*/
+class FramePool
+{
+private:
+	frame_slot_t *slots;
+	size_t capacity;
+	size_t head;
+	size_t count;
+
+public:
+	size_t highWatermark;
+	// Decoded frames that found every slot taken, counted by the caller
+	uint32_t stalls;
+
+	FramePool(frame_slot_t *slots, size_t capacity)
+		: slots(slots), capacity(capacity), head(0), count(0), highWatermark(0), stalls(0)
+	{
+	}
+
+	size_t size() const { return count; }
+
+	bool full() const { return count == capacity; }
+
+	/*
+		The next free slot, or nullptr if every slot holds a frame that has
+		not been drained yet. The slot only joins the queue once published.
+	*/
+	frame_slot_t *acquire()
+	{
+		if (count == capacity)
+			return nullptr;
+
+		return &slots[(head + count) % capacity];
+	}
+
+	void publish()
+	{
+		count++;
+		if (count > highWatermark)
+			highWatermark = count;
+	}
+
+	/*
+		Oldest completed frame, or nullptr if there is none
+	*/
+	frame_slot_t *peek()
+	{
+		return count ? &slots[head] : nullptr;
+	}
+
+	void release()
+	{
+		head = (head + 1) % capacity;
+		count--;
+	}
+};
+
+#endif // __FRAMEPOOL_H_
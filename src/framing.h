@@ -0,0 +1,346 @@
+#ifndef __FRAMING_H_
+#define __FRAMING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+	Radio link framing: START, payload, XOR checksum seeded with BYTE_SEED,
+	END. Any START/ESC/END byte inside the payload or checksum is sent as
+	ESC followed by the byte XOR BYTE_XOR.
+*/
+#define BYTE_START (0x7F)
+#define BYTE_ESC (0x7E)
+#define BYTE_END (0x7D)
+#define BYTE_XOR (0x20)
+#define BYTE_SEED (0xAA)
+
+// Worst case encoded size of a frame carrying a payload of the given length
+#define FRAME_ENCODED_SIZE_MAX(length) (2 + 2 * ((length) + 1))
+
+inline bool frameByteNeedsEscape(uint8_t b)
+{
+	return b == BYTE_START || b == BYTE_ESC || b == BYTE_END;
+}
+
+/*
+	Encode a payload as it would arrive from a radio. The output buffer must
+	hold at least FRAME_ENCODED_SIZE_MAX(length) bytes. Returns the number of
+	bytes written.
+*/
+inline size_t encodeFrame(const uint8_t *payload, size_t length, uint8_t *out)
+{
+	size_t n = 0;
+	uint8_t checksum = BYTE_SEED;
+
+	out[n++] = BYTE_START;
+
+	for (size_t i = 0; i <= length; i++)
+	{
+		uint8_t b = i < length ? payload[i] : checksum;
+		checksum ^= b;
+
+		if (frameByteNeedsEscape(b))
+		{
+			out[n++] = BYTE_ESC;
+			out[n++] = b ^ BYTE_XOR;
+		}
+		else
+			out[n++] = b;
+	}
+
+	out[n++] = BYTE_END;
+	return n;
+}
+
+#define FRAME_INCOMPLETE (-1)
+#define FRAME_STARTED (-2)
+
+/*
+	XOR the bytes of data[0..length) into checksum up to the first START,
+	ESC or END byte, and return its offset (length if there is none). Works
+	a 32-bit word at a time: the three delimiters are 0x7D-0x7F, so after
+	XOR with 0x7C they are exactly the bytes in 1..3.
+*/
+inline size_t scanFrameRun(const uint8_t *data, size_t length, uint8_t &checksum)
+{
+	size_t i = 0;
+	uint32_t acc = 0;
+
+	// Short runs between escapes are not worth the word loop
+	if (length >= 8 && !frameByteNeedsEscape(data[0]))
+	{
+		for (; i + 4 <= length; i += 4)
+		{
+			uint32_t w;
+			memcpy(&w, data + i, 4);
+
+			uint32_t x = w ^ 0x7C7C7C7C;
+			uint32_t y = x & 0xFCFCFCFC;
+
+			// Exact per-byte zero tests, high bit set in each zero byte
+			uint32_t yZero = ~(((y & 0x7F7F7F7F) + 0x7F7F7F7F) | y | 0x7F7F7F7F);
+			uint32_t xZero = ~(((x & 0x7F7F7F7F) + 0x7F7F7F7F) | x | 0x7F7F7F7F);
+			if (yZero & ~xZero)
+				break;
+
+			acc ^= w;
+		}
+
+		acc ^= acc >> 16;
+		acc ^= acc >> 8;
+		checksum ^= (uint8_t)acc;
+	}
+
+	for (; i < length; i++)
+	{
+		if (frameByteNeedsEscape(data[i]))
+			return i;
+		checksum ^= data[i];
+	}
+
+	return length;
+}
+
+/*
+	Resumable decoder for one radio link. Raw bytes are read straight into
+	the decoder's buffer, scanned a word at a time for delimiters and
+	unescaped in place, so each frame is assembled without per-byte calls
+	or copies. Escape and checksum state is kept between calls, so a
+	partially received frame never has to be waited on.
+
+	Layout of the buffer: the payload of the frame being assembled sits at
+	[frameStart, frameStart + length), raw bytes not yet decoded at
+	[readPos, readEnd). Unescaping only ever moves bytes down, so the
+	payload never overtakes the raw bytes.
+*/
+class FrameDecoder
+{
+private:
+	uint8_t *buffer;
+	size_t capacity;
+	size_t frameStart;
+	size_t length;
+	size_t readPos;
+	size_t readEnd;
+	uint8_t checksum;
+	bool inFrame;
+	bool escaped;
+
+	int32_t startFrame()
+	{
+		inFrame = true;
+		escaped = false;
+		frameStart = readPos;
+		length = 0;
+		checksum = BYTE_SEED;
+		return FRAME_STARTED;
+	}
+
+	/*
+		Decode literal runs and escape pairs in place, stopping at START,
+		END, or an ESC whose escaped byte has not arrived yet
+	*/
+	void decodeRun()
+	{
+		size_t r = readPos;
+		size_t w = frameStart + length;
+		uint8_t c = checksum;
+
+		while (r < readEnd)
+		{
+			uint8_t data = buffer[r];
+			if (frameByteNeedsEscape(data))
+			{
+				if (data != BYTE_ESC || r + 1 == readEnd)
+					break;
+
+				// An escaped START is a resync, leave it for the caller
+				uint8_t next = buffer[r + 1];
+				if (next == BYTE_START)
+				{
+					r++;
+					break;
+				}
+
+				next ^= BYTE_XOR;
+				buffer[w++] = next;
+				c ^= next;
+				r += 2;
+				continue;
+			}
+
+			// Lone literals between escapes skip the run scan
+			if (r + 1 == readEnd || frameByteNeedsEscape(buffer[r + 1]))
+			{
+				buffer[w++] = data;
+				c ^= data;
+				r++;
+				continue;
+			}
+
+			size_t n = scanFrameRun(buffer + r, readEnd - r, c);
+			if (w != r)
+				memmove(buffer + w, buffer + r, n);
+			w += n;
+			r += n;
+		}
+
+		readPos = r;
+		length = w - frameStart;
+		checksum = c;
+	}
+
+public:
+	uint32_t badChecksums;
+	uint32_t overflows;
+
+	FrameDecoder(uint8_t *buffer, size_t capacity)
+		: buffer(buffer), capacity(capacity), frameStart(0), length(0), readPos(0),
+		  readEnd(0), checksum(BYTE_SEED), inFrame(false), escaped(false),
+		  badChecksums(0), overflows(0)
+	{
+	}
+
+	const uint8_t *frame() const { return buffer + frameStart; }
+
+	/*
+		Space for raw bytes from the link. Invalidates the last frame
+		returned by decode(). The buffer is compacted once it is three
+		quarters full, and a frame that has filled the whole buffer without
+		ending is dropped to make room.
+	*/
+	uint8_t *writable(size_t &space)
+	{
+		if (capacity - readEnd < capacity / 4 || (!inFrame && readPos == readEnd))
+		{
+			size_t keep = inFrame ? length : 0;
+			if (inFrame && frameStart != 0)
+				memmove(buffer, buffer + frameStart, length);
+
+			memmove(buffer + keep, buffer + readPos, readEnd - readPos);
+			readEnd = keep + readEnd - readPos;
+			readPos = keep;
+			frameStart = 0;
+
+			if (readEnd == capacity)
+			{
+				inFrame = false;
+				overflows++;
+				memmove(buffer, buffer + readPos, readEnd - readPos);
+				readEnd -= readPos;
+				readPos = 0;
+			}
+		}
+
+		space = capacity - readEnd;
+		return buffer + readEnd;
+	}
+
+	void commit(size_t n)
+	{
+		readEnd += n;
+	}
+
+	/*
+		Decode buffered raw bytes. Returns the payload length once END
+		completes a frame with a valid checksum, FRAME_STARTED after a
+		START byte, or FRAME_INCOMPLETE once the raw bytes run out. The
+		payload stays valid in frame() until the next call to writable().
+	*/
+	int32_t decode()
+	{
+		while (readPos < readEnd)
+		{
+			if (!inFrame)
+			{
+				const uint8_t *start = (const uint8_t *)memchr(buffer + readPos, BYTE_START, readEnd - readPos);
+				if (!start)
+				{
+					readPos = readEnd;
+					return FRAME_INCOMPLETE;
+				}
+
+				readPos = start - buffer + 1;
+				return startFrame();
+			}
+
+			uint8_t data = buffer[readPos];
+
+			if (escaped)
+			{
+				// START can never appear inside a frame, so it always resyncs
+				readPos++;
+				if (data == BYTE_START)
+					return startFrame();
+
+				data ^= BYTE_XOR;
+				buffer[frameStart + length++] = data;
+				checksum ^= data;
+				escaped = false;
+				continue;
+			}
+
+			decodeRun();
+			if (readPos == readEnd)
+				break;
+
+			data = buffer[readPos++];
+			if (data == BYTE_START)
+				return startFrame();
+
+			if (data == BYTE_ESC)
+			{
+				escaped = true;
+				continue;
+			}
+
+			// BYTE_END
+			inFrame = false;
+
+			// The checksum byte is at the end of the frame stream
+			// so if the checksum was computed from the preceding
+			// correctly, it will XOR with itself and become zero
+			if (length == 0 || checksum != 0)
+			{
+				badChecksums++;
+				continue;
+			}
+
+			// Pop the checksum byte off the top
+			return length - 1;
+		}
+
+		return FRAME_INCOMPLETE;
+	}
+
+	/*
+		Decode from a stream: buffered bytes first, then whatever the stream
+		has available right now, without waiting for more. Same return
+		values as decode().
+	*/
+	template <typename S>
+	int32_t consume(S &stream)
+	{
+		while (true)
+		{
+			int32_t result = decode();
+			if (result != FRAME_INCOMPLETE)
+				return result;
+
+			int available = stream.available();
+			if (available <= 0)
+				return FRAME_INCOMPLETE;
+
+			size_t space;
+			uint8_t *dst = writable(space);
+			if ((size_t)available > space)
+				available = space;
+
+			commit(stream.readBytes(dst, available));
+		}
+	}
+};
+
+#endif // __FRAMING_H_
@@ -0,0 +1,297 @@
+#ifndef __LOGFILES_H_
+#define __LOGFILES_H_
+
+#include <SD.h>
+
+#include "logformat.h"
+#include "logwriter.h"
+
+// Holds the index the next log file will get, so boot does not have to
+// probe every NNNN.bin on the card
+#define LOG_INDEX_FILENAME "nextlog.txt"
+
+#define LOG_FILENAME_SIZE (13)
+
+// How long to wait before retrying a failed file creation
+#define LOG_CREATE_RETRY_MILLIS (1000)
+
+// How close to rotating the next file is prepared even while the card is
+// busy, so steady traffic cannot hold the rotation off
+#define LOG_PREPARE_AHEAD_SIZE (256ull * 1024)
+#define LOG_PREPARE_AHEAD_MILLIS (10000)
+
+/*
+	Rotating capture logs, each with its own file header. The active file
+	and the next one live in two slots: while the active file is written,
+	the other slot is prepared one step per idle loop() pass, first
+	closing out the previous file and then creating, preallocating and
+	heading the next, so rotating is only a final write of the buffered
+	tail and a switch of slots. Once a rotation is near, preparation
+	goes ahead on every pass (see preparing()), busy card or not.
+
+	Files are never closed by a running capture except on rotation, so
+	begin() trims whatever the previous session left open back to its
+	synced size, and drops a next file that was prepared but never used.
+*/
+class LogFiles
+{
+private:
+	LogWriter &writer;
+	const log_file_header_t &header;
+	uint64_t preallocateSize;
+	uint64_t rotateSize;
+	uint32_t rotateMillis;
+
+	FsFile files[2];
+	// Whether each slot's file got its whole extent up front
+	bool preallocated[2];
+	uint8_t active;
+	uint16_t activeIndex;
+	bool nextReady;
+	bool retiring;
+	uint32_t openedMillis;
+	uint32_t lastCreateMillis;
+	bool createFailed;
+	char activeName[LOG_FILENAME_SIZE];
+
+	static void formatName(char *name, uint16_t index)
+	{
+		sprintf(name, "%04u.bin", index);
+	}
+
+	bool create(uint8_t slot, uint16_t index)
+	{
+		char name[LOG_FILENAME_SIZE];
+		formatName(name, index);
+
+		FsFile &file = files[slot];
+		file = SD.sdfs.open(name, O_RDWR | O_CREAT | O_TRUNC);
+		if (!file)
+			return false;
+
+		// A full or fragmented card leaves the file to grow cluster by
+		// cluster, which is worth knowing about
+		preallocated[slot] = !preallocateSize || file.preAllocate(preallocateSize);
+		if (!preallocated[slot])
+			preallocationFailures++;
+
+		log_file_header_t fileHeader = header;
+		fileHeader.blockSize = writer.getBlockSize();
+		fileHeader.addressResetBlocks = writer.getAddressResetBlocks();
+		fileHeader.fileIndex = index;
+
+		uint8_t sector[LOG_FILE_HEADER_SIZE];
+		buildFileHeaderSector(sector, fileHeader);
+		file.write(sector, sizeof(sector));
+		return true;
+	}
+
+	static uint16_t readIndex()
+	{
+		FsFile file = SD.sdfs.open(LOG_INDEX_FILENAME, O_RDONLY);
+		if (!file)
+			return 0;
+
+		char text[8] = {0};
+		file.read(text, sizeof(text) - 1);
+		file.close();
+		return atoi(text);
+	}
+
+	static void writeIndex(uint16_t index)
+	{
+		FsFile file = SD.sdfs.open(LOG_INDEX_FILENAME, O_RDWR | O_CREAT | O_TRUNC);
+		if (!file)
+			return;
+
+		file.print(index);
+		file.close();
+	}
+
+	/*
+		Trim a file left open by a previous session back to its synced
+		size. Returns true if it held no blocks and was removed.
+	*/
+	static bool recover(uint16_t index)
+	{
+		char name[LOG_FILENAME_SIZE];
+		formatName(name, index);
+
+		FsFile file = SD.sdfs.open(name, O_RDWR);
+		if (!file)
+			return false;
+
+		uint64_t size = file.size();
+		file.truncate(size);
+		file.close();
+
+		if (size > LOG_FILE_HEADER_SIZE)
+			return false;
+
+		SD.remove(name);
+		return true;
+	}
+
+public:
+	uint32_t rotations;
+	uint32_t preallocationFailures;
+
+	/*
+		Every file starts with a copy of header, with its index and the
+		writer's settings filled in. rotateSize and rotateMillis of 0 disable that
+		trigger.
+	*/
+	LogFiles(LogWriter &writer, const log_file_header_t &header, uint64_t preallocateSize, uint64_t rotateSize, uint32_t rotateMillis)
+		: writer(writer), header(header), preallocateSize(preallocateSize), rotateSize(rotateSize), rotateMillis(rotateMillis),
+		  active(0), activeIndex(0), nextReady(false), retiring(false), openedMillis(0), lastCreateMillis(0), createFailed(false),
+		  rotations(0), preallocationFailures(0)
+	{
+		preallocated[0] = preallocated[1] = false;
+		activeName[0] = 0;
+	}
+
+	/*
+		Find the next index, recover the previous session's files and
+		start writing the first file of this one
+	*/
+	bool begin()
+	{
+		uint16_t index = readIndex();
+		if (index == 0)
+			index = 1;
+
+		// The saved index lags if power went just after creating a file
+		char name[LOG_FILENAME_SIZE];
+		formatName(name, index);
+		while (SD.exists(name))
+			formatName(name, ++index);
+
+		for (uint8_t i = 0; i < 2 && index > 1 && recover(index - 1); i++)
+			index--;
+
+		active = 0;
+		if (!create(active, index))
+			return false;
+
+		activeIndex = index;
+		formatName(activeName, activeIndex);
+		writeIndex(activeIndex + 1);
+
+		nextReady = false;
+		retiring = false;
+		openedMillis = millis();
+		writer.begin(files[active]);
+		return true;
+	}
+
+	const char *name() const { return activeName; }
+
+	/*
+		Whether the active file has its extent reserved, or was meant to
+		grow as it goes
+	*/
+	bool extentReserved() const { return preallocated[active]; }
+
+	/*
+		Whether the next file is still to be prepared with a rotation near,
+		so background() should run whether or not the card is idle
+	*/
+	bool preparing(uint32_t now) const
+	{
+		if (nextReady)
+			return false;
+
+		return (rotateSize && writer.size() + LOG_PREPARE_AHEAD_SIZE >= rotateSize) ||
+			   (rotateMillis && now - openedMillis + LOG_PREPARE_AHEAD_MILLIS >= rotateMillis);
+	}
+
+	bool rotationDue(uint32_t now) const
+	{
+		if (!nextReady)
+			return false;
+
+		return (rotateSize && writer.size() >= rotateSize) ||
+			   (rotateMillis && now - openedMillis >= rotateMillis);
+	}
+
+	/*
+		Switch to the prepared next file. Only valid when rotationDue().
+	*/
+	void rotate(uint32_t now)
+	{
+		writer.finish();
+
+		active = !active;
+		activeIndex++;
+		formatName(activeName, activeIndex);
+		writer.begin(files[active]);
+
+		nextReady = false;
+		retiring = true;
+		openedMillis = now;
+		rotations++;
+	}
+
+	/*
+		Write out everything buffered and close the active file, dropping a
+		next file prepared but not used. Nothing more may be logged until
+		begin() is called again.
+	*/
+	void finish()
+	{
+		writer.finish();
+
+		FsFile &file = files[active];
+		file.truncate(file.size());
+		file.close();
+
+		FsFile &spare = files[!active];
+		if (retiring)
+		{
+			spare.truncate(spare.size());
+			spare.close();
+		}
+		else if (nextReady)
+		{
+			spare.close();
+			char name[LOG_FILENAME_SIZE];
+			formatName(name, activeIndex + 1);
+			SD.remove(name);
+			writeIndex(activeIndex + 1);
+		}
+
+		nextReady = false;
+		retiring = false;
+	}
+
+	/*
+		One step of preparing the spare slot. Call when the card is
+		otherwise idle; returns whether it did anything.
+	*/
+	bool background(uint32_t now)
+	{
+		FsFile &spare = files[!active];
+
+		if (retiring)
+		{
+			spare.truncate(spare.size());
+			spare.close();
+			retiring = false;
+			return true;
+		}
+
+		if (nextReady || (createFailed && now - lastCreateMillis < LOG_CREATE_RETRY_MILLIS))
+			return false;
+
+		lastCreateMillis = now;
+		createFailed = !create(!active, activeIndex + 1);
+		if (createFailed)
+			return true;
+
+		writeIndex(activeIndex + 2);
+		nextReady = true;
+		return true;
+	}
+};
+
+#endif // __LOGFILES_H_
@@ -0,0 +1,344 @@
+#ifndef __LOGFORMAT_H_
+#define __LOGFORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.h"
+
+/*
+	Capture log format, shared by the firmware and the host tools.
+
+	Version 0 and 1 records are:
+		type, 4-byte millis, 2-byte micros fraction, then
+			SYSTEM_TIMESTAMP: nothing
+			NMEA_SENTENCE: 1-byte length, sentence
+			RADIO_PACKET_*: 4-byte frame length, frame
+	all little-endian.
+
+	Version 2 records keep the type and what follows the time, but only
+	SYSTEM_TIMESTAMP records carry the absolute millis and micros
+	fraction. Every other record stores the signed difference in
+	microseconds from the record before it in the block, zigzag varint
+	encoded, which is a single byte for anything within 64 us and two
+	within 8 ms. The block header holds the absolute time of the first
+	record, so a block still decodes on its own.
+
+	Version 0 files (no header) are nothing but records back to back.
+
+	Version 1 and later files start with a LOG_FILE_HEADER_SIZE header
+	sector, followed by blocks. Each block starts with a block header and
+	holds whole records only. A reader can check every block on its own,
+	skip a damaged one, find the next by its sync word, or hand blocks to
+	separate threads.
+
+	In versions 1 and 2 every block is zero padded to the block size. In
+	versions 3, 4 and 5 a block takes only the whole sectors its header
+	and payload need, and its records may be stored LZ4 compressed (see
+	blockcompress.h), with rawLength giving their size once decompressed.
+	Version 3 records are the same as version 2; versions 4 and 5 keep
+	them and add the records below.
+
+	Version 4 adds an address dictionary. Most advertising frames carry
+	the advertiser's address at LOG_ADDRESS_OFFSET, and the same few
+	hundred addresses repeat all the time, so the writer keeps recently
+	seen ones in numbered slots. A radio packet record with a flag set in
+	its type is
+		LOG_TYPE_ADDRESS_DEFINE: 4-byte frame length, slot, frame
+			and gives the slot the frame's address
+		LOG_TYPE_ADDRESS_REF: 4-byte frame length, slot, frame without
+			its address, which is the slot's
+	The slots persist from block to block, but are all cleared at the
+	start of every block whose sequence is a multiple of
+	addressResetBlocks in the file header, so decoding can start there.
+	A reader that misses a block must forget every slot until the next
+	such block.
+
+	Version 5 adds repeat records. With repeat suppression on, a frame
+	logged whole and then heard again byte for byte, on any advertising
+	channel, is counted instead of logged, and the counts summed up in a
+		RADIO_REPEAT: 1-byte length, repeat summary (see encodeRepeat())
+	once their window closes. The record has the time of the last repeat
+	it counts, and comes after it by up to a window, so its difference
+	from the record before it may be negative. The summary names its
+	frame by address, PDU header and length and a hash of the whole PDU,
+	so the payloads an advertiser rotates between are told apart.
+*/
+
+enum
+{
+	OUTPUT_TYPE_SYSTEM_TIMESTAMP = 0x00,
+	OUTPUT_TYPE_NMEA_SENTENCE = 0x01,
+	OUTPUT_TYPE_RADIO_PACKET_37 = 0x02,
+	OUTPUT_TYPE_RADIO_PACKET_38 = 0x03,
+	OUTPUT_TYPE_RADIO_PACKET_39 = 0x04,
+	OUTPUT_TYPE_RADIO_REPEAT = 0x05,
+};
+
+// Radio packet record type flags for address slots
+#define LOG_TYPE_ADDRESS_REF (0x10)
+#define LOG_TYPE_ADDRESS_DEFINE (0x20)
+
+// Where a radio frame's address is: after the packet header, the radio
+// header and the 2-byte PDU header, whose length byte is just before it
+#define LOG_ADDRESS_OFFSET (17)
+#define LOG_ADDRESS_SIZE (6)
+
+// Longest encoding of a 64-bit varint
+#define LOG_VARINT_SIZE_MAX (10)
+
+#define LOG_FILE_MAGIC "SWGELOG"
+#define LOG_FORMAT_VERSION (5)
+#define LOG_FILE_HEADER_SIZE (512)
+#define LOG_SECTOR_SIZE (512)
+#define LOG_RADIO_COUNT_MAX (4)
+
+// "SBLK" in file byte order
+#define LOG_BLOCK_SYNC (0x4B4C4253)
+
+// Repeat summaries cover advertising channels 37 to 39. Stored as the
+// address, PDU header, PDU length, 4-byte frame hash, 2-byte span,
+// channel mask, then count, minimum, maximum and mean RSSI for each
+// channel in the mask
+#define LOG_REPEAT_CHANNELS (3)
+#define LOG_REPEAT_HEADER_SIZE (15)
+#define LOG_REPEAT_SIZE_MAX (LOG_REPEAT_HEADER_SIZE + 4 * LOG_REPEAT_CHANNELS)
+
+// Repeat windows are at most LOG_REPEAT_WINDOW_MAX_MILLIS, so a repeat
+// record comes no more than LOG_REPEAT_LATENESS_MAX_MILLIS after the time
+// it carries, allowing for the writer to get round to it
+#define LOG_REPEAT_WINDOW_MAX_MILLIS (10000)
+#define LOG_REPEAT_LATENESS_MAX_MILLIS (LOG_REPEAT_WINDOW_MAX_MILLIS + 1000)
+
+typedef struct
+{
+	uint8_t outputType;
+	uint8_t channel;
+	uint32_t accessAddress;
+	uint32_t baudRate;
+} __packed log_radio_info_t;
+
+/*
+	Start of the header sector. The rest of the sector is zero except for
+	the CRC-32 of everything before it in the last 4 bytes.
+*/
+typedef struct
+{
+	char magic[8];
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t blockSize;
+	uint32_t deviceId[2];
+	uint32_t fileIndex;
+	char firmware[32];
+	uint8_t radioCount;
+	log_radio_info_t radios[LOG_RADIO_COUNT_MAX];
+	// Version 4
+	uint16_t addressResetBlocks;
+} __packed log_file_header_t;
+
+/*
+	The CRC covers the block header, with crc itself zero, and the
+	payloadLength bytes stored after it. rawLength is 0 when the records
+	are stored as they are.
+*/
+typedef struct
+{
+	uint32_t sync;
+	uint32_t sequence;
+	uint16_t recordCount;
+	uint16_t payloadLength;
+	uint32_t firstMillis;
+	uint16_t firstMicrosFraction;
+	uint16_t rawLength;
+	uint32_t crc;
+} __packed log_block_header_t;
+
+typedef struct
+{
+	// 0 if the frame was not heard again on this channel
+	uint8_t count;
+	int8_t rssiMin;
+	int8_t rssiMax;
+	int8_t rssiMean;
+} log_repeat_channel_t;
+
+/*
+	A repeat summary: how often the frame with this address, first PDU
+	header byte, PDU length and low 32 bits of repeatFrameHash() was heard
+	again on each channel, and how strongly, over spanMillis up to the
+	time of its record
+*/
+typedef struct
+{
+	uint8_t address[LOG_ADDRESS_SIZE];
+	uint8_t pduHeader;
+	uint8_t pduLength;
+	uint32_t frameHash;
+	uint16_t spanMillis;
+	log_repeat_channel_t channels[LOG_REPEAT_CHANNELS];
+} log_repeat_t;
+
+/*
+	Record time as a single count of microseconds
+*/
+inline uint64_t logTime(uint32_t millis, uint16_t microsFraction)
+{
+	return (uint64_t)millis * 1000 + microsFraction;
+}
+
+/*
+	FNV-1a hash of a PDU's header, length and payload, as repeats are
+	matched on; never 0
+*/
+inline uint64_t repeatFrameHash(const uint8_t *pdu, size_t length)
+{
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++)
+		h = (h ^ pdu[i]) * 1099511628211ull;
+	return h ? h : 1;
+}
+
+/*
+	Write value as a zigzag varint, returning its size
+*/
+inline size_t encodeDelta(uint8_t *out, int64_t value)
+{
+	uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	size_t size = 0;
+	while (v >= 0x80)
+	{
+		out[size++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	out[size++] = (uint8_t)v;
+	return size;
+}
+
+/*
+	Read a zigzag varint, returning its size or 0 if it runs past end
+*/
+inline size_t decodeDelta(const uint8_t *p, const uint8_t *end, int64_t &value)
+{
+	uint64_t v = 0;
+	for (size_t i = 0; i < LOG_VARINT_SIZE_MAX && p + i < end; i++)
+	{
+		v |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+		if (!(p[i] & 0x80))
+		{
+			value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/*
+	Store a repeat summary, leaving out the channels it has no count for,
+	returning its size
+*/
+inline size_t encodeRepeat(uint8_t *out, const log_repeat_t &repeat)
+{
+	memcpy(out, repeat.address, LOG_ADDRESS_SIZE);
+	out[6] = repeat.pduHeader;
+	out[7] = repeat.pduLength;
+	memcpy(out + 8, &repeat.frameHash, 4);
+	memcpy(out + 12, &repeat.spanMillis, 2);
+	out[14] = 0;
+
+	size_t size = LOG_REPEAT_HEADER_SIZE;
+	for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+	{
+		if (!repeat.channels[i].count)
+			continue;
+		out[14] |= 1 << i;
+		memcpy(out + size, &repeat.channels[i], sizeof(log_repeat_channel_t));
+		size += sizeof(log_repeat_channel_t);
+	}
+	return size;
+}
+
+/*
+	Read a stored repeat summary of length bytes, returning whether it is
+	one: at least one channel, and nothing left over
+*/
+inline bool decodeRepeat(const uint8_t *p, size_t length, log_repeat_t &repeat)
+{
+	if (length < LOG_REPEAT_HEADER_SIZE || !p[14] || p[14] >> LOG_REPEAT_CHANNELS)
+		return false;
+
+	memcpy(repeat.address, p, LOG_ADDRESS_SIZE);
+	repeat.pduHeader = p[6];
+	repeat.pduLength = p[7];
+	memcpy(&repeat.frameHash, p + 8, 4);
+	memcpy(&repeat.spanMillis, p + 12, 2);
+
+	size_t size = LOG_REPEAT_HEADER_SIZE;
+	for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+	{
+		log_repeat_channel_t &channel = repeat.channels[i];
+		if (!(p[14] & 1 << i))
+		{
+			memset(&channel, 0, sizeof(channel));
+			continue;
+		}
+		if (size + sizeof(channel) > length)
+			return false;
+		memcpy(&channel, p + size, sizeof(channel));
+		if (!channel.count)
+			return false;
+		size += sizeof(channel);
+	}
+	return size == length;
+}
+
+/*
+	The address a radio frame starts its PDU payload with, or nullptr if
+	it has none
+*/
+inline const uint8_t *frameAddress(const uint8_t *frame, size_t length)
+{
+	// A data packet (tag 0) whose PDU length covers an address
+	if (length < LOG_ADDRESS_OFFSET + LOG_ADDRESS_SIZE || frame[0] != 0 || frame[LOG_ADDRESS_OFFSET - 1] < LOG_ADDRESS_SIZE)
+		return nullptr;
+
+	return frame + LOG_ADDRESS_OFFSET;
+}
+
+inline void buildFileHeaderSector(uint8_t *sector, const log_file_header_t &header)
+{
+	memset(sector, 0, LOG_FILE_HEADER_SIZE);
+	memcpy(sector, &header, sizeof(header));
+
+	uint32_t crc = crc32(sector, LOG_FILE_HEADER_SIZE - 4);
+	memcpy(sector + LOG_FILE_HEADER_SIZE - 4, &crc, 4);
+}
+
+inline bool checkFileHeaderSector(const uint8_t *sector)
+{
+	uint32_t crc;
+	memcpy(&crc, sector + LOG_FILE_HEADER_SIZE - 4, 4);
+	return !memcmp(sector, LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC)) && crc == crc32(sector, LOG_FILE_HEADER_SIZE - 4);
+}
+
+/*
+	Bytes a version 3 block takes in the file
+*/
+inline size_t blockStride(const log_block_header_t &header)
+{
+	size_t size = sizeof(header) + header.payloadLength;
+	return (size + LOG_SECTOR_SIZE - 1) / LOG_SECTOR_SIZE * LOG_SECTOR_SIZE;
+}
+
+inline uint32_t blockCrc(const uint8_t *block)
+{
+	log_block_header_t header;
+	memcpy(&header, block, sizeof(header));
+	header.crc = 0;
+
+	uint32_t crc = crc32(&header, sizeof(header));
+	return crc32(block + sizeof(header), header.payloadLength, crc);
+}
+
+#endif // __LOGFORMAT_H_
@@ -0,0 +1,368 @@
+#ifndef __LOGWRITER_H_
+#define __LOGWRITER_H_
+
+#include <SD.h>
+
+#include "addresstable.h"
+#include "blockcompress.h"
+#include "logformat.h"
+
+/*
+	Buffered log file writer producing the blocks of a version 5 log.
+	Records are assembled in RAM blocks, each sealed with its block header
+	once the next record no longer fits, so SdFat only ever sees whole,
+	sector-aligned multi-sector writes. The blocks are used as a ring:
+	while sealed blocks wait for service() the next one keeps filling, and
+	only when every block is sealed does a record have to stall on the
+	card.
+
+	With compression enabled, records are assembled in a separate staging
+	block instead and LZ4 compressed into the ring block when it is
+	sealed, falling back to storing them as they are if that is no
+	smaller. The staging block holds no more than is sure to fit once
+	compressed.
+
+	With an address table, writePacket() replaces the address in radio
+	frames with a slot number, once the frame that first brought the
+	address has given it its slot.
+
+	sync() is the bounded replacement for File::flush(): it seals the
+	block being filled early, writes it and updates the directory entry.
+	Every block is written exactly once.
+*/
+class LogWriter
+{
+private:
+	FsFile *file;
+	uint8_t *storage;
+	size_t blockSize;
+	size_t blockCount;
+
+	uint8_t *staging;
+	uint16_t *hashTable;
+	size_t recordCapacity;
+
+	AddressTable *addresses;
+	uint16_t addressResetBlocks;
+
+	size_t fillIndex;
+	size_t fillLength;
+	size_t writeIndex;
+	size_t sealedCount;
+	uint32_t sequence;
+	uint64_t lastTime;
+	uint64_t fileBytes;
+
+	uint8_t *block(size_t index) { return storage + index * blockSize; }
+
+	log_block_header_t *fillHeader() { return (log_block_header_t *)block(fillIndex); }
+
+	uint8_t *records() { return staging ? staging : block(fillIndex) + sizeof(log_block_header_t); }
+
+	void writeBlock()
+	{
+		uint32_t start = micros();
+
+		size_t size = blockStride(*(log_block_header_t *)block(writeIndex));
+		file->write(block(writeIndex), size);
+		bytesWritten += size;
+		blockWrites++;
+
+		writeIndex = (writeIndex + 1) % blockCount;
+		sealedCount--;
+
+		uint32_t elapsed = micros() - start;
+		if (elapsed > maxWriteMicros)
+			maxWriteMicros = elapsed;
+	}
+
+	/*
+		Absolute for a timestamp record, otherwise the difference from the
+		previous record in the block
+	*/
+	size_t encodeStamp(uint8_t *stamp, uint8_t type, uint32_t millis, uint16_t microsFraction, uint64_t time)
+	{
+		if (type == OUTPUT_TYPE_SYSTEM_TIMESTAMP)
+		{
+			memcpy(stamp, &millis, 4);
+			memcpy(stamp + 4, &microsFraction, 2);
+			return 6;
+		}
+
+		uint64_t previous = fillHeader()->recordCount ? lastTime : time;
+		return encodeDelta(stamp, (int64_t)(time - previous));
+	}
+
+	void startBlock()
+	{
+		memset(block(fillIndex), 0, sizeof(log_block_header_t));
+		fillLength = 0;
+
+		if (addresses && sequence % addressResetBlocks == 0)
+			addresses->reset();
+	}
+
+	/*
+		Seal now unless length more bytes of records fit in this block
+	*/
+	void reserve(size_t length)
+	{
+		if (fillLength + length > recordCapacity)
+			seal();
+	}
+
+	/*
+		Finish the block being filled and start the next one, writing out
+		the oldest sealed block first if every block is taken
+	*/
+	void seal()
+	{
+		log_block_header_t *header = fillHeader();
+		uint8_t *payload = block(fillIndex) + sizeof(log_block_header_t);
+
+		header->sync = LOG_BLOCK_SYNC;
+		header->sequence = sequence++;
+		header->payloadLength = fillLength;
+
+		if (staging)
+		{
+			size_t compressed = blockCompress(staging, fillLength, payload, hashTable);
+			if (compressed < fillLength)
+			{
+				header->payloadLength = compressed;
+				header->rawLength = fillLength;
+			}
+			else
+				memcpy(payload, staging, fillLength);
+		}
+
+		size_t stride = blockStride(*header);
+		memset(payload + header->payloadLength, 0, stride - sizeof(log_block_header_t) - header->payloadLength);
+		header->crc = blockCrc(block(fillIndex));
+
+		recordBytes += fillLength;
+		storedBytes += header->payloadLength;
+		fileBytes += stride;
+
+		fillIndex = (fillIndex + 1) % blockCount;
+		sealedCount++;
+
+		if (sealedCount == blockCount)
+		{
+			stalls++;
+			writeBlock();
+		}
+
+		startBlock();
+	}
+
+public:
+	uint64_t bytesWritten;
+	uint32_t blockWrites;
+	uint32_t stalls;
+	uint32_t maxWriteMicros;
+	// Records sealed so far, and the bytes they were stored in
+	uint64_t recordBytes;
+	uint64_t storedBytes;
+	uint32_t addressDefinitions;
+
+	/*
+		storage holds blockCount blocks of blockSize bytes, blockSize a
+		multiple of LOG_SECTOR_SIZE of at most 64 KiB
+	*/
+	LogWriter(uint8_t *storage, size_t blockSize, size_t blockCount)
+		: file(nullptr), storage(storage), blockSize(blockSize), blockCount(blockCount),
+		  staging(nullptr), hashTable(nullptr), recordCapacity(blockSize - sizeof(log_block_header_t)),
+		  addresses(nullptr), addressResetBlocks(0),
+		  fillIndex(0), fillLength(0), writeIndex(0), sealedCount(0), sequence(0), lastTime(0), fileBytes(0),
+		  bytesWritten(0), blockWrites(0), stalls(0), maxWriteMicros(0), recordBytes(0), storedBytes(0), addressDefinitions(0)
+	{
+	}
+
+	size_t getBlockSize() const { return blockSize; }
+
+	/*
+		Compress blocks using a staging block of blockSize bytes and a
+		table of BLOCK_COMPRESS_HASH_SIZE entries, or stop compressing
+		with nullptrs. Call before begin().
+	*/
+	void setCompression(uint8_t *staging, uint16_t *hashTable)
+	{
+		this->staging = staging;
+		this->hashTable = hashTable;
+
+		size_t capacity = blockSize - sizeof(log_block_header_t);
+		recordCapacity = staging ? BLOCK_COMPRESS_INPUT_MAX(capacity) : capacity;
+	}
+
+	/*
+		Replace frame addresses with slots of table, which is cleared
+		every resetBlocks blocks, or stop with nullptr. Call before
+		begin().
+	*/
+	void setAddressTable(AddressTable *table, uint16_t resetBlocks)
+	{
+		addresses = table;
+		addressResetBlocks = table ? resetBlocks : 0;
+	}
+
+	uint16_t getAddressResetBlocks() const { return addressResetBlocks; }
+
+	/*
+		Start writing blocks to a file positioned just past its header
+		sector
+	*/
+	void begin(FsFile &file)
+	{
+		this->file = &file;
+		fillIndex = writeIndex = sealedCount = 0;
+		sequence = 0;
+		fileBytes = 0;
+		startBlock();
+	}
+
+	/*
+		Start a record with its type and time, moving on to a new block if
+		it and payloadLength more bytes do not fit in this one. The rest of
+		its bytes follow with write(). Returns the size of the whole record.
+	*/
+	size_t beginRecord(uint8_t type, uint32_t millis, uint16_t microsFraction, size_t payloadLength)
+	{
+		uint64_t time = logTime(millis, microsFraction);
+		uint8_t stamp[LOG_VARINT_SIZE_MAX];
+		size_t stampSize = encodeStamp(stamp, type, millis, microsFraction, time);
+
+		if (fillLength + 1 + stampSize + payloadLength > recordCapacity)
+		{
+			seal();
+			stampSize = encodeStamp(stamp, type, millis, microsFraction, time);
+		}
+
+		log_block_header_t *header = fillHeader();
+		if (header->recordCount++ == 0)
+		{
+			header->firstMillis = millis;
+			header->firstMicrosFraction = microsFraction;
+		}
+		lastTime = time;
+
+		write(type);
+		write(stamp, stampSize);
+		return 1 + stampSize + payloadLength;
+	}
+
+	/*
+		Write a radio packet record, returning its size
+	*/
+	size_t writePacket(uint8_t type, uint32_t millis, uint16_t microsFraction, const uint8_t *frame, uint32_t length)
+	{
+		const uint8_t *address = addresses ? frameAddress(frame, length) : nullptr;
+		if (!address)
+		{
+			size_t size = beginRecord(type, millis, microsFraction, 4 + length);
+			write(&length, 4);
+			write(frame, length);
+			return size;
+		}
+
+		// Any table reset for a new block has to come before the lookup
+		reserve(1 + LOG_VARINT_SIZE_MAX + 4 + 1 + length);
+
+		uint8_t slot;
+		if (!addresses->lookup(address, slot))
+		{
+			size_t size = beginRecord(type | LOG_TYPE_ADDRESS_DEFINE, millis, microsFraction, 4 + 1 + length);
+			write(&length, 4);
+			write(slot);
+			write(frame, length);
+			addressDefinitions++;
+			return size;
+		}
+
+		size_t size = beginRecord(type | LOG_TYPE_ADDRESS_REF, millis, microsFraction, 4 + 1 + length - LOG_ADDRESS_SIZE);
+		write(&length, 4);
+		write(slot);
+		write(frame, LOG_ADDRESS_OFFSET);
+		write(address + LOG_ADDRESS_SIZE, length - LOG_ADDRESS_OFFSET - LOG_ADDRESS_SIZE);
+		return size;
+	}
+
+	/*
+		Write a repeat record, returning its size
+	*/
+	size_t writeRepeat(uint32_t millis, uint16_t microsFraction, const log_repeat_t &repeat)
+	{
+		uint8_t summary[LOG_REPEAT_SIZE_MAX];
+		uint8_t length = encodeRepeat(summary, repeat);
+
+		size_t size = beginRecord(OUTPUT_TYPE_RADIO_REPEAT, millis, microsFraction, 1 + length);
+		write(length);
+		write(summary, length);
+		return size;
+	}
+
+	size_t write(uint8_t b)
+	{
+		records()[fillLength++] = b;
+		return 1;
+	}
+
+	size_t write(const void *data, size_t length)
+	{
+		memcpy(records() + fillLength, data, length);
+		fillLength += length;
+		return length;
+	}
+
+	/*
+		Write at most one sealed block. Call once per loop() pass; returns
+		whether anything was written.
+	*/
+	bool service()
+	{
+		if (!file || sealedCount == 0)
+			return false;
+
+		writeBlock();
+		return true;
+	}
+
+	/*
+		Seal the block being filled, if it holds anything, write every
+		sealed block and update the directory entry
+	*/
+	void sync()
+	{
+		if (!file)
+			return;
+
+		if (fillHeader()->recordCount)
+			seal();
+
+		while (sealedCount)
+			writeBlock();
+
+		file->flush();
+	}
+
+	/*
+		Write out everything before the file is closed. Nothing more may be
+		written to it afterwards.
+	*/
+	void finish()
+	{
+		sync();
+		file = nullptr;
+	}
+
+	/*
+		At least the size the current file will have once everything
+		buffered is written
+	*/
+	uint64_t size() const
+	{
+		return LOG_FILE_HEADER_SIZE + fileBytes + blockSize;
+	}
+};
+
+#endif // __LOGWRITER_H_
@@ -1,15 +1,19 @@
 #include <Adafruit_GPS.h>
 #include <SD.h>
 #include <SPI.h>
+#include "advertisertable.h"
 #include "display.h"
+#include "framepool.h"
+#include "logfiles.h"
+#include "logformat.h"
+#include "logwriter.h"
 #include "packet.h"
+#include "packetfilter.h"
+#include "radio.h"
+#include "repeatcache.h"
 #include "structio.h"
 
-#define BYTE_START (0x7F)
-#define BYTE_ESC (0x7E)
-#define BYTE_END (0x7D)
-#define BYTE_XOR (0x20)
-#define BYTE_SEED (0xAA)
+static_assert(offsetof(packet_t, payload.pdu.adv.payload) == LOG_ADDRESS_OFFSET, "log address offset");
 
 #define LCD_CK (3)
 #define LCD_DI (4)
@@ -23,43 +27,138 @@
 
 #define RADIO_BAUD_RATE (115200)
 
+#define FIRMWARE_VERSION ("TeensySwgeInspector " __DATE__)
+
+// Completed frames held between decoding and writing to the log
+#define FRAME_POOL_SIZE (16)
+
 #define ADVERTISING_RADIO_ACCESS_ADDRESS (0x8E89BED6)
 #define ADVERTISING_CRC_INIT (0x555555)
 
-#define SERIAL_BUFFER_SIZE (65536)
+// The UART buffers only have to cover one ingest period, the rings are
+// what absorbs SD write stalls
+#define SERIAL_BUFFER_SIZE (1024)
 static DMAMEM uint8_t RADIO37_RX_BUFFER[SERIAL_BUFFER_SIZE] = {0};
 static DMAMEM uint8_t RADIO38_RX_BUFFER[SERIAL_BUFFER_SIZE] = {0};
 static DMAMEM uint8_t RADIO39_RX_BUFFER[SERIAL_BUFFER_SIZE] = {0};
 
+// Must be a power of two
+#define RADIO_RING_SIZE (65536)
+static DMAMEM uint8_t RADIO37_RING_BUFFER[RADIO_RING_SIZE] = {0};
+static DMAMEM uint8_t RADIO38_RING_BUFFER[RADIO_RING_SIZE] = {0};
+static DMAMEM uint8_t RADIO39_RING_BUFFER[RADIO_RING_SIZE] = {0};
+
+// At 115200 baud a radio delivers about 6 bytes per period
+#define RADIO_INGEST_PERIOD_US (500)
+IntervalTimer radioIngestTimer;
+
 #define GPS_BUFFER_SIZE (16384)
 static DMAMEM uint8_t GPS_RX_BUFFER[GPS_BUFFER_SIZE] = {0};
 Adafruit_GPS GPS(&U_GPS);
 
 Display display(LCD_CK, LCD_DI, LCD_CS);
 
+static DMAMEM uint8_t RADIO37_FRAME_BUFFER[FRAME_BUFFER_SIZE] = {0};
+static DMAMEM uint8_t RADIO38_FRAME_BUFFER[FRAME_BUFFER_SIZE] = {0};
+static DMAMEM uint8_t RADIO39_FRAME_BUFFER[FRAME_BUFFER_SIZE] = {0};
+
+static DMAMEM frame_slot_t FRAME_POOL_SLOTS[FRAME_POOL_SIZE];
+FramePool framePool(FRAME_POOL_SLOTS, FRAME_POOL_SIZE);
+
 Sd2Card card;
 SdVolume volume;
 SdFile root;
 
-File dumpFile;
+// Start a new log file once the current one reaches this size or age,
+// 0 disables either trigger
+#ifndef LOG_ROTATE_SIZE
+#define LOG_ROTATE_SIZE (256ull * 1024 * 1024)
+#endif
+#ifndef LOG_ROTATE_MILLIS
+#define LOG_ROTATE_MILLIS (60ul * 60 * 1000)
+#endif
+
+// Contiguous extent reserved for each log up front, so no clusters are
+// allocated mid-capture. About 7 hours of three busy radios; 0 lets the
+// file grow cluster by cluster instead
+#ifndef LOG_PREALLOCATE_SIZE
+#define LOG_PREALLOCATE_SIZE (1024ull * 1024 * 1024)
+#endif
+
+// A log rotated by size never gets past the rotation size and the last
+// loop() pass before it, so reserve no more than that
+#define LOG_ROTATE_HEADROOM (1024ull * 1024)
+#define LOG_EXTENT_SIZE (LOG_ROTATE_SIZE != 0 && LOG_ROTATE_SIZE + LOG_ROTATE_HEADROOM < LOG_PREALLOCATE_SIZE ? \
+	LOG_ROTATE_SIZE + LOG_ROTATE_HEADROOM : LOG_PREALLOCATE_SIZE)
+
+// Log blocks, written to the card one at a time as each fills up
+#define LOG_BLOCK_SIZE (8192)
+#define LOG_BLOCK_COUNT (4)
+static DMAMEM uint8_t LOG_BLOCKS[LOG_BLOCK_SIZE * LOG_BLOCK_COUNT] __attribute__((aligned(32)));
+LogWriter logWriter(LOG_BLOCKS, LOG_BLOCK_SIZE, LOG_BLOCK_COUNT);
+
+// LZ4 compress each log block as it is sealed, 0 stores records as they
+// are. Kept in DTCM, as compression reads them byte by byte
+#ifndef LOG_COMPRESS
+#define LOG_COMPRESS (1)
+#endif
+#if LOG_COMPRESS
+static uint8_t LOG_COMPRESS_STAGING[LOG_BLOCK_SIZE];
+static uint16_t LOG_COMPRESS_HASH_TABLE[BLOCK_COMPRESS_HASH_SIZE];
+#endif
+
+// Log repeated advertiser addresses as slots of a table, cleared every
+// LOG_ADDRESS_RESET_BLOCKS blocks so a damaged block loses only a few
+// more; 0 logs every frame whole. Compression already finds the repeats,
+// and does slightly worse without them, so only used without it
+#ifndef LOG_ADDRESS_TABLE
+#define LOG_ADDRESS_TABLE (!LOG_COMPRESS)
+#endif
+#define LOG_ADDRESS_RESET_BLOCKS (16)
+#if LOG_ADDRESS_TABLE
+AddressTable addressTable;
+#endif
+
+// Advertisers heard recently, must be a power of two
+#define ADVERTISER_TABLE_SIZE (4096)
+static DMAMEM advertiser_t ADVERTISER_ENTRIES[ADVERTISER_TABLE_SIZE];
+AdvertiserTable advertiserTable(ADVERTISER_ENTRIES, ADVERTISER_TABLE_SIZE);
+
+// Which advertising packets are logged, compiled from FILTER_FILENAME at
+// boot; without it every packet is
+#define FILTER_TEXT_SIZE (8192)
+PacketFilter packetFilter;
+
+// Log an advertisement heard again within LOG_REPEAT_WINDOW_MILLIS as a
+// count in a repeat record rather than whole, and whole again at least
+// every LOG_REPEAT_REFRESH_MILLIS; 0 logs every frame. Off unless asked
+// for, as the repeats' radio timestamps are lost
+#ifndef LOG_REPEAT_WINDOW_MILLIS
+#define LOG_REPEAT_WINDOW_MILLIS (0)
+#endif
+#define LOG_REPEAT_REFRESH_MILLIS (10000)
+uint32_t repeatWindowMillis = LOG_REPEAT_WINDOW_MILLIS;
+
+// Frames remembered for repeat suppression, must be a power of two
+#define REPEAT_CACHE_SIZE (1024)
+static repeat_entry_t REPEAT_CACHE_ENTRIES[REPEAT_CACHE_SIZE];
+RepeatCache repeatCache(REPEAT_CACHE_ENTRIES, REPEAT_CACHE_SIZE);
+
+log_file_header_t logHeader;
+LogFiles logFiles(logWriter, logHeader, LOG_EXTENT_SIZE, LOG_ROTATE_SIZE, LOG_ROTATE_MILLIS);
 
 uint64_t packetCount = 0;
-static DMAMEM uint8_t packet_buffer[65536] = {0};
 uint64_t rollingPacketCount = 0;
+uint64_t filteredPacketCount = 0;
 
 uint64_t fileSizeCounter = 0;
 uint64_t lastFlush = 0;
 uint64_t lastMillisNoted = 0;
 uint64_t lastDisplayUpdate = 0;
 
-enum
-{
-	OUTPUT_TYPE_SYSTEM_TIMESTAMP = 0x00,
-	OUTPUT_TYPE_NMEA_SENTENCE = 0x01,
-	OUTPUT_TYPE_RADIO_PACKET_37 = 0x02,
-	OUTPUT_TYPE_RADIO_PACKET_38 = 0x03,
-	OUTPUT_TYPE_RADIO_PACKET_39 = 0x04,
-};
+radio_state_t radio37 = {U_RADIO37, OUTPUT_TYPE_RADIO_PACKET_37, SpscRing(RADIO37_RING_BUFFER, RADIO_RING_SIZE), FrameDecoder(RADIO37_FRAME_BUFFER, FRAME_BUFFER_SIZE), 0, 0, false, FRAME_INCOMPLETE};
+radio_state_t radio38 = {U_RADIO38, OUTPUT_TYPE_RADIO_PACKET_38, SpscRing(RADIO38_RING_BUFFER, RADIO_RING_SIZE), FrameDecoder(RADIO38_FRAME_BUFFER, FRAME_BUFFER_SIZE), 0, 0, false, FRAME_INCOMPLETE};
+radio_state_t radio39 = {U_RADIO39, OUTPUT_TYPE_RADIO_PACKET_39, SpscRing(RADIO39_RING_BUFFER, RADIO_RING_SIZE), FrameDecoder(RADIO39_FRAME_BUFFER, FRAME_BUFFER_SIZE), 0, 0, false, FRAME_INCOMPLETE};
 
 void printTagName(Stream &stream, int tag)
 {
@@ -124,62 +223,16 @@ void printTagName(Stream &stream, int tag)
 	stream.print(">");
 }
 
-int timedRead(Stream &stream, uint32_t timeout)
-{
-	int c;
-	unsigned long startMillis = millis();
-	do
-	{
-		c = stream.read();
-		if (c >= 0)
-			return c;
-		yield();
-	} while (millis() - startMillis < timeout);
-	return -1; // -1 indicates timeout
-}
-
-bool consumeFrameBegin(HardwareSerial &radio)
-{
-	return radio.read() == BYTE_START;
-}
-
-int32_t consumeFrame(HardwareSerial &radio)
+int32_t consumeFrame(radio_state_t &radio)
 {
-	uint16_t length = 0;
-	uint8_t checksum = BYTE_SEED;
-
-	while (true)
+	int32_t result;
+	while ((result = radio.decoder.consume(radio.ring)) == FRAME_STARTED)
 	{
-		int32_t data = timedRead(radio, 100);
-		if (data == -1)
-			return -1;
-
-		if (data == BYTE_ESC)
-		{
-			data = timedRead(radio, 100);
-			if (data == -1)
-				return -1;
-			data ^= BYTE_XOR;
-		}
-		else if (data == BYTE_END)
-			break;
-
-		packet_buffer[length] = data;
-		checksum ^= data;
-
-		length++;
+		radio.frameMillis = millis();
+		radio.frameMicrosFraction = micros() % 1000;
 	}
 
-	// Pop the checksum byte off the top
-	length--;
-
-	// The checksum byte is at the end of the frame stream
-	// so if the checksum was computed from the preceding
-	// correctly, it will XOR with itself and become zero
-	if (checksum != 0)
-		return -1;
-
-	return length;
+	return result;
 }
 
 void printVersion(HardwareSerial &radio)
@@ -246,25 +299,190 @@ void startSniffer(HardwareSerial &radio, uint8_t channel)
 	radio.clear();
 }
 
-void processPacket(int32_t frameLength)
+/*
+	Look at a completed frame before it is logged, returning whether it
+	should be
+*/
+bool processPacket(const uint8_t *frame, int32_t frameLength, uint32_t frameMillis)
 {
-	if (frameLength == -1)
+	if (frameLength < 0)
+		return true;
+
+	PacketView packet(frame, frameLength);
+	if (!packet.isAdvertising())
+		return true;
+
+	AdIndex ads(packet);
+	advertiserTable.observe(packet, ads, frameMillis);
+	return packetFilter.keep(packet, ads);
+}
+
+/*
+	Log a summary of repeats instead of the frames themselves
+*/
+void logRepeat(const log_repeat_t &repeat, uint32_t millis, uint16_t microsFraction)
+{
+	fileSizeCounter += logWriter.writeRepeat(millis, microsFraction, repeat);
+}
+
+/*
+	Show the active log file on the status line, flagged if it could not
+	have its extent reserved and so allocates clusters as it grows
+*/
+void showLogFile()
+{
+	if (logFiles.extentReserved())
+	{
+		display.setStatus(logFiles.name());
+		return;
+	}
+
+	U_HOST.print(logFiles.name());
+	U_HOST.println(": preallocation failed, card full or fragmented");
+
+	char status[LOG_FILENAME_SIZE + 5];
+	snprintf(status, sizeof(status), "%s frag", logFiles.name());
+	display.setStatus(status);
+}
+
+/*
+	Write every pending repeat summary and buffered block and close the
+	log, as before power is removed. Capture stops until the next setup().
+*/
+void finishCapture()
+{
+	repeatCache.clear(logRepeat);
+	logFiles.finish();
+}
+
+/*
+	Compile the packet filter from the card, if there is one
+*/
+void loadFilter()
+{
+	FsFile file = SD.sdfs.open(FILTER_FILENAME, O_RDONLY);
+	if (!file)
+		return;
+
+	static char text[FILTER_TEXT_SIZE];
+	int length = file.read(text, sizeof(text));
+	file.close();
+	if (length < 0)
+	{
+		U_HOST.println(FILTER_FILENAME " unreadable, logging everything");
+		return;
+	}
+	if (length > (int)sizeof(text) - 1)
+	{
+		U_HOST.println(FILTER_FILENAME " too long, logging everything");
+		return;
+	}
+
+	text[length] = 0;
+	if (!packetFilter.compile(text))
+	{
+		U_HOST.print(FILTER_FILENAME " line ");
+		U_HOST.print(packetFilter.errorLine());
+		U_HOST.print(": ");
+		U_HOST.print(packetFilter.error());
+		U_HOST.println(", logging everything");
 		return;
+	}
+
+	U_HOST.print("Filter: ");
+	U_HOST.print(packetFilter.rules());
+	U_HOST.println(" rules");
+}
+
+/*
+	Radio ingest interrupt, the only place the radio UARTs are read once
+	capture has started
+*/
+void ingestRadios()
+{
+	radio37.ring.fill(radio37.port);
+	radio38.ring.fill(radio38.port);
+	radio39.ring.fill(radio39.port);
+}
 
-	packet_t *packet = (packet_t *)packet_buffer;
-	if (packet->header.tag == TAG_DATA)
+/*
+	Decode complete frames from one radio into the frame pool, until the
+	radio has nothing more or the pool is full. A frame decoded with no
+	slot free stays in the decoder until a later pass finds one.
+*/
+void captureRadio(radio_state_t &radio)
+{
+	while (true)
 	{
-		// TODO: do something with MAC addresses?
+		if (!radio.frameWaiting)
+		{
+			radio.frameLength = consumeFrame(radio);
+			if (radio.frameLength == FRAME_INCOMPLETE)
+				return;
+		}
 
-		// auto packet = (radio_t *)packet_buffer;
-		// U_HOST.print(", time: ");
-		// U_HOST.print(packet->timestamp);
-		// U_HOST.print(", channel: ");
-		// U_HOST.print(packet->channel);
-		// U_HOST.print(", rssi: ");
-		// U_HOST.print(-packet->rssi_negative);
+		frame_slot_t *slot = framePool.acquire();
+		if (!slot)
+		{
+			// Counted once per frame, however many passes it waits
+			if (!radio.frameWaiting)
+				framePool.stalls++;
+			radio.frameWaiting = true;
+			return;
+		}
 
-		// U_HOST.println();
+		slot->outputType = radio.outputType;
+		slot->millis = radio.frameMillis;
+		slot->microsFraction = radio.frameMicrosFraction;
+		slot->length = radio.frameLength;
+		memcpy(slot->data, radio.decoder.frame(), radio.frameLength);
+		framePool.publish();
+		radio.frameWaiting = false;
+	}
+}
+
+/*
+	Process and log every completed frame in the pool, oldest first
+*/
+void drainFrames()
+{
+	frame_slot_t *slot;
+	while ((slot = framePool.peek()))
+	{
+		if (!processPacket(slot->data, slot->length, slot->millis))
+			filteredPacketCount++;
+		else if (!repeatCache.absorb(PacketView(slot->data, slot->length), slot->millis, slot->microsFraction, logRepeat))
+			fileSizeCounter += logWriter.writePacket(slot->outputType, slot->millis, slot->microsFraction, slot->data, slot->length);
+
+		packetCount++;
+		rollingPacketCount++;
+
+		framePool.release();
+	}
+}
+
+/*
+	Describe this device and its radios at the start of every log file
+*/
+void fillLogHeader()
+{
+	static const radio_state_t *radios[] = {&radio37, &radio38, &radio39};
+
+	memset(&logHeader, 0, sizeof(logHeader));
+	memcpy(logHeader.magic, LOG_FILE_MAGIC, sizeof(logHeader.magic));
+	logHeader.version = LOG_FORMAT_VERSION;
+	logHeader.headerSize = LOG_FILE_HEADER_SIZE;
+	logHeader.deviceId[0] = HW_OCOTP_CFG0;
+	logHeader.deviceId[1] = HW_OCOTP_CFG1;
+	snprintf(logHeader.firmware, sizeof(logHeader.firmware), "%s", FIRMWARE_VERSION);
+
+	logHeader.radioCount = 3;
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		logHeader.radios[i].outputType = radios[i]->outputType;
+		logHeader.radios[i].channel = 37 + i;
+		logHeader.radios[i].accessAddress = ADVERTISING_RADIO_ACCESS_ADDRESS;
+		logHeader.radios[i].baudRate = RADIO_BAUD_RATE;
 	}
 }
 
@@ -299,19 +517,26 @@ void setup()
 		return;
 	}
 
-	// Find next available filename
-	char filename[9];
-	uint16_t fileIdx = 0;
-	do
+	display.setStatus("Load filter");
+	loadFilter();
+	repeatCache.setWindow(repeatWindowMillis, LOG_REPEAT_REFRESH_MILLIS);
+
+#if LOG_COMPRESS
+	logWriter.setCompression(LOG_COMPRESS_STAGING, LOG_COMPRESS_HASH_TABLE);
+#endif
+#if LOG_ADDRESS_TABLE
+	logWriter.setAddressTable(&addressTable, LOG_ADDRESS_RESET_BLOCKS);
+#endif
+	fillLogHeader();
+	if (!logFiles.begin())
 	{
-		fileIdx++;
-		sprintf(filename, "%04d.bin", fileIdx);
-	} while (SD.exists(filename));
+		display.setStatus("No log file");
+		U_HOST.println("Log file creation failed");
+		return;
+	}
 
 	U_HOST.print("Output file: ");
-	U_HOST.println(filename);
-
-	dumpFile = SD.open(filename, FILE_WRITE_BEGIN);
+	U_HOST.println(logFiles.name());
 
 	/*
 		RADIO37
@@ -362,30 +587,47 @@ void setup()
 	startSniffer(U_RADIO39, 39);
 	delay(50);
 
-	display.setStatus(filename);
+	radioIngestTimer.begin(ingestRadios, RADIO_INGEST_PERIOD_US);
+
+	showLogFile();
 
 	digitalWriteFast(LED_BUILTIN, LOW);
 }
 
 /*
 	Loop tasks:
-		Flush the file buffer at regular intervals
-		Tally and print the radio packet statistics
+		Rotate to the next log file when the current one is big or old enough
+		Write a system timestamp every 250 ms
+		Print the packet count and sync the log's whole sectors to the
+		card at regular intervals
+		Show the radio packet statistics on the LCD
+		Decode whatever each radio ring holds into the frame pool
+		Write the completed packets in the pool to output, and the repeat
+		summaries due
+		Hand at most one full log block to the card, and take one step
+		towards preparing the next log file if the card was idle or a
+		rotation is near
 		Read zero or one sentence from the GPS, write to output
-		Read one radio packet from each radio, write to output
 */
 void loop()
 {
 	uint32_t now = millis();
 	uint16_t nowMicrosFraction = micros() % 1000;
 
-	// Write system timestamp
-	if (now - lastMillisNoted > 250)
+	// Rotate between records
+	bool rotated = logFiles.rotationDue(now);
+	if (rotated)
 	{
-		dumpFile.write(OUTPUT_TYPE_SYSTEM_TIMESTAMP);
-		dumpFile.write((uint8_t *)&now, 4);
-		dumpFile.write((uint8_t *)&nowMicrosFraction, 2);
-		fileSizeCounter += 7;
+		// Repeats belong with the frames they repeat
+		repeatCache.clear(logRepeat);
+		logFiles.rotate(now);
+		showLogFile();
+	}
+
+	// Write system timestamp, always first thing in a new file
+	if (rotated || now - lastMillisNoted > 250)
+	{
+		fileSizeCounter += logWriter.beginRecord(OUTPUT_TYPE_SYSTEM_TIMESTAMP, now, nowMicrosFraction, 0);
 		lastMillisNoted = now;
 	}
 
@@ -396,7 +638,7 @@ void loop()
 		U_HOST.println(" packets");
 
 		U_HOST.flush();
-		dumpFile.flush();
+		logWriter.sync();
 
 		lastFlush = now;
 	}
@@ -404,7 +646,7 @@ void loop()
 	// Update LCD
 	if (now - lastDisplayUpdate > 1000)
 	{
-		display.setDetailsCount(packetCount, rollingPacketCount, fileSizeCounter * 8);
+		display.setDetailsCount(packetCount, rollingPacketCount, fileSizeCounter * 8, filteredPacketCount);
 
 		fileSizeCounter = 0;
 		rollingPacketCount = 0;
@@ -412,71 +654,14 @@ void loop()
 		lastDisplayUpdate = now;
 	}
 
-	if (consumeFrameBegin(U_RADIO37))
-	{
-		now = millis();
-		nowMicrosFraction = micros() % 1000;
-		
-		int32_t frameLength = consumeFrame(U_RADIO37);
-		if (frameLength != -1)
-		{
-			processPacket(frameLength);
-
-			dumpFile.write(OUTPUT_TYPE_RADIO_PACKET_37);
-			dumpFile.write((uint8_t *)&now, 4);
-			dumpFile.write((uint8_t *)&nowMicrosFraction, 2);
-			dumpFile.write((uint8_t *)&frameLength, 4);
-			dumpFile.write(packet_buffer, frameLength);
-
-			packetCount++;
-			rollingPacketCount++;
-			fileSizeCounter += frameLength + 11;
-		}
-	}
-
-	if (consumeFrameBegin(U_RADIO38))
-	{
-		now = millis();
-		nowMicrosFraction = micros() % 1000;
-
-		int32_t frameLength = consumeFrame(U_RADIO38);
-		if (frameLength != -1)
-		{
-			processPacket(frameLength);
-
-			dumpFile.write(OUTPUT_TYPE_RADIO_PACKET_38);
-			dumpFile.write((uint8_t *)&now, 4);
-			dumpFile.write((uint8_t *)&nowMicrosFraction, 2);
-			dumpFile.write((uint8_t *)&frameLength, 4);
-			dumpFile.write(packet_buffer, frameLength);
+	captureRadio(radio37);
+	captureRadio(radio38);
+	captureRadio(radio39);
+	drainFrames();
+	repeatCache.expire(millis(), logRepeat);
 
-			packetCount++;
-			rollingPacketCount++;
-			fileSizeCounter += frameLength + 11;
-		}
-	}
-
-	if (consumeFrameBegin(U_RADIO39))
-	{
-		now = millis();
-		nowMicrosFraction = micros() % 1000;
-		
-		int32_t frameLength = consumeFrame(U_RADIO39);
-		if (frameLength != -1)
-		{
-			processPacket(frameLength);
-
-			dumpFile.write(OUTPUT_TYPE_RADIO_PACKET_39);
-			dumpFile.write((uint8_t *)&now, 4);
-			dumpFile.write((uint8_t *)&nowMicrosFraction, 2);
-			dumpFile.write((uint8_t *)&frameLength, 4);
-			dumpFile.write(packet_buffer, frameLength);
-
-			packetCount++;
-			rollingPacketCount++;
-			fileSizeCounter += frameLength + 11;
-		}
-	}
+	if (!logWriter.service() || logFiles.preparing(now))
+		logFiles.background(now);
 
 	// Read one sentence from the GPS
 	if (U_GPS.available())
@@ -493,13 +678,9 @@ void loop()
 
 				sentenceLength &= 0xFF;
 
-				dumpFile.write(OUTPUT_TYPE_NMEA_SENTENCE);
-				dumpFile.write((uint8_t *)&now, 4);
-				dumpFile.write((uint8_t *)&nowMicrosFraction, 2);
-				dumpFile.write((uint8_t)sentenceLength);
-				dumpFile.write(sentence, sentenceLength);
-
-				fileSizeCounter += sentenceLength + 8;
+				fileSizeCounter += logWriter.beginRecord(OUTPUT_TYPE_NMEA_SENTENCE, now, nowMicrosFraction, 1 + sentenceLength);
+				logWriter.write((uint8_t)sentenceLength);
+				logWriter.write(sentence, sentenceLength);
 
 				if (GPS.parse(sentence))
 				{
@@ -110,6 +110,11 @@ typedef struct {
     } pdu;
 } __packed radio_t;
 
+// radio_t flags bits
+#define RADIO_FLAG_DIRECTION_MASK (0x03)
+#define RADIO_FLAG_CRC_OK (0x04)
+#define RADIO_FLAG_MISSED (0x08)
+
 typedef struct {
     uint8_t  tag;
     uint16_t length;
@@ -0,0 +1,471 @@
+#ifndef __PACKETFILTER_H_
+#define __PACKETFILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adindex.h"
+#include "packetview.h"
+
+/*
+	Which advertising packets get logged, as a list of rules read from a
+	text file, one per line, tried in order until one matches:
+
+		# Only a few manufacturers, and nearby droids
+		keep manufacturer 0x0183
+		keep manufacturer 0x004C ad 0xFF@2 0215
+		drop rssi < -85
+		keep address C0:FF:EE:00:00:00/24 random
+		keep type scan_rsp channel 37
+		default drop
+
+	A rule is keep or drop followed by any number of conditions, all of
+	which must hold:
+
+		channel N                 37, 38 or 39
+		rssi >= N, rssi < N       dBm
+		type T                    adv_ind, direct_ind, nonconn_ind,
+		                          scan_req, scan_rsp, connect_ind,
+		                          scan_ind, ext_ind or the PDU type number
+		address A[/M]             first PDU address, written most
+		                          significant byte first, with an address
+		                          mask or a count of leading bits to compare
+		random, public            kind of that address
+		manufacturer ID           company identifier of the manufacturer data
+		ad TYPE[@OFFSET] HEX      any AD structure of TYPE whose data holds
+		                          the bytes HEX at OFFSET (0 by default)
+
+	"default drop" drops packets no rule matches; they are kept otherwise.
+	Frames other than intact advertising PDUs are always kept.
+
+	Rules are compiled once into a compact bytecode, each rule its action,
+	the length of its conditions so a failed one skips straight to the
+	next rule, then one opcode and its operands per condition. Evaluating
+	reads the few packet fields the conditions need once, then runs
+	through the program with no allocation, in time linear in the rules.
+*/
+
+#define FILTER_FILENAME "filter.txt"
+
+// Bytes of compiled rules, enough for a few hundred
+#define FILTER_PROGRAM_SIZE (4096)
+#define FILTER_LINE_SIZE (256)
+#define FILTER_TOKENS (32)
+
+enum
+{
+	FILTER_DROP = 0,
+	FILTER_KEEP = 1,
+};
+
+enum
+{
+	FILTER_OP_CHANNEL = 1,		// channel
+	FILTER_OP_RSSI_AT_LEAST,	// int8_t dBm
+	FILTER_OP_RSSI_BELOW,		// int8_t dBm
+	FILTER_OP_TYPE,				// PDU type
+	FILTER_OP_ADDRESS,			// 6 bytes masked address, 6 bytes mask, as sent
+	FILTER_OP_RANDOM,			// 0 public, 1 random
+	FILTER_OP_MANUFACTURER,		// uint16_t company, little endian
+	FILTER_OP_AD,				// AD type, offset, length, bytes
+};
+
+class PacketFilter
+{
+private:
+	uint8_t program[FILTER_PROGRAM_SIZE];
+	uint16_t programSize;
+	uint16_t ruleCount;
+	uint8_t fallback;
+
+	uint16_t failedLine;
+	const char *failure;
+
+	static bool parseNumber(const char *text, long &value, long min, long max)
+	{
+		char *end;
+		value = strtol(text, &end, 0);
+		return end != text && !*end && value >= min && value <= max;
+	}
+
+	static int hexDigit(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	/*
+		Hex digits, optionally separated by colons, into at most size
+		bytes. Returns the number of bytes, 0 if it is not hex.
+	*/
+	static uint8_t parseHex(const char *text, uint8_t *out, uint8_t size)
+	{
+		uint8_t n = 0;
+		while (*text)
+		{
+			if (*text == ':')
+			{
+				text++;
+				continue;
+			}
+			int high = hexDigit(text[0]);
+			int low = high < 0 ? -1 : hexDigit(text[1]);
+			if (low < 0 || n == size)
+				return 0;
+			out[n++] = high << 4 | low;
+			text += 2;
+		}
+		return n;
+	}
+
+	/*
+		An address, most significant byte first, into the byte order it is
+		sent in
+	*/
+	static bool parseAddress(const char *text, uint8_t *out)
+	{
+		uint8_t msbFirst[BDADDR_SIZE];
+		if (parseHex(text, msbFirst, BDADDR_SIZE) != BDADDR_SIZE)
+			return false;
+		for (uint8_t i = 0; i < BDADDR_SIZE; i++)
+			out[i] = msbFirst[BDADDR_SIZE - 1 - i];
+		return true;
+	}
+
+	bool emit(const uint8_t *bytes, uint16_t length)
+	{
+		if (programSize + length > FILTER_PROGRAM_SIZE)
+			return false;
+		memcpy(program + programSize, bytes, length);
+		programSize += length;
+		return true;
+	}
+
+	bool fail(const char *message)
+	{
+		failure = message;
+		return false;
+	}
+
+	/*
+		Compile one rule's tokens after its action
+	*/
+	bool compileConditions(char **tokens, uint8_t count)
+	{
+		for (uint8_t i = 0; i < count;)
+		{
+			const char *name = tokens[i++];
+			const char *arg = i < count ? tokens[i] : nullptr;
+			long value;
+
+			if (!strcmp(name, "random") || !strcmp(name, "public"))
+			{
+				uint8_t op[] = {FILTER_OP_RANDOM, name[0] == 'r'};
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+				continue;
+			}
+
+			if (!arg)
+				return fail("condition without a value");
+			i++;
+
+			if (!strcmp(name, "channel"))
+			{
+				if (!parseNumber(arg, value, 0, 39))
+					return fail("bad channel");
+				uint8_t op[] = {FILTER_OP_CHANNEL, (uint8_t)value};
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+			}
+			else if (!strcmp(name, "rssi"))
+			{
+				bool atLeast = !strcmp(arg, ">=");
+				if ((!atLeast && strcmp(arg, "<")) || i == count || !parseNumber(tokens[i++], value, -128, 127))
+					return fail("rssi takes >= or < and a dBm value");
+				uint8_t op[] = {(uint8_t)(atLeast ? FILTER_OP_RSSI_AT_LEAST : FILTER_OP_RSSI_BELOW), (uint8_t)(int8_t)value};
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+			}
+			else if (!strcmp(name, "type"))
+			{
+				// By PDU type number
+				static const char *const typeNames[] = {
+					"adv_ind", "direct_ind", "nonconn_ind", "scan_req", "scan_rsp", "connect_ind", "scan_ind", "ext_ind",
+				};
+				value = -1;
+				for (uint8_t t = 0; t < sizeof(typeNames) / sizeof(typeNames[0]); t++)
+					if (!strcmp(arg, typeNames[t]))
+						value = t;
+				if (value < 0 && !parseNumber(arg, value, 0, 15))
+					return fail("bad PDU type");
+				uint8_t op[] = {FILTER_OP_TYPE, (uint8_t)value};
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+			}
+			else if (!strcmp(name, "address"))
+			{
+				char text[FILTER_LINE_SIZE];
+				strncpy(text, arg, sizeof(text) - 1);
+				text[sizeof(text) - 1] = 0;
+				char *slash = strchr(text, '/');
+				if (slash)
+					*slash++ = 0;
+
+				uint8_t op[1 + 2 * BDADDR_SIZE] = {FILTER_OP_ADDRESS};
+				uint8_t *address = op + 1;
+				uint8_t *mask = op + 1 + BDADDR_SIZE;
+				if (!parseAddress(text, address))
+					return fail("bad address");
+
+				memset(mask, 0xFF, BDADDR_SIZE);
+				if (slash && strchr(slash, ':'))
+				{
+					if (!parseAddress(slash, mask))
+						return fail("bad address mask");
+				}
+				else if (slash)
+				{
+					if (!parseNumber(slash, value, 0, 48))
+						return fail("bad address prefix length");
+					// Leading bits of the address as written are the last bytes sent
+					for (uint8_t b = 0; b < BDADDR_SIZE; b++)
+					{
+						long bits = value - 8 * (BDADDR_SIZE - 1 - b);
+						mask[b] = bits >= 8 ? 0xFF : bits <= 0 ? 0 : (uint8_t)(0xFF << (8 - bits));
+					}
+				}
+
+				for (uint8_t b = 0; b < BDADDR_SIZE; b++)
+					address[b] &= mask[b];
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+			}
+			else if (!strcmp(name, "manufacturer"))
+			{
+				if (!parseNumber(arg, value, 0, 0xFFFF))
+					return fail("bad company identifier");
+				uint8_t op[] = {FILTER_OP_MANUFACTURER, (uint8_t)value, (uint8_t)(value >> 8)};
+				if (!emit(op, sizeof(op)))
+					return fail("too many rules");
+			}
+			else if (!strcmp(name, "ad"))
+			{
+				char text[FILTER_LINE_SIZE];
+				strncpy(text, arg, sizeof(text) - 1);
+				text[sizeof(text) - 1] = 0;
+				char *at = strchr(text, '@');
+				long offset = 0;
+				if (at)
+				{
+					*at++ = 0;
+					if (!parseNumber(at, offset, 0, 31))
+						return fail("bad AD offset");
+				}
+				if (!parseNumber(text, value, 0, 0xFF))
+					return fail("bad AD type");
+
+				uint8_t op[4 + 31] = {FILTER_OP_AD, (uint8_t)value, (uint8_t)offset};
+				if (i == count || !(op[3] = parseHex(tokens[i++], op + 4, 31)))
+					return fail("ad takes a type and hex bytes");
+				if (!emit(op, 4 + op[3]))
+					return fail("too many rules");
+			}
+			else
+				return fail("unknown condition");
+		}
+		return true;
+	}
+
+	bool compileLine(char *line)
+	{
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+
+		char *tokens[FILTER_TOKENS];
+		uint8_t count = 0;
+		for (char *p = line; *p;)
+		{
+			while (*p == ' ' || *p == '\t' || *p == '\r')
+				*p++ = 0;
+			if (!*p)
+				break;
+			if (count == FILTER_TOKENS)
+				return fail("line too long");
+			tokens[count++] = p;
+			while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+				p++;
+		}
+		if (!count)
+			return true;
+
+		if (!strcmp(tokens[0], "default"))
+		{
+			if (count != 2 || (strcmp(tokens[1], "keep") && strcmp(tokens[1], "drop")))
+				return fail("default takes keep or drop");
+			fallback = tokens[1][0] == 'k' ? FILTER_KEEP : FILTER_DROP;
+			return true;
+		}
+
+		bool keep = !strcmp(tokens[0], "keep");
+		if (!keep && strcmp(tokens[0], "drop"))
+			return fail("rules start with keep or drop");
+
+		uint16_t start = programSize;
+		uint8_t header[] = {(uint8_t)(keep ? FILTER_KEEP : FILTER_DROP), 0};
+		if (!emit(header, sizeof(header)))
+			return fail("too many rules");
+		if (!compileConditions(tokens + 1, count - 1))
+			return false;
+		if (programSize - start - 2 > 0xFF)
+			return fail("rule too long");
+
+		program[start + 1] = programSize - start - 2;
+		ruleCount++;
+		return true;
+	}
+
+public:
+	PacketFilter() { clear(); }
+
+	/*
+		Keep everything
+	*/
+	void clear()
+	{
+		programSize = 0;
+		ruleCount = 0;
+		fallback = FILTER_KEEP;
+		failedLine = 0;
+		failure = nullptr;
+	}
+
+	/*
+		Compile rules from text, which may be changed. On an error the
+		filter keeps everything, and error() and errorLine() say what and
+		where.
+	*/
+	bool compile(char *text)
+	{
+		clear();
+		uint16_t lineNumber = 0;
+		for (char *line = text; line;)
+		{
+			char *next = strchr(line, '\n');
+			if (next)
+				*next++ = 0;
+			lineNumber++;
+
+			if (strlen(line) >= FILTER_LINE_SIZE || !compileLine(line))
+			{
+				const char *message = failure ? failure : "line too long";
+				clear();
+				failure = message;
+				failedLine = lineNumber;
+				return false;
+			}
+			line = next;
+		}
+		return true;
+	}
+
+	uint16_t rules() const { return ruleCount; }
+	uint16_t size() const { return programSize; }
+	bool dropsByDefault() const { return fallback == FILTER_DROP; }
+	const char *error() const { return failure; }
+	uint16_t errorLine() const { return failedLine; }
+
+	/*
+		Whether to log a packet, given the index of its AD structures
+	*/
+	bool keep(const PacketView &packet, const AdIndex &ads) const
+	{
+		if (!programSize && fallback == FILTER_KEEP)
+			return true;
+		if (!packet.isAdvertising())
+			return true;
+
+		uint8_t channel = packet.channel();
+		int16_t rssi = packet.rssi();
+		uint8_t type = packet.advType();
+		uint8_t random = packet.txAddrRandom();
+		const uint8_t *address = packet.address();
+		uint64_t sender = 0;
+		if (address)
+			memcpy(&sender, address, BDADDR_SIZE);
+		uint16_t company;
+		bool hasCompany = ads.manufacturer(company);
+
+		const uint8_t *pc = program;
+		const uint8_t *end = program + programSize;
+		while (pc < end)
+		{
+			uint8_t action = pc[0];
+			const uint8_t *next = pc + 2 + pc[1];
+			bool match = true;
+			for (pc += 2; match && pc < next;)
+			{
+				switch (pc[0])
+				{
+				case FILTER_OP_CHANNEL:
+					match = channel == pc[1];
+					pc += 2;
+					break;
+				case FILTER_OP_RSSI_AT_LEAST:
+					match = rssi >= (int8_t)pc[1];
+					pc += 2;
+					break;
+				case FILTER_OP_RSSI_BELOW:
+					match = rssi < (int8_t)pc[1];
+					pc += 2;
+					break;
+				case FILTER_OP_TYPE:
+					match = type == pc[1];
+					pc += 2;
+					break;
+				case FILTER_OP_RANDOM:
+					match = random == pc[1];
+					pc += 2;
+					break;
+				case FILTER_OP_ADDRESS:
+				{
+					uint64_t value = 0, mask = 0;
+					memcpy(&value, pc + 1, BDADDR_SIZE);
+					memcpy(&mask, pc + 1 + BDADDR_SIZE, BDADDR_SIZE);
+					match = address && (sender & mask) == value;
+					pc += 1 + 2 * BDADDR_SIZE;
+					break;
+				}
+				case FILTER_OP_MANUFACTURER:
+					match = hasCompany && company == (pc[1] | pc[2] << 8);
+					pc += 3;
+					break;
+				case FILTER_OP_AD:
+				{
+					match = ads.any(pc[1], [pc](const uint8_t *data, uint8_t length) {
+						return pc[2] + pc[3] <= length && !memcmp(data + pc[2], pc + 4, pc[3]);
+					});
+					pc += 4 + pc[3];
+					break;
+				}
+				default:
+					match = false;
+				}
+			}
+			if (match)
+				return action == FILTER_KEEP;
+			pc = next;
+		}
+		return fallback == FILTER_KEEP;
+	}
+};
+
+#endif // __PACKETFILTER_H_
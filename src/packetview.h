@@ -0,0 +1,247 @@
+#ifndef __PACKETVIEW_H_
+#define __PACKETVIEW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "packet.h"
+
+/*
+	Byte offsets of the fields of a radio frame, a packet_t holding a
+	radio_t, as laid out by packet.h
+*/
+#define VIEW_TAG_OFFSET (0)
+#define VIEW_LENGTH_OFFSET (1)
+#define VIEW_TIMESTAMP_OFFSET (3)
+#define VIEW_CHANNEL_OFFSET (7)
+#define VIEW_FLAGS_OFFSET (8)
+#define VIEW_RSSI_OFFSET (9)
+#define VIEW_AA_OFFSET (11)
+#define VIEW_PDU_HEADER_OFFSET (15)
+#define VIEW_PDU_LENGTH_OFFSET (16)
+#define VIEW_PDU_OFFSET (17)
+
+static_assert(offsetof(packet_t, header.length) == VIEW_LENGTH_OFFSET, "view length offset");
+static_assert(offsetof(packet_t, payload.timestamp) == VIEW_TIMESTAMP_OFFSET, "view timestamp offset");
+static_assert(offsetof(packet_t, payload.channel) == VIEW_CHANNEL_OFFSET, "view channel offset");
+static_assert(offsetof(packet_t, payload.flags) == VIEW_FLAGS_OFFSET, "view flags offset");
+static_assert(offsetof(packet_t, payload.rssi_negative) == VIEW_RSSI_OFFSET, "view rssi offset");
+static_assert(offsetof(packet_t, payload.aa) == VIEW_AA_OFFSET, "view aa offset");
+static_assert(offsetof(packet_t, payload.pdu.adv.payload) == VIEW_PDU_OFFSET, "view pdu offset");
+
+// pdu_adv header bits
+#define VIEW_PDU_TYPE_MASK (0x0F)
+#define VIEW_PDU_CHSEL (0x20)
+#define VIEW_PDU_TXADD (0x40)
+#define VIEW_PDU_RXADD (0x80)
+
+/*
+	One AD structure of an advertising payload
+*/
+typedef struct
+{
+	uint8_t type;
+	const uint8_t *data;
+	uint8_t length;
+} ad_structure_t;
+
+/*
+	Walks the AD structures of an advertising payload in order. Stops at
+	the first zero length, which pads the rest of the payload, or at the
+	first structure running past its end.
+*/
+class AdIterator
+{
+private:
+	const uint8_t *p;
+	const uint8_t *end;
+
+	void settle()
+	{
+		// Length byte, type byte and the length - 1 data bytes must all fit
+		if (p < end && (!p[0] || p[0] > end - p - 1))
+			p = end;
+	}
+
+public:
+	AdIterator(const uint8_t *p, const uint8_t *end) : p(p), end(end) { settle(); }
+
+	bool operator!=(const AdIterator &other) const { return p != other.p; }
+
+	ad_structure_t operator*() const
+	{
+		ad_structure_t ad = {p[1], p + 2, (uint8_t)(p[0] - 1)};
+		return ad;
+	}
+
+	AdIterator &operator++()
+	{
+		p += p[0] + 1;
+		settle();
+		return *this;
+	}
+};
+
+/*
+	The AD structures of a payload, for range-based for
+*/
+class AdStructures
+{
+private:
+	const uint8_t *data;
+	const uint8_t *limit;
+
+public:
+	AdStructures(const uint8_t *data, size_t length) : data(data), limit(data + length) {}
+
+	AdIterator begin() const { return AdIterator(data, limit); }
+	AdIterator end() const { return AdIterator(limit, limit); }
+};
+
+/*
+	Typed access to the fields of a frame as a radio sent it, read
+	straight from its bytes. Nothing is copied, and every read is a fixed
+	offset from the start of the frame, so it costs what reading the
+	packed packet_t does, without the unaligned struct and bitfield
+	accesses the casts invite.
+
+	Check once: tag() and length() need hasHeader(), the radio_t fields
+	and pduLength() need isRadio(), and the PDU itself needs isAdvertising()
+	or pduFits(), after which pdu() holds pduLength() bytes. The addresses
+	and AD structures check that the PDU covers them, returning nullptr or
+	nothing otherwise.
+*/
+class PacketView
+{
+private:
+	const uint8_t *frame;
+	size_t frameLength;
+
+	uint16_t load16(size_t offset) const
+	{
+		uint16_t value;
+		memcpy(&value, frame + offset, sizeof(value));
+		return value;
+	}
+
+	uint32_t load32(size_t offset) const
+	{
+		uint32_t value;
+		memcpy(&value, frame + offset, sizeof(value));
+		return value;
+	}
+
+	const uint8_t *pduAt(size_t offset, size_t length) const
+	{
+		return pduLength() >= offset + length ? frame + VIEW_PDU_OFFSET + offset : nullptr;
+	}
+
+public:
+	PacketView(const uint8_t *frame, size_t length) : frame(frame), frameLength(length) {}
+
+	const uint8_t *data() const { return frame; }
+	size_t size() const { return frameLength; }
+
+	bool hasHeader() const { return frameLength >= sizeof(packet_header_t); }
+	uint8_t tag() const { return frame[VIEW_TAG_OFFSET]; }
+	uint16_t length() const { return load16(VIEW_LENGTH_OFFSET); }
+
+	/*
+		A radio packet with everything up to the PDU header
+	*/
+	bool isRadio() const { return frameLength >= VIEW_PDU_OFFSET && tag() == TAG_DATA; }
+
+	uint32_t timestamp() const { return load32(VIEW_TIMESTAMP_OFFSET); }
+	uint8_t channel() const { return frame[VIEW_CHANNEL_OFFSET]; }
+	uint8_t flags() const { return frame[VIEW_FLAGS_OFFSET]; }
+	uint8_t direction() const { return flags() & RADIO_FLAG_DIRECTION_MASK; }
+	bool crcOk() const { return flags() & RADIO_FLAG_CRC_OK; }
+	bool missed() const { return flags() & RADIO_FLAG_MISSED; }
+	int16_t rssi() const { return -(int16_t)frame[VIEW_RSSI_OFFSET]; }
+	uint32_t accessAddress() const { return load32(VIEW_AA_OFFSET); }
+
+	uint8_t advType() const { return frame[VIEW_PDU_HEADER_OFFSET] & VIEW_PDU_TYPE_MASK; }
+	bool chanSel() const { return frame[VIEW_PDU_HEADER_OFFSET] & VIEW_PDU_CHSEL; }
+	bool txAddrRandom() const { return frame[VIEW_PDU_HEADER_OFFSET] & VIEW_PDU_TXADD; }
+	bool rxAddrRandom() const { return frame[VIEW_PDU_HEADER_OFFSET] & VIEW_PDU_RXADD; }
+	uint8_t pduLength() const { return frame[VIEW_PDU_LENGTH_OFFSET]; }
+
+	/*
+		Whether the frame holds all pduLength() bytes of the PDU
+	*/
+	bool pduFits() const { return frameLength - VIEW_PDU_OFFSET >= pduLength(); }
+
+	/*
+		A radio packet with its whole PDU
+	*/
+	bool isAdvertising() const { return isRadio() && pduFits(); }
+
+	const uint8_t *pdu() const { return frame + VIEW_PDU_OFFSET; }
+
+	/*
+		The first address of the PDU, its sender's for every legacy
+		advertising PDU type
+	*/
+	const uint8_t *address() const { return pduAt(0, BDADDR_SIZE); }
+
+	/*
+		AdvA, wherever the PDU type puts it
+	*/
+	const uint8_t *advertiserAddress() const
+	{
+		switch (advType())
+		{
+		case PDU_ADV_TYPE_ADV_IND:
+		case PDU_ADV_TYPE_DIRECT_IND:
+		case PDU_ADV_TYPE_NONCONN_IND:
+		case PDU_ADV_TYPE_SCAN_RSP:
+		case PDU_ADV_TYPE_SCAN_IND:
+			return pduAt(0, BDADDR_SIZE);
+		case PDU_ADV_TYPE_SCAN_REQ:
+		case PDU_ADV_TYPE_CONNECT_IND:
+			return pduAt(BDADDR_SIZE, BDADDR_SIZE);
+		}
+		return nullptr;
+	}
+
+	/*
+		The address of the other side: TargetA of a directed advertisement,
+		ScanA of a scan request, InitA of a connect request
+	*/
+	const uint8_t *peerAddress() const
+	{
+		switch (advType())
+		{
+		case PDU_ADV_TYPE_DIRECT_IND:
+			return pduAt(BDADDR_SIZE, BDADDR_SIZE);
+		case PDU_ADV_TYPE_SCAN_REQ:
+		case PDU_ADV_TYPE_CONNECT_IND:
+			return pduAt(0, BDADDR_SIZE);
+		}
+		return nullptr;
+	}
+
+	/*
+		Whether the PDU type carries AD structures after AdvA
+	*/
+	bool hasAdData() const
+	{
+		switch (advType())
+		{
+		case PDU_ADV_TYPE_ADV_IND:
+		case PDU_ADV_TYPE_NONCONN_IND:
+		case PDU_ADV_TYPE_SCAN_RSP:
+		case PDU_ADV_TYPE_SCAN_IND:
+			return pduLength() >= BDADDR_SIZE;
+		}
+		return false;
+	}
+
+	const uint8_t *adData() const { return hasAdData() ? pdu() + BDADDR_SIZE : nullptr; }
+	uint8_t adLength() const { return hasAdData() ? pduLength() - BDADDR_SIZE : 0; }
+
+	AdStructures adStructures() const { return AdStructures(adData(), adLength()); }
+};
+
+#endif // __PACKETVIEW_H_
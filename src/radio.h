@@ -0,0 +1,28 @@
+#ifndef __RADIO_H_
+#define __RADIO_H_
+
+#include <Arduino.h>
+
+#include "framing.h"
+#include "spscring.h"
+
+/*
+	Per-radio state. The ingest interrupt moves bytes from the UART into
+	the ring, loop() decodes them from the ring; decode state is kept
+	across loop() passes so a partially received frame on one radio never
+	holds up the others.
+*/
+typedef struct
+{
+	HardwareSerial &port;
+	uint8_t outputType;
+	SpscRing ring;
+	FrameDecoder decoder;
+	uint32_t frameMillis;
+	uint16_t frameMicrosFraction;
+	// A decoded frame still in frame(), waiting for a pool slot
+	bool frameWaiting;
+	int32_t frameLength;
+} radio_state_t;
+
+#endif // __RADIO_H_
@@ -0,0 +1,271 @@
+#ifndef __REPEATCACHE_H_
+#define __REPEATCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "logformat.h"
+#include "packet.h"
+#include "packetview.h"
+
+// Slots looked at for a frame, so the cost per packet stays the same
+// however full the cache is
+#define REPEAT_CACHE_PROBES (8)
+
+// Slots expire() looks at per call
+#define REPEAT_CACHE_SWEEP (16)
+
+/*
+	A frame logged whole, and its repeats since the last summary, 48 bytes
+*/
+typedef struct
+{
+	// Of the PDU header and payload, 0 for a free slot
+	uint64_t hash;
+	uint32_t loggedMillis;
+	uint32_t firstMillis;
+	uint32_t lastMillis;
+	uint16_t lastMicrosFraction;
+	uint8_t address[BDADDR_SIZE];
+	uint8_t pduHeader;
+	uint8_t pduLength;
+	// Channels 37 to 39
+	uint8_t counts[LOG_REPEAT_CHANNELS];
+	int8_t rssiMin[LOG_REPEAT_CHANNELS];
+	int8_t rssiMax[LOG_REPEAT_CHANNELS];
+	int16_t rssiSum[LOG_REPEAT_CHANNELS];
+} repeat_entry_t;
+
+/*
+	Suppresses advertisements heard again unchanged. Every advertiser
+	sends the same PDU over and over, on all three channels, and only the
+	first copy says anything the rest do not; after that what matters is
+	when and how strongly it was heard, which fits in a repeat record
+	summing up a window of repeats per channel.
+
+	Frames are remembered by repeatFrameHash() of their PDU header and
+	payload, checked against the address as well, in a fixed number of
+	entries supplied by the caller, with open addressing over
+	REPEAT_CACHE_PROBES slots as in AdvertiserTable. A frame not in the
+	cache is logged whole, as is one last logged whole refreshMillis ago,
+	so any stretch of the log that long shows every advertisement still
+	being sent. The rest are absorbed, and their summary is written once
+	windowMillis have passed since the first of them, once a channel has
+	counted 255, or when the entry is given up for another frame.
+
+	Summaries are handed to an emit(const log_repeat_t &, millis,
+	microsFraction) callback, with the time of the last repeat counted.
+*/
+class RepeatCache
+{
+private:
+	repeat_entry_t *entries;
+	uint32_t mask;
+	uint32_t windowMillis;
+	uint32_t refreshMillis;
+	uint32_t sweepIndex;
+
+	static bool pending(const repeat_entry_t &entry)
+	{
+		return entry.counts[0] | entry.counts[1] | entry.counts[2];
+	}
+
+	template <typename F>
+	void flush(repeat_entry_t &entry, F emit)
+	{
+		if (!pending(entry))
+			return;
+
+		log_repeat_t repeat;
+		memcpy(repeat.address, entry.address, BDADDR_SIZE);
+		repeat.pduHeader = entry.pduHeader;
+		repeat.pduLength = entry.pduLength;
+		repeat.frameHash = (uint32_t)entry.hash;
+		uint32_t span = entry.lastMillis - entry.firstMillis;
+		repeat.spanMillis = span > 0xFFFF ? 0xFFFF : span;
+
+		for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+		{
+			log_repeat_channel_t &channel = repeat.channels[i];
+			uint8_t count = entry.counts[i];
+			channel.count = count;
+			channel.rssiMin = count ? entry.rssiMin[i] : 0;
+			channel.rssiMax = count ? entry.rssiMax[i] : 0;
+			// Rounded, the sum being negative
+			channel.rssiMean = count ? (entry.rssiSum[i] - count / 2) / count : 0;
+		}
+
+		memset(entry.counts, 0, sizeof(entry.counts));
+		summaries++;
+		emit(repeat, entry.lastMillis, entry.lastMicrosFraction);
+	}
+
+	/*
+		Count a repeat heard on channel index c
+	*/
+	template <typename F>
+	void count(repeat_entry_t &entry, uint8_t c, int8_t rssi, uint32_t millis, uint16_t microsFraction, F emit)
+	{
+		if (pending(entry) && millis - entry.firstMillis >= windowMillis)
+			flush(entry, emit);
+		if (!pending(entry))
+			entry.firstMillis = millis;
+
+		if (!entry.counts[c]++)
+		{
+			entry.rssiMin[c] = rssi;
+			entry.rssiMax[c] = rssi;
+			entry.rssiSum[c] = 0;
+		}
+		if (rssi < entry.rssiMin[c])
+			entry.rssiMin[c] = rssi;
+		if (rssi > entry.rssiMax[c])
+			entry.rssiMax[c] = rssi;
+		entry.rssiSum[c] += rssi;
+
+		entry.lastMillis = millis;
+		entry.lastMicrosFraction = microsFraction;
+		repeats++;
+
+		if (entry.counts[c] == 0xFF)
+			flush(entry, emit);
+	}
+
+public:
+	// Frames absorbed, summaries written, and frames given up for others
+	uint64_t repeats;
+	uint32_t summaries;
+	uint32_t evictions;
+
+	/*
+		capacity must be a power of two, at least REPEAT_CACHE_PROBES.
+		Absorbs nothing until given a window.
+	*/
+	RepeatCache(repeat_entry_t *entries, uint32_t capacity)
+		: entries(entries), mask(capacity - 1), windowMillis(0), refreshMillis(0), sweepIndex(0),
+		  repeats(0), summaries(0), evictions(0)
+	{
+		memset(entries, 0, sizeof(repeat_entry_t) * capacity);
+	}
+
+	/*
+		Summarise repeats over windowMillis, at most
+		LOG_REPEAT_WINDOW_MAX_MILLIS, logging frames whole again after
+		refreshMillis; a window of 0 absorbs nothing
+	*/
+	void setWindow(uint32_t windowMillis, uint32_t refreshMillis)
+	{
+		this->windowMillis = windowMillis < LOG_REPEAT_WINDOW_MAX_MILLIS ? windowMillis : LOG_REPEAT_WINDOW_MAX_MILLIS;
+		this->refreshMillis = refreshMillis;
+	}
+
+	bool enabled() const { return windowMillis != 0; }
+
+	uint32_t capacity() const { return mask + 1; }
+
+	/*
+		Take a frame about to be logged, heard at millis. Returns true if it
+		is a repeat that is counted instead, false if it has to be logged
+		whole.
+	*/
+	template <typename F>
+	bool absorb(const PacketView &packet, uint32_t millis, uint16_t microsFraction, F emit)
+	{
+		if (!windowMillis || !packet.isAdvertising() || !packet.crcOk())
+			return false;
+
+		const uint8_t *address = packet.address();
+		uint8_t c = packet.channel() - 37;
+		if (!address || c >= LOG_REPEAT_CHANNELS)
+			return false;
+
+		// Only what advertisers send over and over, not requests
+		switch (packet.advType())
+		{
+		case PDU_ADV_TYPE_ADV_IND:
+		case PDU_ADV_TYPE_DIRECT_IND:
+		case PDU_ADV_TYPE_NONCONN_IND:
+		case PDU_ADV_TYPE_SCAN_RSP:
+		case PDU_ADV_TYPE_SCAN_IND:
+			break;
+		default:
+			return false;
+		}
+
+		const uint8_t *pdu = packet.pdu() - 2;
+		uint64_t h = repeatFrameHash(pdu, 2 + packet.pduLength());
+		uint32_t index = (uint32_t)(h >> 32) & mask;
+		repeat_entry_t *oldest = nullptr;
+		repeat_entry_t *entry = nullptr;
+		for (uint8_t i = 0; i < REPEAT_CACHE_PROBES; i++, index = (index + 1) & mask)
+		{
+			repeat_entry_t &candidate = entries[index];
+			if (!candidate.hash)
+			{
+				entry = &candidate;
+				break;
+			}
+			if (candidate.hash == h && !memcmp(candidate.address, address, BDADDR_SIZE))
+			{
+				if (millis - candidate.loggedMillis < refreshMillis)
+				{
+					count(candidate, c, packet.rssi() < -128 ? -128 : packet.rssi(), millis, microsFraction, emit);
+					return true;
+				}
+
+				// Due to be logged whole again
+				flush(candidate, emit);
+				candidate.loggedMillis = candidate.lastMillis = millis;
+				return false;
+			}
+			if (!oldest || millis - candidate.lastMillis > millis - oldest->lastMillis)
+				oldest = &candidate;
+		}
+
+		if (!entry)
+		{
+			entry = oldest;
+			flush(*entry, emit);
+			evictions++;
+		}
+
+		entry->hash = h;
+		memcpy(entry->address, address, BDADDR_SIZE);
+		entry->pduHeader = pdu[0];
+		entry->pduLength = pdu[1];
+		entry->loggedMillis = entry->lastMillis = millis;
+		memset(entry->counts, 0, sizeof(entry->counts));
+		return false;
+	}
+
+	/*
+		Write the summaries whose window has closed by nowMillis, looking
+		at REPEAT_CACHE_SWEEP slots per call. Call once per loop() pass.
+	*/
+	template <typename F>
+	void expire(uint32_t nowMillis, F emit)
+	{
+		for (uint8_t i = 0; i < REPEAT_CACHE_SWEEP; i++)
+		{
+			repeat_entry_t &entry = entries[sweepIndex];
+			sweepIndex = (sweepIndex + 1) & mask;
+			if (pending(entry) && nowMillis - entry.firstMillis >= windowMillis)
+				flush(entry, emit);
+		}
+	}
+
+	/*
+		Write every summary and forget every frame, so the next copy of
+		each is logged whole, as at the start of a new log file
+	*/
+	template <typename F>
+	void clear(F emit)
+	{
+		for (uint32_t i = 0; i <= mask; i++)
+			flush(entries[i], emit);
+		memset(entries, 0, sizeof(repeat_entry_t) * (mask + 1));
+	}
+};
+
+#endif // __REPEATCACHE_H_
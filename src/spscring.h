@@ -0,0 +1,156 @@
+#ifndef __SPSCRING_H_
+#define __SPSCRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+/*
+	Lock-free single-producer/single-consumer byte ring. The producer is an
+	interrupt (or a thread on the host) and only ever moves head, the
+	consumer is loop() and only ever moves tail. Both indices run freely
+	and are masked on access, so the capacity must be a power of two.
+
+	The counters belong to the producer: highWatermark is the most bytes
+	ever waiting in the ring, overflows the bytes dropped because it was
+	full.
+*/
+class SpscRing
+{
+private:
+	uint8_t *buffer;
+	uint32_t mask;
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+
+public:
+	volatile uint32_t highWatermark;
+	volatile uint32_t overflows;
+
+	SpscRing(uint8_t *buffer, uint32_t capacity)
+		: buffer(buffer), mask(capacity - 1), head(0), tail(0), highWatermark(0), overflows(0)
+	{
+	}
+
+	uint32_t capacity() const { return mask + 1; }
+
+	// Producer side
+
+	size_t space() const
+	{
+		return capacity() - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+	}
+
+	/*
+		Contiguous free space at the head. Written bytes become visible to
+		the consumer on commit().
+	*/
+	uint8_t *writable(size_t &space)
+	{
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t free = capacity() - (h - tail.load(std::memory_order_acquire));
+		uint32_t toEnd = capacity() - (h & mask);
+
+		space = free < toEnd ? free : toEnd;
+		return buffer + (h & mask);
+	}
+
+	void commit(size_t n)
+	{
+		uint32_t h = head.load(std::memory_order_relaxed) + n;
+		head.store(h, std::memory_order_release);
+
+		uint32_t used = h - tail.load(std::memory_order_relaxed);
+		if (used > highWatermark)
+			highWatermark = used;
+	}
+
+	/*
+		Copy in as much as fits, counting the rest as overflow. Returns the
+		number of bytes queued.
+	*/
+	size_t push(const uint8_t *data, size_t length)
+	{
+		size_t queued = 0;
+		while (queued < length)
+		{
+			size_t space;
+			uint8_t *dst = writable(space);
+			if (space == 0)
+				break;
+
+			if (space > length - queued)
+				space = length - queued;
+			memcpy(dst, data + queued, space);
+			commit(space);
+			queued += space;
+		}
+
+		overflows += length - queued;
+		return queued;
+	}
+
+	/*
+		Move everything a stream has received into the ring. Bytes that do
+		not fit are still read, so the stream itself never backs up, and
+		counted as overflow.
+	*/
+	template <typename S>
+	size_t fill(S &stream)
+	{
+		size_t queued = 0;
+		int available = stream.available();
+		while (available > 0)
+		{
+			size_t space;
+			uint8_t *dst = writable(space);
+			if (space == 0)
+			{
+				overflows += available;
+				while (available-- > 0)
+					stream.read();
+				break;
+			}
+
+			if (space > (size_t)available)
+				space = available;
+			size_t n = stream.readBytes(dst, space);
+			if (n == 0)
+				break;
+
+			commit(n);
+			queued += n;
+			available -= n;
+		}
+
+		return queued;
+	}
+
+	// Consumer side
+
+	int available() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+	}
+
+	size_t readBytes(uint8_t *dst, size_t length)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t used = head.load(std::memory_order_acquire) - t;
+		if (length > used)
+			length = used;
+
+		size_t first = capacity() - (t & mask);
+		if (first > length)
+			first = length;
+		memcpy(dst, buffer + (t & mask), first);
+		memcpy(dst + first, buffer, length - first);
+
+		tail.store(t + length, std::memory_order_release);
+		return length;
+	}
+};
+
+#endif // __SPSCRING_H_
@@ -0,0 +1,167 @@
+#ifndef __LOGCHUNKS_H_
+#define __LOGCHUNKS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "logindex.h"
+#include "logreader.h"
+
+/*
+	Splitting a capture log into chunks that decode independently, for
+	reading one on several threads. A chunk is the records of the blocks
+	starting in [start, end), so chunk boundaries only have to fall on
+	the block grid: sector boundaries from version 3, block size steps
+	before that. Reading a chunk starts at readOffset, early enough that
+	the address slots its frames use are defined again; the records of
+	that lead-in are read and dropped.
+
+	Version 0 logs have no blocks, so boundaries are found by looking for
+	a run of records that parse and whose times make sense, and a chunk is
+	read as a headerless log of its own.
+*/
+
+typedef struct
+{
+	size_t readOffset;
+	size_t start;
+	size_t end;
+} log_chunk_t;
+
+typedef struct
+{
+	uint32_t badBlocks;
+	uint64_t skippedBytes;
+	uint32_t unresolvedAddresses;
+} log_chunk_damage_t;
+
+/*
+	Split a log into about count chunks. index, if given, supplies where
+	reading must start for each chunk; otherwise it is worked out from
+	the address table reset interval in the file header.
+*/
+inline std::vector<log_chunk_t> splitLog(const uint8_t *data, size_t size, size_t count, const LogIndex *index = nullptr)
+{
+	std::vector<log_chunk_t> chunks;
+	LogReader reader(data, size);
+	if (count == 0)
+		count = 1;
+
+	if (reader.version() == 0)
+	{
+		size_t start = 0;
+		for (size_t i = 1; i < count && start < size; i++)
+		{
+			size_t p = std::max(start + 1, size * i / count);
+			while (p < size && !logRecordsStartAt(data, size, p))
+				p++;
+			if (p >= size)
+				break;
+
+			chunks.push_back({start, start, p});
+			start = p;
+		}
+		chunks.push_back({start, start, size});
+		return chunks;
+	}
+
+	if (!reader.supported())
+		return chunks;
+
+	const log_file_header_t &header = reader.header();
+	size_t first = header.headerSize;
+	size_t grid = header.version >= 3 ? LOG_SECTOR_SIZE : header.blockSize;
+	size_t maxStride = (header.blockSize + LOG_SECTOR_SIZE - 1) / LOG_SECTOR_SIZE * LOG_SECTOR_SIZE;
+	size_t leadIn = header.version >= 4 ? (header.addressResetBlocks + 1) * maxStride : 0;
+	bool slots = header.version >= 4 && header.addressResetBlocks;
+
+	size_t start = first;
+	for (size_t i = 1; i <= count; i++)
+	{
+		size_t end = size;
+		if (i < count)
+		{
+			end = first + (size - first) * i / count / grid * grid;
+			if (end <= start)
+				continue;
+		}
+
+		size_t readOffset = start;
+		if (index && index->size())
+		{
+			size_t n = std::partition_point(&(*index)[0], &(*index)[0] + index->size(),
+											[&](const log_index_entry_t &entry) { return entry.offset < start; }) -
+					   &(*index)[0];
+			if (n < index->size())
+				readOffset = std::min<size_t>(start, (*index)[n].readOffset);
+		}
+		else if (slots)
+			readOffset = start - std::min(start - first, leadIn);
+
+		chunks.push_back({readOffset, start, end});
+		start = end;
+	}
+	return chunks;
+}
+
+/*
+	The reader for a chunk: the whole log from version 1, only the
+	chunk's bytes for version 0
+*/
+inline LogReader chunkReader(const uint8_t *data, size_t size, const log_chunk_t &chunk)
+{
+	LogReader whole(data, size);
+	if (whole.version() != 0)
+		return whole;
+	return LogReader(data + chunk.start, chunk.end - chunk.start);
+}
+
+/*
+	Read the records of a chunk with a reader from chunkReader(),
+	calling callback(record) for each. Returns the damage found, leaving
+	out the lead-in, whose damage the chunk before reports.
+*/
+template <typename F>
+log_chunk_damage_t readChunk(LogReader &reader, const log_chunk_t &chunk, F callback)
+{
+	log_record_t record;
+	if (reader.version() == 0)
+	{
+		while (reader.next(record))
+			callback(record);
+		return {reader.badBlocks, reader.skippedBytes, reader.unresolvedAddresses};
+	}
+
+	// Damage before the first block is this chunk's only in the first one
+	bool leading = chunk.start > reader.header().headerSize;
+	log_chunk_damage_t lead = {0, 0, 0};
+
+	reader.seek(chunk.readOffset);
+	while (reader.next(record))
+	{
+		size_t block = reader.recordBlock();
+		if (block >= chunk.end)
+			break;
+		if (block < chunk.start)
+			continue;
+
+		if (leading)
+		{
+			lead = {reader.badBlocks, reader.skippedBytes, reader.unresolvedAddresses};
+			leading = false;
+		}
+		callback(record);
+	}
+
+	// A chunk with no records of its own has nothing the one before
+	// did not see
+	if (leading)
+		return {0, 0, 0};
+	return {reader.badBlocks - lead.badBlocks, reader.skippedBytes - lead.skippedBytes,
+			reader.unresolvedAddresses - lead.unresolvedAddresses};
+}
+
+#endif // __LOGCHUNKS_H_
@@ -0,0 +1,229 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "logreader.h"
+#include "mappedfile.h"
+#include "packetdecode.h"
+#include "parquet.h"
+
+/*
+	Exports the radio packets of capture logs as a Parquet table, one row
+	per packet, for analysis with pandas, Arrow, DuckDB and the like:
+
+		time_us         INT64    device time of the record
+		channel         INT8     link layer channel
+		rssi            INT8     dBm
+		direction       INT32    radio_t direction bits
+		crc_ok          BOOLEAN
+		missed          BOOLEAN  packets were missed before this one
+		adv_type        INT32    PDU type
+		address         STRING   first PDU address, MSB first, dictionary
+		                         encoded; null if the PDU has none
+		address_random  BOOLEAN
+		ad_data         BINARY   AD structures; null for PDUs without
+		repeats         INT32    packets the row stands for
+
+	A repeat record becomes a row for each channel it counts packets on,
+	with repeats giving how many, rssi their mean and ad_data null, at
+	the time of the last of them, so per-channel RSSI over time can be
+	had from the rows whichever way the packets were logged.
+
+	Rows are written in row groups of a fixed count, so memory stays the
+	same however long the input. Each row group carries min/max statistics
+	for its integer and address columns, letting readers skip row groups
+	by time, channel or RSSI.
+
+	Usage:
+		logcolumns [-o OUTPUT] [--row-group ROWS] FILE...
+*/
+
+#define LOGCOLUMNS_ROW_GROUP (262144)
+
+static std::string defaultOutput(const char *input)
+{
+	std::string path = input;
+	size_t dot = path.rfind('.');
+	if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+		path.resize(dot);
+	return path + ".parquet";
+}
+
+int main(int argc, char **argv)
+{
+	const char *outputPath = nullptr;
+	uint32_t rowGroup = LOGCOLUMNS_ROW_GROUP;
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "-o"))
+			outputPath = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "--row-group"))
+			rowGroup = strtoul(argv[++i], nullptr, 0);
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	if (inputs.empty() || rowGroup == 0)
+	{
+		fprintf(stderr, "usage: logcolumns [-o OUTPUT] [--row-group ROWS] FILE...\n");
+		return 2;
+	}
+
+	std::string output = outputPath ? outputPath : defaultOutput(inputs[0]);
+	FILE *out = fopen(output.c_str(), "wb");
+	if (!out)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+	static char outBuffer[1 << 20];
+	setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+	ParquetColumn timeColumn("time_us", PARQUET_INT64, PARQUET_REQUIRED);
+	ParquetColumn channelColumn("channel", PARQUET_INT32, PARQUET_REQUIRED, PARQUET_CONVERTED_INT_8);
+	ParquetColumn rssiColumn("rssi", PARQUET_INT32, PARQUET_REQUIRED, PARQUET_CONVERTED_INT_8);
+	ParquetColumn directionColumn("direction", PARQUET_INT32, PARQUET_REQUIRED);
+	ParquetColumn crcColumn("crc_ok", PARQUET_BOOLEAN, PARQUET_REQUIRED, PARQUET_CONVERTED_NONE, false, false);
+	ParquetColumn missedColumn("missed", PARQUET_BOOLEAN, PARQUET_REQUIRED, PARQUET_CONVERTED_NONE, false, false);
+	ParquetColumn typeColumn("adv_type", PARQUET_INT32, PARQUET_REQUIRED);
+	ParquetColumn addressColumn("address", PARQUET_BYTE_ARRAY, PARQUET_OPTIONAL, PARQUET_CONVERTED_UTF8, true);
+	ParquetColumn randomColumn("address_random", PARQUET_BOOLEAN, PARQUET_REQUIRED, PARQUET_CONVERTED_NONE, false, false);
+	ParquetColumn dataColumn("ad_data", PARQUET_BYTE_ARRAY, PARQUET_OPTIONAL, PARQUET_CONVERTED_NONE, false, false);
+	ParquetColumn repeatsColumn("repeats", PARQUET_INT32, PARQUET_REQUIRED);
+
+	ParquetWriter parquet;
+	parquet.begin(out,
+				  {&timeColumn, &channelColumn, &rssiColumn, &directionColumn, &crcColumn, &missedColumn,
+				   &typeColumn, &addressColumn, &randomColumn, &dataColumn, &repeatsColumn},
+				  "logcolumns");
+
+	// Dictionary indices of the row group's addresses, by their 48 bits,
+	// so the text form is only made once per address per row group
+	std::unordered_map<uint64_t, uint32_t> addressSlots;
+	uint64_t rows = 0;
+	uint64_t skipped = 0;
+	int failed = 0;
+
+	for (const char *path : inputs)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			perror(path);
+			failed++;
+			continue;
+		}
+
+		LogReader reader(file.data(), file.size());
+		if (!reader.supported())
+		{
+			fprintf(stderr, "%s: unsupported log format\n", path);
+			failed++;
+			continue;
+		}
+
+		auto addAddress = [&](const uint8_t *address) {
+			uint64_t key = 0;
+			memcpy(&key, address, BDADDR_SIZE);
+			auto slot = addressSlots.find(key);
+			if (slot == addressSlots.end())
+			{
+				// Most significant byte first, as addresses are usually written
+				char text[3 * BDADDR_SIZE];
+				for (int i = 0; i < BDADDR_SIZE; i++)
+					snprintf(text + 3 * i, 4, i + 1 < BDADDR_SIZE ? "%02X:" : "%02X", address[BDADDR_SIZE - 1 - i]);
+				slot = addressSlots.emplace(key, addressColumn.lookup(text, sizeof(text) - 1)).first;
+			}
+			addressColumn.addIndex(slot->second);
+		};
+
+		auto endRow = [&]() {
+			rows++;
+			if (parquet.rows() >= rowGroup)
+			{
+				parquet.endRowGroup();
+				addressSlots.clear();
+			}
+		};
+
+		decodeLog(reader, [&](const log_record_t &record, const decoded_packet_t *packet) {
+			log_repeat_t repeat;
+			if (record.type == OUTPUT_TYPE_RADIO_REPEAT && decodeRepeat(record.payload, record.length, repeat))
+			{
+				for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+				{
+					const log_repeat_channel_t &channel = repeat.channels[i];
+					if (!channel.count)
+						continue;
+
+					timeColumn.addInt64(logTime(record.millis, record.microsFraction));
+					channelColumn.addInt32(37 + i);
+					rssiColumn.addInt32(channel.rssiMean);
+					directionColumn.addInt32(0);
+					crcColumn.addBoolean(true);
+					missedColumn.addBoolean(false);
+					typeColumn.addInt32(repeat.pduHeader & VIEW_PDU_TYPE_MASK);
+					randomColumn.addBoolean(repeat.pduHeader & VIEW_PDU_TXADD);
+					addAddress(repeat.address);
+					dataColumn.addNull();
+					repeatsColumn.addInt32(channel.count);
+					endRow();
+				}
+				return;
+			}
+
+			if (record.type < OUTPUT_TYPE_RADIO_PACKET_37 || record.type > OUTPUT_TYPE_RADIO_PACKET_39)
+				return;
+			if (!packet || packet->tag != TAG_DATA)
+			{
+				skipped++;
+				return;
+			}
+
+			timeColumn.addInt64(logTime(record.millis, record.microsFraction));
+			channelColumn.addInt32(packet->channel);
+			rssiColumn.addInt32(packet->rssi);
+			directionColumn.addInt32(packet->flags & RADIO_FLAG_DIRECTION_MASK);
+			crcColumn.addBoolean(packet->flags & RADIO_FLAG_CRC_OK);
+			missedColumn.addBoolean(packet->flags & RADIO_FLAG_MISSED);
+			typeColumn.addInt32(packet->pduType);
+			randomColumn.addBoolean(packet->txAddrRandom);
+
+			if (packet->address)
+				addAddress(packet->address);
+			else
+				addressColumn.addNull();
+
+			if (packet->data)
+				dataColumn.addBytes(packet->data, packet->dataLength);
+			else
+				dataColumn.addNull();
+			repeatsColumn.addInt32(1);
+			endRow();
+		});
+
+		if (reader.badBlocks || reader.unresolvedAddresses)
+			fprintf(stderr, "%s: %" PRIu32 " bad blocks, %" PRIu64 " bytes skipped, %" PRIu32 " unresolved addresses\n",
+					path, reader.badBlocks, reader.skippedBytes, reader.unresolvedAddresses);
+	}
+
+	parquet.finish();
+	if (fclose(out) != 0)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+
+	fprintf(stderr, "%s: %" PRIu64 " rows, %" PRIu64 " bytes", output.c_str(), rows, parquet.bytesWritten());
+	if (skipped)
+		fprintf(stderr, ", %" PRIu64 " frames that are not advertising packets left out", skipped);
+	fprintf(stderr, "\n");
+	return failed ? 1 : 0;
+}
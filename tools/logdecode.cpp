@@ -0,0 +1,555 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logchunks.h"
+#include "logindex.h"
+#include "logreader.h"
+#include "mappedfile.h"
+#include "packetdecode.h"
+#include "workpool.h"
+
+/*
+	Streams the records of capture logs to stdout as text, one line each,
+	with radio frames decoded:
+
+		<millis>.<micros> time
+		<millis>.<micros> nmea <sentence>
+		<millis>.<micros> radio<channel> ts=<radio timestamp> ch=<channel>
+			rssi=<dBm> aa=<access address> crc=ok|bad dir=<direction>
+			[missed] <PDU type> addr=<address>[/r] data=<AD bytes>
+		<millis>.<micros> repeat <PDU type> addr=<address>[/r]
+			len=<PDU length> hash=<frame hash> span=<ms>
+			[ch<channel>=<count> rssi=<min>/<mean>/<max>]...
+
+	A repeat line stands for the copies of the frame with that address,
+	type, length and hash (32 bits of repeatFrameHash() over the PDU)
+	heard over span milliseconds up to its time, with their count and
+	RSSI on each channel they were heard on.
+
+	Files are memory mapped and read in place. --quiet only decodes, for
+	timing the decoder without the output.
+
+	--threads N decodes each file in chunks on N threads (0 for one per
+	core) and merges their lines into timestamp order, so records the
+	radios interleaved a little out of order come out sorted. Chunks
+	start at block boundaries, with the sidecar index if there is one
+	telling where their address slots are defined.
+
+	Usage:
+		logdecode [--quiet] [--threads N] FILE...
+*/
+
+static const char *pduTypeNames[16] = {
+	"ADV_IND", "DIRECT_IND", "NONCONN_IND", "SCAN_REQ",
+	"SCAN_RSP", "CONNECT_IND", "SCAN_IND", "EXT_IND",
+	"PDU_8", "PDU_9", "PDU_10", "PDU_11",
+	"PDU_12", "PDU_13", "PDU_14", "PDU_15"};
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// Chunks per thread, and the least a chunk should hold
+#define PARALLEL_CHUNKS_PER_THREAD (4)
+#define PARALLEL_CHUNK_SIZE (8 << 20)
+
+/*
+	Output assembled in a large buffer and written a chunk at a time,
+	as printf per field would be far slower than decoding
+*/
+class LineWriter
+{
+private:
+	char buffer[1 << 20];
+	size_t used;
+
+public:
+	LineWriter() : used(0) {}
+	~LineWriter() { flush(); }
+
+	void flush()
+	{
+		fwrite(buffer, 1, used, stdout);
+		used = 0;
+	}
+
+	// Make room for a line of up to length bytes
+	char *reserve(size_t length)
+	{
+		if (used + length > sizeof(buffer))
+			flush();
+		return buffer + used;
+	}
+
+	void commit(char *end) { used = end - buffer; }
+
+	void write(const char *text, size_t length)
+	{
+		char *p = reserve(length);
+		memcpy(p, text, length);
+		commit(p + length);
+	}
+};
+
+static char *putString(char *p, const char *s)
+{
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char *putUnsigned(char *p, uint32_t value)
+{
+	char digits[10];
+	int n = 0;
+	do
+	{
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	while (n)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char *putHex(char *p, const uint8_t *data, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		*p++ = HEX_DIGITS[data[i] >> 4];
+		*p++ = HEX_DIGITS[data[i] & 15];
+	}
+	return p;
+}
+
+static char *putHex32(char *p, uint32_t value)
+{
+	for (int shift = 28; shift >= 0; shift -= 4)
+		*p++ = HEX_DIGITS[(value >> shift) & 15];
+	return p;
+}
+
+static char *putTime(char *p, const log_record_t &record)
+{
+	p = putUnsigned(p, record.millis);
+	*p++ = '.';
+	*p++ = '0' + record.microsFraction / 100;
+	*p++ = '0' + record.microsFraction / 10 % 10;
+	*p++ = '0' + record.microsFraction % 10;
+	*p++ = ' ';
+	return p;
+}
+
+static char *putPacket(char *p, const decoded_packet_t &packet)
+{
+	if (packet.tag != TAG_DATA)
+	{
+		p = putString(p, "tag=");
+		return putUnsigned(p, packet.tag);
+	}
+
+	p = putString(p, "ts=");
+	p = putUnsigned(p, packet.timestamp);
+	p = putString(p, " ch=");
+	p = putUnsigned(p, packet.channel);
+	p = putString(p, " rssi=-");
+	p = putUnsigned(p, -packet.rssi);
+	p = putString(p, " aa=");
+	p = putHex32(p, packet.accessAddress);
+	p = putString(p, packet.flags & RADIO_FLAG_CRC_OK ? " crc=ok dir=" : " crc=bad dir=");
+	p = putUnsigned(p, packet.flags & RADIO_FLAG_DIRECTION_MASK);
+	if (packet.flags & RADIO_FLAG_MISSED)
+		p = putString(p, " missed");
+	*p++ = ' ';
+	p = putString(p, pduTypeNames[packet.pduType]);
+
+	if (packet.address)
+	{
+		// Most significant byte first, as addresses are usually written
+		p = putString(p, " addr=");
+		for (int i = BDADDR_SIZE - 1; i >= 0; i--)
+		{
+			p = putHex(p, packet.address + i, 1);
+			if (i)
+				*p++ = ':';
+		}
+		if (packet.txAddrRandom)
+			p = putString(p, "/r");
+	}
+
+	if (packet.data)
+	{
+		p = putString(p, " data=");
+		p = putHex(p, packet.data, packet.dataLength);
+	}
+	return p;
+}
+
+static char *putSigned(char *p, int32_t value)
+{
+	if (value < 0)
+	{
+		*p++ = '-';
+		value = -value;
+	}
+	return putUnsigned(p, value);
+}
+
+static char *putRepeat(char *p, const log_repeat_t &repeat)
+{
+	p = putString(p, pduTypeNames[repeat.pduHeader & VIEW_PDU_TYPE_MASK]);
+	p = putString(p, " addr=");
+	for (int i = BDADDR_SIZE - 1; i >= 0; i--)
+	{
+		p = putHex(p, repeat.address + i, 1);
+		if (i)
+			*p++ = ':';
+	}
+	if (repeat.pduHeader & VIEW_PDU_TXADD)
+		p = putString(p, "/r");
+
+	p = putString(p, " len=");
+	p = putUnsigned(p, repeat.pduLength);
+	p = putString(p, " hash=");
+	p = putHex32(p, repeat.frameHash);
+	p = putString(p, " span=");
+	p = putUnsigned(p, repeat.spanMillis);
+
+	for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+	{
+		const log_repeat_channel_t &channel = repeat.channels[i];
+		if (!channel.count)
+			continue;
+		p = putString(p, " ch");
+		p = putUnsigned(p, 37 + i);
+		*p++ = '=';
+		p = putUnsigned(p, channel.count);
+		p = putString(p, " rssi=");
+		p = putSigned(p, channel.rssiMin);
+		*p++ = '/';
+		p = putSigned(p, channel.rssiMean);
+		*p++ = '/';
+		p = putSigned(p, channel.rssiMax);
+	}
+	return p;
+}
+
+// Room for the longest line of a record: a frame in hex plus the fields
+static size_t lineSizeMax(const log_record_t &record)
+{
+	return 2 * record.length + 256;
+}
+
+/*
+	Format a record as a line, returning its end
+*/
+static char *putRecord(char *p, const log_record_t &record, const decoded_packet_t *packet)
+{
+	p = putTime(p, record);
+
+	switch (record.type)
+	{
+	case OUTPUT_TYPE_SYSTEM_TIMESTAMP:
+		p = putString(p, "time");
+		break;
+
+	case OUTPUT_TYPE_NMEA_SENTENCE:
+		p = putString(p, "nmea ");
+		memcpy(p, record.payload, record.length);
+		p += record.length;
+		// Sentences keep their line ending
+		while (p[-1] == '\n' || p[-1] == '\r')
+			p--;
+		break;
+
+	case OUTPUT_TYPE_RADIO_REPEAT:
+	{
+		p = putString(p, "repeat ");
+		log_repeat_t repeat;
+		if (decodeRepeat(record.payload, record.length, repeat))
+			p = putRepeat(p, repeat);
+		else
+		{
+			p = putString(p, "undecodable=");
+			p = putHex(p, record.payload, record.length);
+		}
+		break;
+	}
+
+	default:
+		p = putString(p, "radio");
+		p = putUnsigned(p, 37 + record.type - OUTPUT_TYPE_RADIO_PACKET_37);
+		*p++ = ' ';
+		if (packet)
+			p = putPacket(p, *packet);
+		else
+		{
+			p = putString(p, "undecodable=");
+			p = putHex(p, record.payload, record.length);
+		}
+		break;
+	}
+
+	*p++ = '\n';
+	return p;
+}
+
+typedef struct
+{
+	uint64_t records;
+	uint64_t packets;
+	uint32_t badBlocks;
+	uint64_t skippedBytes;
+	uint32_t unresolvedAddresses;
+} decode_totals_t;
+
+static void decodeFile(const MappedFile &file, bool quiet, LineWriter &out, decode_totals_t &totals)
+{
+	LogReader reader(file.data(), file.size());
+	decodeLog(reader, [&](const log_record_t &record, const decoded_packet_t *packet) {
+		totals.records++;
+		totals.packets += packet != nullptr;
+		if (quiet)
+			return;
+
+		char *p = out.reserve(lineSizeMax(record));
+		out.commit(putRecord(p, record, packet));
+	});
+
+	totals.badBlocks = reader.badBlocks;
+	totals.skippedBytes = reader.skippedBytes;
+	totals.unresolvedAddresses = reader.unresolvedAddresses;
+}
+
+typedef struct
+{
+	uint64_t time;
+	// Index into the chunk's text
+	uint32_t offset;
+	uint32_t length;
+} chunk_line_t;
+
+/*
+	The lines of one chunk, sorted by time
+*/
+struct ChunkOutput
+{
+	std::vector<char> text;
+	std::vector<chunk_line_t> lines;
+	uint64_t records = 0;
+	uint64_t packets = 0;
+	log_chunk_damage_t damage = {0, 0, 0};
+	bool done = false;
+};
+
+static void decodeChunk(const MappedFile &file, const log_chunk_t &chunk, bool quiet, ChunkOutput &output)
+{
+	LogReader reader = chunkReader(file.data(), file.size(), chunk);
+	decoded_packet_t decoded;
+	size_t used = 0;
+
+	output.damage = readChunk(reader, chunk, [&](const log_record_t &record) {
+		bool radio = record.type >= OUTPUT_TYPE_RADIO_PACKET_37 && record.type <= OUTPUT_TYPE_RADIO_PACKET_39;
+		const decoded_packet_t *packet = radio && decodePacket(record.payload, record.length, decoded) ? &decoded : nullptr;
+		output.records++;
+		output.packets += packet != nullptr;
+		if (quiet)
+			return;
+
+		size_t room = lineSizeMax(record);
+		if (output.text.size() < used + room)
+			output.text.resize(std::max(2 * output.text.size(), used + room));
+
+		char *start = output.text.data() + used;
+		char *end = putRecord(start, record, packet);
+		output.lines.push_back({logTime(record.millis, record.microsFraction), (uint32_t)used, (uint32_t)(end - start)});
+		used += end - start;
+	});
+
+	output.text.resize(used);
+	std::stable_sort(output.lines.begin(), output.lines.end(),
+					 [](const chunk_line_t &a, const chunk_line_t &b) { return a.time < b.time; });
+}
+
+typedef struct
+{
+	uint64_t time;
+	const char *text;
+	uint32_t length;
+	// Chunk the line came from
+	uint32_t chunk;
+} merge_line_t;
+
+/*
+	Decode a file's chunks on a pool of threads and write their lines in
+	time order. Chunks are decoded a few ahead of the one being written,
+	and chunks overlap in time only where they meet, or by up to
+	LOG_REPEAT_LATENESS_MAX_MILLIS for repeat records, so a line is written
+	once the next chunk shows nothing can come before it.
+*/
+static void decodeFileParallel(const MappedFile &file, const char *path, size_t threads, bool quiet, LineWriter &out,
+							   decode_totals_t &totals)
+{
+	LogIndex index;
+	bool indexed = index.load(LogIndex::sidecarPath(path).c_str(), file.data(), file.size());
+
+	size_t chunkCount = std::max(threads * PARALLEL_CHUNKS_PER_THREAD, file.size() / PARALLEL_CHUNK_SIZE);
+	std::vector<log_chunk_t> chunks = splitLog(file.data(), file.size(), chunkCount, indexed ? &index : nullptr);
+	std::vector<std::unique_ptr<ChunkOutput>> outputs(chunks.size());
+
+	std::mutex lock;
+	std::condition_variable finished;
+	WorkStealingPool pool(threads);
+
+	size_t submitted = 0;
+	auto submit = [&]() {
+		size_t i = submitted++;
+		outputs[i].reset(new ChunkOutput);
+		pool.submit([&, i]() {
+			decodeChunk(file, chunks[i], quiet, *outputs[i]);
+			std::lock_guard<std::mutex> guard(lock);
+			outputs[i]->done = true;
+			finished.notify_all();
+		});
+	};
+
+	size_t ahead = 2 * threads;
+	while (submitted < chunks.size() && submitted < ahead)
+		submit();
+
+	std::vector<merge_line_t> pending;
+	std::vector<merge_line_t> merged;
+	size_t oldestHeld = 0;
+
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			finished.wait(guard, [&] { return outputs[i]->done; });
+		}
+		if (submitted < chunks.size())
+			submit();
+
+		ChunkOutput &output = *outputs[i];
+		totals.records += output.records;
+		totals.packets += output.packets;
+		totals.badBlocks += output.damage.badBlocks;
+		totals.skippedBytes += output.damage.skippedBytes;
+		totals.unresolvedAddresses += output.damage.unresolvedAddresses;
+		if (quiet)
+		{
+			outputs[i].reset();
+			continue;
+		}
+
+		// Write what comes before this chunk's first line, less the most a
+		// repeat record in a later chunk may come after the time it carries
+		uint64_t first = output.lines.empty() ? 0 : output.lines[0].time;
+		uint64_t lateness = (uint64_t)LOG_REPEAT_LATENESS_MAX_MILLIS * 1000;
+		uint64_t cutoff = first > lateness ? first - lateness : 0;
+		size_t written = 0;
+		while (written < pending.size() && pending[written].time < cutoff)
+		{
+			const merge_line_t &line = pending[written++];
+			out.write(line.text, line.length);
+		}
+
+		merged.clear();
+		size_t a = written;
+		size_t b = 0;
+		while (a < pending.size() || b < output.lines.size())
+		{
+			if (b == output.lines.size() || (a < pending.size() && pending[a].time <= output.lines[b].time))
+				merged.push_back(pending[a++]);
+			else
+			{
+				const chunk_line_t &line = output.lines[b++];
+				merged.push_back({line.time, output.text.data() + line.offset, line.length, (uint32_t)i});
+			}
+		}
+		pending.swap(merged);
+
+		// Free the chunks no pending line comes from
+		uint32_t oldest = i;
+		for (const merge_line_t &line : pending)
+			oldest = std::min(oldest, line.chunk);
+		for (; oldestHeld < oldest; oldestHeld++)
+			outputs[oldestHeld].reset();
+	}
+
+	for (const merge_line_t &line : pending)
+		out.write(line.text, line.length);
+}
+
+int main(int argc, char **argv)
+{
+	bool quiet = false;
+	size_t threads = 1;
+	int files = 0;
+	int failed = 0;
+	static LineWriter out;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--quiet"))
+		{
+			quiet = true;
+			continue;
+		}
+		if (i + 1 < argc && !strcmp(argv[i], "--threads"))
+		{
+			threads = strtoul(argv[++i], nullptr, 0);
+			if (threads == 0)
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			continue;
+		}
+
+		const char *path = argv[i];
+		files++;
+
+		MappedFile file;
+		if (!file.open(path))
+		{
+			perror(path);
+			failed++;
+			continue;
+		}
+
+		LogReader reader(file.data(), file.size());
+		if (!reader.supported())
+		{
+			fprintf(stderr, "%s: unsupported log format\n", path);
+			failed++;
+			continue;
+		}
+
+		decode_totals_t totals = {};
+		if (threads > 1)
+			decodeFileParallel(file, path, threads, quiet, out, totals);
+		else
+			decodeFile(file, quiet, out, totals);
+
+		if (quiet)
+			fprintf(stderr, "%s: %" PRIu64 " records, %" PRIu64 " packets\n", path, totals.records, totals.packets);
+		if (totals.badBlocks || totals.unresolvedAddresses)
+			fprintf(stderr, "%s: %" PRIu32 " bad blocks, %" PRIu64 " bytes skipped, %" PRIu32 " unresolved addresses\n",
+					path, totals.badBlocks, totals.skippedBytes, totals.unresolvedAddresses);
+	}
+
+	if (!files)
+	{
+		fprintf(stderr, "usage: logdecode [--quiet] [--threads N] FILE...\n");
+		return 2;
+	}
+
+	out.flush();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logreader.h"
+#include "mappedfile.h"
+
+/*
+	Prints what a capture log holds: its format and header, then either a
+	summary of its records per type or every record.
+
+	Usage:
+		logdump [--records] FILE
+*/
+
+static void printHeader(const log_file_header_t &header)
+{
+	printf("version %u, %u byte blocks, file %u\n", header.version, header.blockSize, header.fileIndex);
+	printf("device %08" PRIX32 "%08" PRIX32 ", firmware %.*s\n",
+		   header.deviceId[1], header.deviceId[0], (int)sizeof(header.firmware), header.firmware);
+
+	for (uint8_t i = 0; i < header.radioCount && i < LOG_RADIO_COUNT_MAX; i++)
+	{
+		const log_radio_info_t &radio = header.radios[i];
+		printf("radio type %u: channel %u, access address %08" PRIX32 ", %" PRIu32 " baud\n",
+			   radio.outputType, radio.channel, radio.accessAddress, radio.baudRate);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool listRecords = false;
+	const char *path = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--records"))
+			listRecords = true;
+		else
+			path = argv[i];
+	}
+
+	if (!path)
+	{
+		fprintf(stderr, "usage: logdump [--records] FILE\n");
+		return 2;
+	}
+
+	MappedFile file;
+	if (!file.open(path))
+	{
+		perror(path);
+		return 1;
+	}
+
+	LogReader reader(file.data(), file.size());
+	if (reader.version() == 0)
+		printf("version 0 (no header)\n");
+	else
+		printHeader(reader.header());
+
+	if (!reader.supported())
+	{
+		fprintf(stderr, "%s: unsupported log format\n", path);
+		return 1;
+	}
+
+	uint64_t counts[256] = {0};
+	uint64_t payloadBytes[256] = {0};
+	uint64_t records = 0;
+	uint32_t firstMillis = 0;
+	uint32_t lastMillis = 0;
+
+	log_record_t record;
+	while (reader.next(record))
+	{
+		if (records++ == 0)
+			firstMillis = record.millis;
+		lastMillis = record.millis;
+
+		counts[record.type]++;
+		payloadBytes[record.type] += record.length;
+
+		if (listRecords)
+		{
+			printf("%10" PRIu32 ".%03u %-9s %4" PRIu32 " ", record.millis, record.microsFraction,
+				   recordTypeName(record.type), record.length);
+			if (record.type == OUTPUT_TYPE_NMEA_SENTENCE)
+				printf("%.*s", (int)record.length, (const char *)record.payload);
+			else
+				for (uint32_t i = 0; i < record.length; i++)
+					printf("%02X", record.payload[i]);
+			printf("\n");
+		}
+	}
+
+	printf("%" PRIu64 " records, %" PRIu32 " ms to %" PRIu32 " ms\n", records, firstMillis, lastMillis);
+	for (int type = 0; type < 256; type++)
+		if (counts[type])
+			printf("  %-9s %10" PRIu64 " records %12" PRIu64 " payload bytes\n", recordTypeName(type), counts[type], payloadBytes[type]);
+
+	if (reader.version() > 0)
+	{
+		printf("%" PRIu32 " blocks, %" PRIu32 " bad\n", reader.blocks, reader.badBlocks);
+		printf("%" PRIu64 " record bytes in %" PRIu64 " block bytes (%.2f:1)\n", reader.recordBytes, reader.storedBytes,
+			   reader.storedBytes ? reader.recordBytes / (double)reader.storedBytes : 0.0);
+	}
+	if (reader.unresolvedAddresses)
+		printf("%" PRIu32 " frames lost with the address they referred to\n", reader.unresolvedAddresses);
+	if (reader.skippedBytes)
+		printf("%" PRIu64 " bytes skipped\n", reader.skippedBytes);
+
+	return reader.badBlocks ? 1 : 0;
+}
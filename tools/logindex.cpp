@@ -0,0 +1,177 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logindex.h"
+#include "mappedfile.h"
+
+/*
+	Builds the sidecar index of a capture log, or reuses it if it is up
+	to date, and answers queries through it without reading the rest of
+	the log.
+
+	--blocks prints each block's summary. --from and --to (milliseconds)
+	print the records in that time range. --record N prints --count
+	records starting at record N, or at packet N of --channel. --channel
+	also limits a time range to that channel's packets.
+
+	Usage:
+		logindex [--rebuild] [--blocks] [--from MS] [--to MS]
+			[--record N] [--count N] [--channel 37|38|39] FILE
+*/
+
+static void printRecord(const log_record_t &record)
+{
+	printf("%10" PRIu32 ".%03u %-9s %4" PRIu32 " ", record.millis, record.microsFraction,
+		   recordTypeName(record.type), record.length);
+	if (record.type == OUTPUT_TYPE_NMEA_SENTENCE)
+		printf("%.*s", (int)record.length, (const char *)record.payload);
+	else
+		for (uint32_t i = 0; i < record.length; i++)
+			printf("%02X", record.payload[i]);
+	printf("\n");
+}
+
+static void printBlocks(const LogIndex &index)
+{
+	printf("%12s %14s %14s %7s %6s %6s %6s %9s %5s\n",
+		   "offset", "from ms", "to ms", "records", "ch37", "ch38", "ch39", "rssi", "addrs");
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		const log_index_entry_t &entry = index[i];
+		printf("%12" PRIu64 " %10" PRIu64 ".%03u %10" PRIu64 ".%03u %7" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %4d..%-4d %5u\n",
+			   entry.offset, entry.minTime / 1000, (unsigned)(entry.minTime % 1000),
+			   entry.maxTime / 1000, (unsigned)(entry.maxTime % 1000), entry.records,
+			   entry.packets[0], entry.packets[1], entry.packets[2], entry.rssiMin, entry.rssiMax, entry.advertisers);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool rebuild = false;
+	bool blocks = false;
+	double fromMillis = -1;
+	double toMillis = -1;
+	int64_t firstRecord = -1;
+	uint64_t count = 1;
+	int channel = -1;
+	const char *path = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--rebuild"))
+			rebuild = true;
+		else if (!strcmp(argv[i], "--blocks"))
+			blocks = true;
+		else if (i + 1 < argc && !strcmp(argv[i], "--from"))
+			fromMillis = atof(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "--to"))
+			toMillis = atof(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "--record"))
+			firstRecord = strtoll(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--count"))
+			count = strtoull(argv[++i], nullptr, 0);
+		else if (i + 1 < argc && !strcmp(argv[i], "--channel"))
+			channel = atoi(argv[++i]) - 37;
+		else
+			path = argv[i];
+	}
+
+	if (!path || (channel != -1 && (channel < 0 || channel >= LOG_INDEX_CHANNELS)))
+	{
+		fprintf(stderr, "usage: logindex [--rebuild] [--blocks] [--from MS] [--to MS] [--record N] [--count N] [--channel 37|38|39] FILE\n");
+		return 2;
+	}
+
+	MappedFile file;
+	if (!file.open(path))
+	{
+		perror(path);
+		return 1;
+	}
+
+	LogIndex index;
+	std::string indexPath = LogIndex::sidecarPath(path);
+	if (rebuild || !index.load(indexPath.c_str(), file.data(), file.size()))
+	{
+		if (!index.build(file.data(), file.size()))
+		{
+			fprintf(stderr, "%s: not a log this tool can index\n", path);
+			return 1;
+		}
+		if (!index.save(indexPath.c_str()))
+			perror(indexPath.c_str());
+		else
+			fprintf(stderr, "%s: indexed %zu blocks\n", indexPath.c_str(), index.size());
+	}
+
+	LogReader reader(file.data(), file.size());
+	log_record_t record;
+	uint8_t channelType = OUTPUT_TYPE_RADIO_PACKET_37 + channel;
+
+	if (blocks)
+		printBlocks(index);
+
+	if (fromMillis >= 0 || toMillis >= 0)
+	{
+		uint64_t from = fromMillis >= 0 ? (uint64_t)(fromMillis * 1000) : 0;
+		uint64_t to = toMillis >= 0 ? (uint64_t)(toMillis * 1000) : UINT64_MAX;
+
+		// Up to the first block wholly after the range
+		size_t end = index.findTimeEnd(to);
+		uint64_t endOffset = end < index.size() ? index[end].offset : UINT64_MAX;
+
+		bool more = index.seek(reader, index.findTime(from), record);
+		for (; more && reader.recordBlock() < endOffset; more = reader.next(record))
+		{
+			uint64_t time = logTime(record.millis, record.microsFraction);
+			if (time >= from && time <= to && (channel == -1 || record.type == channelType))
+				printRecord(record);
+		}
+	}
+
+	if (firstRecord >= 0)
+	{
+		// Records are counted from the block's first, or its first packet
+		// on the channel
+		size_t i;
+		uint64_t skip;
+		if (channel == -1)
+		{
+			i = index.findRecord(firstRecord);
+			skip = i < index.size() ? firstRecord - index[i].firstRecord : 0;
+		}
+		else
+		{
+			i = index.findPacket(channel, firstRecord);
+			skip = i < index.size() ? firstRecord - index[i].firstPacket[channel] : 0;
+		}
+
+		bool more = index.seek(reader, i, record);
+		for (; more && count; more = reader.next(record))
+		{
+			if (channel != -1 && record.type != channelType)
+				continue;
+			if (skip)
+			{
+				skip--;
+				continue;
+			}
+
+			printRecord(record);
+			count--;
+		}
+	}
+
+	if (!blocks && fromMillis < 0 && toMillis < 0 && firstRecord < 0)
+	{
+		const log_index_header_t &header = index.header();
+		printf("%zu blocks, %" PRIu64 " records, %" PRIu64 "/%" PRIu64 "/%" PRIu64 " packets on 37/38/39\n",
+			   index.size(), header.records, header.packets[0], header.packets[1], header.packets[2]);
+		if (index.size())
+			printf("%" PRIu64 " ms to %" PRIu64 " ms\n", index[0].minTime / 1000, index[index.size() - 1].maxTime / 1000);
+	}
+
+	return 0;
+}
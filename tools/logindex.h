@@ -0,0 +1,345 @@
+#ifndef __LOGINDEX_H_
+#define __LOGINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "logreader.h"
+#include "packetdecode.h"
+
+/*
+	Sidecar index of a capture log, one entry per block, so a time or a
+	record number can be found by binary search and read from its block
+	instead of from the start of the file. Each entry also summarises its
+	block: records, packets per channel, RSSI range and the number of
+	distinct advertiser addresses.
+
+	Version 0 logs have no blocks, so their entries are checkpoints
+	instead: the offset of a record about every LOG_INDEX_SPAN bytes, and
+	of the first record found again with logRecordsStartAt() after
+	anything that does not parse. Reading can start at any of them.
+
+	The index sits next to the log as NNNN.idx: an index header followed
+	by the entries, little endian as written. It names the log it was
+	built from by size and header CRC, so one left behind by a log that
+	has since grown is rebuilt rather than trusted.
+*/
+
+#define LOG_INDEX_MAGIC "SWGEIDX"
+#define LOG_INDEX_VERSION (1)
+#define LOG_INDEX_CHANNELS (3)
+
+// Bytes of a version 0 log between checkpoints
+#define LOG_INDEX_SPAN (65536)
+
+typedef struct
+{
+	char magic[8];
+	uint16_t version;
+	uint16_t entrySize;
+	uint32_t entryCount;
+	// The log: its size and the CRC at the end of its header sector
+	uint64_t logSize;
+	uint32_t logHeaderCrc;
+	uint64_t records;
+	uint64_t packets[LOG_INDEX_CHANNELS];
+	// CRC-32 of the entries
+	uint32_t crc;
+} __packed log_index_header_t;
+
+typedef struct
+{
+	uint64_t offset;
+	// Block to start reading at for the address slots this block uses
+	uint64_t readOffset;
+	// Number of the block's first record in the file, and of its first
+	// packet on each channel
+	uint64_t firstRecord;
+	uint64_t firstPacket[LOG_INDEX_CHANNELS];
+	// Earliest and latest record time, in microseconds
+	uint64_t minTime;
+	uint64_t maxTime;
+	uint32_t records;
+	uint32_t packets[LOG_INDEX_CHANNELS];
+	// dBm, both 0 if the block holds no radio packets
+	int16_t rssiMin;
+	int16_t rssiMax;
+	uint16_t advertisers;
+} __packed log_index_entry_t;
+
+class LogIndex
+{
+private:
+	log_index_header_t indexHeader;
+	std::vector<log_index_entry_t> entries;
+
+	static uint32_t logHeaderCrc(const uint8_t *log, size_t logSize)
+	{
+		if (logSize < LOG_FILE_HEADER_SIZE)
+			return 0;
+		uint32_t crc;
+		memcpy(&crc, log + LOG_FILE_HEADER_SIZE - 4, 4);
+		return crc;
+	}
+
+	void start(const uint8_t *log, size_t logSize)
+	{
+		memset(&indexHeader, 0, sizeof(indexHeader));
+		memcpy(indexHeader.magic, LOG_INDEX_MAGIC, sizeof(indexHeader.magic));
+		indexHeader.version = LOG_INDEX_VERSION;
+		indexHeader.entrySize = sizeof(log_index_entry_t);
+		indexHeader.logSize = logSize;
+		indexHeader.logHeaderCrc = logHeaderCrc(log, logSize);
+		entries.clear();
+	}
+
+	static void finishEntry(log_index_entry_t &entry, std::vector<uint64_t> &addresses)
+	{
+		std::sort(addresses.begin(), addresses.end());
+		entry.advertisers = std::unique(addresses.begin(), addresses.end()) - addresses.begin();
+		addresses.clear();
+
+		if (entry.rssiMin > entry.rssiMax)
+			entry.rssiMin = entry.rssiMax = 0;
+	}
+
+public:
+	LogIndex()
+	{
+		memset(&indexHeader, 0, sizeof(indexHeader));
+	}
+
+	/*
+		NNNN.idx for NNNN.bin
+	*/
+	static std::string sidecarPath(const char *logPath)
+	{
+		std::string path = logPath;
+		size_t dot = path.rfind('.');
+		if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+			path.resize(dot);
+		return path + ".idx";
+	}
+
+	/*
+		Index a log by reading it through once
+	*/
+	bool build(const uint8_t *log, size_t logSize)
+	{
+		LogReader reader(log, logSize);
+		if (!reader.supported())
+			return false;
+
+		start(log, logSize);
+
+		log_record_t record;
+		decoded_packet_t packet;
+		log_index_entry_t entry = {};
+		std::vector<uint64_t> addresses;
+		uint64_t readOffset = 0;
+		bool headerless = reader.version() == 0;
+		bool resynced = false;
+
+		for (;;)
+		{
+			uint64_t skipped = reader.skippedBytes;
+			while (reader.next(record))
+			{
+				if (entries.empty() || (headerless ? resynced || reader.recordBlock() >= entries.back().offset + LOG_INDEX_SPAN
+												   : reader.recordBlock() != entries.back().offset))
+				{
+					if (!entries.empty())
+						finishEntry(entries.back(), addresses);
+
+					memset(&entry, 0, sizeof(entry));
+					entry.offset = reader.recordBlock();
+					if (reader.recordBlockSelfContained())
+						readOffset = entry.offset;
+					entry.readOffset = readOffset;
+					entry.firstRecord = indexHeader.records;
+					memcpy(entry.firstPacket, indexHeader.packets, sizeof(entry.firstPacket));
+					entry.minTime = UINT64_MAX;
+					entry.rssiMin = INT16_MAX;
+					entry.rssiMax = INT16_MIN;
+					entries.push_back(entry);
+					resynced = false;
+				}
+
+				log_index_entry_t &current = entries.back();
+				uint64_t time = logTime(record.millis, record.microsFraction);
+				current.minTime = std::min(current.minTime, time);
+				current.maxTime = std::max(current.maxTime, time);
+				current.records++;
+				indexHeader.records++;
+
+				if (record.type < OUTPUT_TYPE_RADIO_PACKET_37 || record.type > OUTPUT_TYPE_RADIO_PACKET_39)
+					continue;
+
+				int channel = record.type - OUTPUT_TYPE_RADIO_PACKET_37;
+				current.packets[channel]++;
+				indexHeader.packets[channel]++;
+
+				if (!decodePacket(record.payload, record.length, packet) || packet.tag != TAG_DATA)
+					continue;
+
+				current.rssiMin = std::min(current.rssiMin, packet.rssi);
+				current.rssiMax = std::max(current.rssiMax, packet.rssi);
+				if (packet.address)
+				{
+					uint64_t address = 0;
+					memcpy(&address, packet.address, BDADDR_SIZE);
+					addresses.push_back(address);
+				}
+			}
+
+			// A version 0 log stops at the first record it cannot parse;
+			// carry on from where records look to start again
+			if (!headerless || reader.skippedBytes == skipped)
+				break;
+
+			size_t p = logSize - (reader.skippedBytes - skipped) + 1;
+			while (p < logSize && !logRecordsStartAt(log, logSize, p))
+				p++;
+			if (p >= logSize)
+				break;
+			reader.seek(p);
+			resynced = true;
+		}
+
+		if (!entries.empty())
+			finishEntry(entries.back(), addresses);
+
+		indexHeader.entryCount = entries.size();
+		indexHeader.crc = crc32(entries.data(), entries.size() * sizeof(log_index_entry_t));
+		return true;
+	}
+
+	/*
+		Load the index at path, failing if it is damaged or was built
+		from a different state of the log
+	*/
+	bool load(const char *path, const uint8_t *log, size_t logSize)
+	{
+		if (logSize < LOG_FILE_HEADER_SIZE)
+			return false;
+
+		FILE *file = fopen(path, "rb");
+		if (!file)
+			return false;
+
+		log_index_header_t header;
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+				  !memcmp(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic)) &&
+				  header.version == LOG_INDEX_VERSION &&
+				  header.entrySize == sizeof(log_index_entry_t) &&
+				  header.logSize == logSize &&
+				  header.logHeaderCrc == logHeaderCrc(log, logSize);
+		if (ok)
+		{
+			entries.resize(header.entryCount);
+			ok = fread(entries.data(), sizeof(log_index_entry_t), entries.size(), file) == entries.size() &&
+				 crc32(entries.data(), entries.size() * sizeof(log_index_entry_t)) == header.crc;
+		}
+		fclose(file);
+
+		if (!ok)
+		{
+			entries.clear();
+			return false;
+		}
+
+		indexHeader = header;
+		return true;
+	}
+
+	bool save(const char *path) const
+	{
+		FILE *file = fopen(path, "wb");
+		if (!file)
+			return false;
+
+		bool ok = fwrite(&indexHeader, sizeof(indexHeader), 1, file) == 1 &&
+				  fwrite(entries.data(), sizeof(log_index_entry_t), entries.size(), file) == entries.size();
+		return fclose(file) == 0 && ok;
+	}
+
+	const log_index_header_t &header() const { return indexHeader; }
+	size_t size() const { return entries.size(); }
+	const log_index_entry_t &operator[](size_t i) const { return entries[i]; }
+
+	/*
+		The first block with records at or after time, or size() if
+		there is none. Records go forward in time but for the few
+		milliseconds by which the radios' are interleaved, and for repeat
+		records, which come up to LOG_REPEAT_LATENESS_MAX_MILLIS after the
+		time they carry. So a block's latest time still only moves
+		forward, but its earliest may reach back into the blocks before.
+	*/
+	size_t findTime(uint64_t time) const
+	{
+		auto it = std::partition_point(entries.begin(), entries.end(),
+									   [&](const log_index_entry_t &entry) { return entry.maxTime < time; });
+		return it - entries.begin();
+	}
+
+	/*
+		The first block with no records at or before time, or size(),
+		reading on far enough for repeat records logged late
+	*/
+	size_t findTimeEnd(uint64_t time) const
+	{
+		uint64_t late = time + (uint64_t)LOG_REPEAT_LATENESS_MAX_MILLIS * 1000;
+		auto it = std::partition_point(entries.begin(), entries.end(),
+									   [&](const log_index_entry_t &entry) { return entry.minTime <= late; });
+		return it - entries.begin();
+	}
+
+	/*
+		The block holding record number ordinal, or size() if there is
+		none
+	*/
+	size_t findRecord(uint64_t ordinal) const
+	{
+		auto it = std::partition_point(entries.begin(), entries.end(),
+									   [&](const log_index_entry_t &entry) { return entry.firstRecord + entry.records <= ordinal; });
+		return it - entries.begin();
+	}
+
+	/*
+		The block holding packet number ordinal of channel 37 + channel,
+		or size() if there is none
+	*/
+	size_t findPacket(int channel, uint64_t ordinal) const
+	{
+		auto it = std::partition_point(entries.begin(), entries.end(),
+									   [&](const log_index_entry_t &entry) {
+										   return entry.firstPacket[channel] + entry.packets[channel] <= ordinal;
+									   });
+		return it - entries.begin();
+	}
+
+	/*
+		Position reader to read block i, leaving its first record in
+		record. Reading starts at the block's readOffset so that frames
+		referring to address slots defined earlier resolve.
+	*/
+	bool seek(LogReader &reader, size_t i, log_record_t &record) const
+	{
+		if (i >= entries.size())
+			return false;
+
+		reader.seek(entries[i].readOffset);
+		while (reader.next(record))
+			if (reader.recordBlock() == entries[i].offset)
+				return true;
+		return false;
+	}
+};
+
+#endif // __LOGINDEX_H_
@@ -0,0 +1,283 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "logreader.h"
+#include "mappedfile.h"
+#include "packetdecode.h"
+#include "pcapng.h"
+
+/*
+	Exports capture logs to pcapng for Wireshark, in one pass over
+	memory mapped input with nothing held per packet.
+
+	Radio frames go to one interface per advertising channel as
+	LINKTYPE_BLUETOOTH_LE_LL_WITH_PHDR, keeping RSSI, channel, access
+	address, direction and the radio's CRC verdict in the pseudo header.
+	The frames carry no CRC; for advertising channel packets that passed
+	it is recomputed, otherwise it is zero and the header says whether
+	the radio found it valid. Packets flagged as following missed ones
+	get a comment saying so.
+
+	NMEA sentences go to a "gps" interface as packets holding the
+	sentence, which is also their comment so it shows in the packet list.
+
+	Timestamps are the device's clock, time since it started, as the log
+	holds no wall clock time.
+
+	Usage:
+		logpcap [-o OUTPUT] FILE...
+*/
+
+#define BLE_ADVERTISING_ACCESS_ADDRESS (0x8E89BED6)
+#define BLE_ADVERTISING_CRC_INIT (0x555555)
+#define BLE_CRC_SIZE (3)
+#define BLE_ACCESS_ADDRESS_SIZE (4)
+
+// LINKTYPE_BLUETOOTH_LE_LL_WITH_PHDR pseudo header
+typedef struct
+{
+	uint8_t rfChannel;
+	int8_t signalPower;
+	int8_t noisePower;
+	uint8_t accessAddressOffenses;
+	uint32_t referenceAccessAddress;
+	uint16_t flags;
+} __packed ble_phdr_t;
+
+#define BLE_PHDR_DEWHITENED (0x0001)
+#define BLE_PHDR_SIGNAL_POWER_VALID (0x0002)
+#define BLE_PHDR_REFERENCE_AA_VALID (0x0010)
+#define BLE_PHDR_PDU_MASTER_TO_SLAVE (0x0100)
+#define BLE_PHDR_PDU_SLAVE_TO_MASTER (0x0180)
+#define BLE_PHDR_CRC_CHECKED (0x0400)
+#define BLE_PHDR_CRC_VALID (0x0800)
+
+#define NMEA_INTERFACE (3)
+
+/*
+	RF channel (2402 MHz + 2 MHz steps) of a link layer channel index
+*/
+static uint8_t bleRfChannel(uint8_t channel)
+{
+	if (channel == 37)
+		return 0;
+	if (channel == 38)
+		return 12;
+	if (channel == 39)
+		return 39;
+	return channel < 11 ? channel + 1 : channel + 2;
+}
+
+/*
+	The link layer CRC (x^24 + x^10 + x^9 + x^6 + x^4 + x^3 + x + 1),
+	kept bit reversed so that data, which goes in least significant bit
+	first, is taken a byte at a time. Bit 0 of the register is position
+	23, the first bit of the CRC on air.
+*/
+struct ble_crc_table_t
+{
+	uint32_t entries[256];
+
+	constexpr ble_crc_table_t() : entries()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xDA6000 ^ (c >> 1) : c >> 1;
+			entries[i] = c;
+		}
+	}
+};
+
+static constexpr ble_crc_table_t BLE_CRC_TABLE;
+
+/*
+	The CRC of a PDU as its 3 bytes go over the air, from the CRCInit
+	value as the specification gives it
+*/
+static void bleCrc(const uint8_t *pdu, size_t length, uint32_t init, uint8_t *crc)
+{
+	uint32_t reg = 0;
+	for (int bit = 0; bit < 24; bit++)
+		reg |= ((init >> bit) & 1) << (23 - bit);
+
+	for (size_t i = 0; i < length; i++)
+		reg = BLE_CRC_TABLE.entries[(reg ^ pdu[i]) & 0xFF] ^ (reg >> 8);
+
+	crc[0] = reg;
+	crc[1] = reg >> 8;
+	crc[2] = reg >> 16;
+}
+
+static std::string defaultOutput(const char *input)
+{
+	std::string path = input;
+	size_t dot = path.rfind('.');
+	if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+		path.resize(dot);
+	return path + ".pcapng";
+}
+
+int main(int argc, char **argv)
+{
+	const char *outputPath = nullptr;
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "-o"))
+			outputPath = argv[++i];
+		else
+			inputs.push_back(argv[i]);
+	}
+
+	if (inputs.empty())
+	{
+		fprintf(stderr, "usage: logpcap [-o OUTPUT] FILE...\n");
+		return 2;
+	}
+
+	std::string output = outputPath ? outputPath : defaultOutput(inputs[0]);
+	FILE *out = fopen(output.c_str(), "wb");
+	if (!out)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+	static char outBuffer[1 << 20];
+	setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+	PcapngWriter pcap;
+	bool started = false;
+	uint64_t skipped = 0;
+	int failed = 0;
+
+	for (const char *path : inputs)
+	{
+		MappedFile file;
+		if (!file.open(path))
+		{
+			perror(path);
+			failed++;
+			continue;
+		}
+
+		LogReader reader(file.data(), file.size());
+		if (!reader.supported())
+		{
+			fprintf(stderr, "%s: unsupported log format\n", path);
+			failed++;
+			continue;
+		}
+
+		if (!started)
+		{
+			// The section and interfaces come from the first log
+			const log_file_header_t &header = reader.header();
+			char hardware[96];
+			snprintf(hardware, sizeof(hardware), "TeensySwgeInspector %08" PRIX32 "%08" PRIX32 ", firmware %.*s",
+					 header.deviceId[1], header.deviceId[0], (int)sizeof(header.firmware), header.firmware);
+			pcap.begin(out, "logpcap", reader.version() ? hardware : nullptr,
+					   "Timestamps are time since the capture device started");
+
+			for (int i = 0; i < 3; i++)
+			{
+				char name[16];
+				char description[64] = "";
+				snprintf(name, sizeof(name), "radio%d", 37 + i);
+				for (uint8_t r = 0; r < header.radioCount && r < LOG_RADIO_COUNT_MAX; r++)
+					if (header.radios[r].outputType == OUTPUT_TYPE_RADIO_PACKET_37 + i)
+						snprintf(description, sizeof(description), "channel %u, access address %08" PRIX32 ", %" PRIu32 " baud",
+								 header.radios[r].channel, header.radios[r].accessAddress, header.radios[r].baudRate);
+				pcap.addInterface(LINKTYPE_BLUETOOTH_LE_LL_WITH_PHDR, name, description);
+			}
+			pcap.addInterface(LINKTYPE_USER0, "gps", "NMEA sentences");
+			started = true;
+		}
+
+		uint8_t frame[sizeof(ble_phdr_t) + BLE_ACCESS_ADDRESS_SIZE + 2 + 255 + BLE_CRC_SIZE];
+		ble_phdr_t phdr = {};
+
+		decodeLog(reader, [&](const log_record_t &record, const decoded_packet_t *packet) {
+			uint64_t time = logTime(record.millis, record.microsFraction);
+
+			if (record.type == OUTPUT_TYPE_NMEA_SENTENCE)
+			{
+				size_t length = record.length;
+				while (length && (record.payload[length - 1] == '\n' || record.payload[length - 1] == '\r'))
+					length--;
+				pcap.packet(NMEA_INTERFACE, time, record.payload, record.length, 0, (const char *)record.payload, length);
+				return;
+			}
+
+			// Repeat summaries have no frame to capture
+			if (record.type == OUTPUT_TYPE_SYSTEM_TIMESTAMP || record.type == OUTPUT_TYPE_RADIO_REPEAT)
+				return;
+
+			if (!packet || packet->tag != TAG_DATA)
+			{
+				skipped++;
+				return;
+			}
+
+			phdr.rfChannel = bleRfChannel(packet->channel);
+			phdr.signalPower = packet->rssi;
+			phdr.referenceAccessAddress = packet->accessAddress;
+			phdr.flags = BLE_PHDR_DEWHITENED | BLE_PHDR_SIGNAL_POWER_VALID | BLE_PHDR_REFERENCE_AA_VALID | BLE_PHDR_CRC_CHECKED;
+			if (packet->flags & RADIO_FLAG_CRC_OK)
+				phdr.flags |= BLE_PHDR_CRC_VALID;
+			if (packet->channel < 37)
+			{
+				uint8_t direction = packet->flags & RADIO_FLAG_DIRECTION_MASK;
+				if (direction == DIRECTION_MASTER)
+					phdr.flags |= BLE_PHDR_PDU_MASTER_TO_SLAVE;
+				else if (direction == DIRECTION_SLAVE)
+					phdr.flags |= BLE_PHDR_PDU_SLAVE_TO_MASTER;
+			}
+
+			// Pseudo header, access address, PDU header and payload, CRC
+			const uint8_t *pdu = packet->pdu - 2;
+			size_t pduLength = 2 + packet->pduLength;
+			uint8_t *p = frame;
+			memcpy(p, &phdr, sizeof(phdr));
+			p += sizeof(phdr);
+			memcpy(p, &packet->accessAddress, BLE_ACCESS_ADDRESS_SIZE);
+			p += BLE_ACCESS_ADDRESS_SIZE;
+			memcpy(p, pdu, pduLength);
+			p += pduLength;
+			if ((packet->flags & RADIO_FLAG_CRC_OK) && packet->accessAddress == BLE_ADVERTISING_ACCESS_ADDRESS)
+				bleCrc(pdu, pduLength, BLE_ADVERTISING_CRC_INIT, p);
+			else
+				memset(p, 0, BLE_CRC_SIZE);
+			p += BLE_CRC_SIZE;
+
+			uint32_t flags = PCAPNG_EPB_INBOUND | (packet->flags & RADIO_FLAG_CRC_OK ? 0 : PCAPNG_EPB_CRC_ERROR);
+			static const char missed[] = "packets missed before this one";
+			bool wasMissed = packet->flags & RADIO_FLAG_MISSED;
+			pcap.packet(record.type - OUTPUT_TYPE_RADIO_PACKET_37, time, frame, p - frame, flags,
+						missed, wasMissed ? sizeof(missed) - 1 : 0);
+		});
+
+		if (reader.badBlocks || reader.unresolvedAddresses)
+			fprintf(stderr, "%s: %" PRIu32 " bad blocks, %" PRIu64 " bytes skipped, %" PRIu32 " unresolved addresses\n",
+					path, reader.badBlocks, reader.skippedBytes, reader.unresolvedAddresses);
+	}
+
+	if (fclose(out) != 0)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+
+	fprintf(stderr, "%s: %" PRIu64 " packets, %" PRIu64 " bytes", output.c_str(), pcap.packets, pcap.bytesWritten);
+	if (skipped)
+		fprintf(stderr, ", %" PRIu64 " frames that are not radio packets left out", skipped);
+	fprintf(stderr, "\n");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,483 @@
+#ifndef __LOGREADER_H_
+#define __LOGREADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "blockcompress.h"
+#include "logformat.h"
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t millis;
+	uint16_t microsFraction;
+	// NMEA sentence, radio frame or stored repeat summary, empty for
+	// timestamps
+	const uint8_t *payload;
+	uint32_t length;
+} log_record_t;
+
+typedef struct
+{
+	// Offset of the block in the file
+	size_t offset;
+	log_block_header_t header;
+	// Its records, decompressed if they were stored compressed
+	const uint8_t *records;
+	size_t length;
+} log_block_t;
+
+inline const char *recordTypeName(uint8_t type)
+{
+	switch (type)
+	{
+	case OUTPUT_TYPE_SYSTEM_TIMESTAMP:
+		return "timestamp";
+	case OUTPUT_TYPE_NMEA_SENTENCE:
+		return "nmea";
+	case OUTPUT_TYPE_RADIO_PACKET_37:
+		return "radio37";
+	case OUTPUT_TYPE_RADIO_PACKET_38:
+		return "radio38";
+	case OUTPUT_TYPE_RADIO_PACKET_39:
+		return "radio39";
+	case OUTPUT_TYPE_RADIO_REPEAT:
+		return "repeat";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+	Reads the records of a capture log held in memory, of any version up
+	to LOG_FORMAT_VERSION, always giving the absolute time of each record
+	and whole radio frames.
+	Blocks are checked on their own: a damaged one is skipped and reading
+	carries on with the next, found at the next block size in versions 1
+	and 2 and by scanning sector by sector for a valid block in version 3.
+	A version 0 file stops at the first record it cannot make sense of.
+*/
+class LogReader
+{
+private:
+	const uint8_t *data;
+	size_t size;
+	uint16_t formatVersion;
+	log_file_header_t fileHeader;
+	size_t blockSize;
+
+	size_t blockOffset;
+	bool resyncing;
+	std::vector<uint8_t> raw;
+
+	const uint8_t *pos;
+	const uint8_t *end;
+	// Time of the last record, in microseconds
+	uint64_t time;
+
+	uint8_t addresses[256][LOG_ADDRESS_SIZE];
+	bool addressKnown[256];
+	uint32_t expectedSequence;
+	std::vector<uint8_t> frame;
+
+	// Block the records being read came from, and whether reading can
+	// start there without the blocks before it
+	size_t recordBlockOffset;
+	bool recordBlockFresh;
+	// The next block is the first since seek()
+	bool seeking;
+
+	/*
+		Put the address back into a frame logged with a slot in its place.
+		Returns false if the slot is not known.
+	*/
+	bool resolveAddress(log_record_t &record)
+	{
+		uint8_t slot = record.payload[0];
+		if (!addressKnown[slot])
+			return false;
+
+		const uint8_t *rest = record.payload + 1;
+		record.length += LOG_ADDRESS_SIZE - 1;
+		frame.resize(record.length);
+
+		memcpy(frame.data(), rest, LOG_ADDRESS_OFFSET);
+		memcpy(frame.data() + LOG_ADDRESS_OFFSET, addresses[slot], LOG_ADDRESS_SIZE);
+		memcpy(frame.data() + LOG_ADDRESS_OFFSET + LOG_ADDRESS_SIZE, rest + LOG_ADDRESS_OFFSET,
+			   record.length - LOG_ADDRESS_OFFSET - LOG_ADDRESS_SIZE);
+
+		record.type &= ~LOG_TYPE_ADDRESS_REF;
+		record.payload = frame.data();
+		return true;
+	}
+
+	/*
+		Keep the address table in step with the block about to be read
+	*/
+	void enterBlock(const log_block_header_t &header)
+	{
+		uint16_t resetBlocks = fileHeader.addressResetBlocks;
+		recordBlockFresh = seeking || formatVersion < 4 || header.sequence != expectedSequence ||
+						   (resetBlocks && header.sequence % resetBlocks == 0);
+		if (recordBlockFresh)
+			memset(addressKnown, 0, sizeof(addressKnown));
+		seeking = false;
+		expectedSequence = header.sequence + 1;
+	}
+
+	/*
+		Decode the record at p, returning its size or 0 if it is
+		malformed or runs past limit
+	*/
+	size_t parseRecord(const uint8_t *p, const uint8_t *limit, log_record_t &record)
+	{
+		const uint8_t *start = p;
+		if (p == limit)
+			return 0;
+
+		record.type = *p++;
+		if (formatVersion < 4 && (record.type & (LOG_TYPE_ADDRESS_REF | LOG_TYPE_ADDRESS_DEFINE)))
+			return 0;
+
+		if (formatVersion < 2 || record.type == OUTPUT_TYPE_SYSTEM_TIMESTAMP)
+		{
+			if (limit - p < 6)
+				return 0;
+
+			memcpy(&record.millis, p, 4);
+			memcpy(&record.microsFraction, p + 4, 2);
+			p += 6;
+			time = logTime(record.millis, record.microsFraction);
+		}
+		else
+		{
+			int64_t delta;
+			size_t deltaSize = decodeDelta(p, limit, delta);
+			if (!deltaSize)
+				return 0;
+
+			p += deltaSize;
+			time += delta;
+			record.millis = (uint32_t)(time / 1000);
+			record.microsFraction = time % 1000;
+		}
+
+		switch (record.type)
+		{
+		case OUTPUT_TYPE_SYSTEM_TIMESTAMP:
+			record.length = 0;
+			break;
+
+		case OUTPUT_TYPE_NMEA_SENTENCE:
+			if (limit - p < 1)
+				return 0;
+			record.length = *p++;
+			break;
+
+		case OUTPUT_TYPE_RADIO_REPEAT:
+			if (formatVersion < 5 || limit - p < 1)
+				return 0;
+			record.length = *p++;
+			break;
+
+		case OUTPUT_TYPE_RADIO_PACKET_37:
+		case OUTPUT_TYPE_RADIO_PACKET_38:
+		case OUTPUT_TYPE_RADIO_PACKET_39:
+			if (limit - p < 4)
+				return 0;
+			memcpy(&record.length, p, 4);
+			p += 4;
+			break;
+
+		case OUTPUT_TYPE_RADIO_PACKET_37 | LOG_TYPE_ADDRESS_DEFINE:
+		case OUTPUT_TYPE_RADIO_PACKET_38 | LOG_TYPE_ADDRESS_DEFINE:
+		case OUTPUT_TYPE_RADIO_PACKET_39 | LOG_TYPE_ADDRESS_DEFINE:
+		case OUTPUT_TYPE_RADIO_PACKET_37 | LOG_TYPE_ADDRESS_REF:
+		case OUTPUT_TYPE_RADIO_PACKET_38 | LOG_TYPE_ADDRESS_REF:
+		case OUTPUT_TYPE_RADIO_PACKET_39 | LOG_TYPE_ADDRESS_REF:
+			// Left as the slot and what is stored of the frame for next()
+			if (limit - p < 4)
+				return 0;
+			memcpy(&record.length, p, 4);
+			p += 4;
+			if (record.length < LOG_ADDRESS_OFFSET + LOG_ADDRESS_SIZE)
+				return 0;
+			record.length += 1;
+			if (record.type & LOG_TYPE_ADDRESS_REF)
+				record.length -= LOG_ADDRESS_SIZE;
+			break;
+
+		default:
+			return 0;
+		}
+
+		if (record.length > (size_t)(limit - p))
+			return 0;
+
+		record.payload = p;
+		return p + record.length - start;
+	}
+
+	bool blockValid(const uint8_t *block, const log_block_header_t &header, size_t stride) const
+	{
+		return header.sync == LOG_BLOCK_SYNC &&
+			   header.payloadLength <= blockSize - sizeof(header) &&
+			   header.rawLength <= blockSize &&
+			   stride <= size - blockOffset &&
+			   header.crc == blockCrc(block);
+	}
+
+public:
+	uint32_t blocks;
+	// Stretches of damaged blocks skipped
+	uint32_t badBlocks;
+	uint64_t skippedBytes;
+	// Records in the blocks read, and the file bytes those blocks took
+	uint64_t recordBytes;
+	uint64_t storedBytes;
+	// Frames dropped for referring to an address lost with a damaged block
+	uint32_t unresolvedAddresses;
+
+	LogReader(const uint8_t *data, size_t size)
+		: data(data), size(size), formatVersion(0), fileHeader(), blockSize(0),
+		  blockOffset(0), resyncing(false), pos(data), end(data + size), time(0),
+		  expectedSequence(0), recordBlockOffset(0), recordBlockFresh(true), seeking(true),
+		  blocks(0), badBlocks(0), skippedBytes(0), recordBytes(0), storedBytes(0), unresolvedAddresses(0)
+	{
+		memset(addressKnown, 0, sizeof(addressKnown));
+
+		if (size < LOG_FILE_HEADER_SIZE || !checkFileHeaderSector(data))
+			return;
+
+		memcpy(&fileHeader, data, sizeof(fileHeader));
+		formatVersion = fileHeader.version;
+		blockSize = fileHeader.blockSize;
+		blockOffset = fileHeader.headerSize;
+		pos = end = data;
+		raw.resize(blockSize);
+	}
+
+	/*
+		0 for a headerless file, otherwise the version in its header
+	*/
+	uint16_t version() const { return formatVersion; }
+
+	/*
+		The file header; all zero for version 0
+	*/
+	const log_file_header_t &header() const { return fileHeader; }
+
+	/*
+		Whether this reader understands the file's layout
+	*/
+	bool supported() const { return formatVersion <= LOG_FORMAT_VERSION && (formatVersion == 0 || blockSize > sizeof(log_block_header_t)); }
+
+	/*
+		Read the next valid block of a version 1 or later file. Returns
+		false at the end of the file. The records stay valid until the
+		next call.
+	*/
+	bool nextBlock(log_block_t &block)
+	{
+		if (formatVersion == 0 || !supported())
+			return false;
+
+		while (blockOffset < size && size - blockOffset >= sizeof(log_block_header_t))
+		{
+			const uint8_t *p = data + blockOffset;
+			log_block_header_t header;
+			memcpy(&header, p, sizeof(header));
+
+			size_t stride = formatVersion >= 3 ? blockStride(header) : blockSize;
+			bool valid = blockValid(p, header, stride);
+
+			const uint8_t *records = p + sizeof(header);
+			size_t length = header.payloadLength;
+			if (valid && header.rawLength)
+			{
+				records = raw.data();
+				length = blockDecompress(p + sizeof(header), header.payloadLength, raw.data(), raw.size());
+				valid = length == header.rawLength;
+			}
+
+			if (!valid)
+			{
+				if (!resyncing)
+					badBlocks++;
+				resyncing = true;
+
+				size_t step = formatVersion >= 3 ? LOG_SECTOR_SIZE : blockSize;
+				step = step < size - blockOffset ? step : size - blockOffset;
+				skippedBytes += step;
+				blockOffset += step;
+				continue;
+			}
+
+			resyncing = false;
+			block.offset = blockOffset;
+			block.header = header;
+			block.records = records;
+			block.length = length;
+
+			blockOffset += stride;
+			blocks++;
+			recordBytes += length;
+			storedBytes += stride;
+			return true;
+		}
+
+		skippedBytes += size - blockOffset;
+		blockOffset = size;
+		return false;
+	}
+
+	/*
+		Carry on reading from the block at offset, as found by nextBlock()
+		or an index. Address slots are forgotten, so frames referring to
+		slots defined before offset are dropped as unresolved. In a
+		version 0 file offset is that of a record.
+	*/
+	void seek(size_t offset)
+	{
+		if (formatVersion == 0)
+		{
+			pos = data + (offset < size ? offset : size);
+			end = data + size;
+			return;
+		}
+
+		blockOffset = offset < size ? offset : size;
+		resyncing = false;
+		pos = end = data;
+		seeking = true;
+	}
+
+	/*
+		Offset of the block the last record came from, or of the record
+		itself in a version 0 file, and whether that block started with no
+		address slots known, so seek() to it reads every frame
+	*/
+	size_t recordBlock() const { return recordBlockOffset; }
+	bool recordBlockSelfContained() const { return recordBlockFresh; }
+
+	/*
+		Read the next record. Returns false at the end of the file.
+	*/
+	bool next(log_record_t &record)
+	{
+		if (!supported())
+			return false;
+
+		for (;;)
+		{
+			if (pos < end)
+			{
+				if (formatVersion == 0)
+					recordBlockOffset = pos - data;
+				size_t length = parseRecord(pos, end, record);
+				if (length)
+				{
+					pos += length;
+
+					if (record.type & LOG_TYPE_ADDRESS_DEFINE)
+					{
+						uint8_t slot = record.payload[0];
+						addressKnown[slot] = true;
+						memcpy(addresses[slot], record.payload + 1 + LOG_ADDRESS_OFFSET, LOG_ADDRESS_SIZE);
+						record.type &= ~LOG_TYPE_ADDRESS_DEFINE;
+						record.payload++;
+						record.length--;
+					}
+					else if ((record.type & LOG_TYPE_ADDRESS_REF) && !resolveAddress(record))
+					{
+						unresolvedAddresses++;
+						continue;
+					}
+
+					return true;
+				}
+
+				// Valid blocks never hold one; a version 0 file ends here
+				skippedBytes += end - pos;
+				pos = end;
+				if (formatVersion == 0)
+					return false;
+			}
+
+			log_block_t block;
+			if (formatVersion == 0 || !nextBlock(block))
+				return false;
+
+			pos = block.records;
+			end = pos + block.length;
+			time = logTime(block.header.firstMillis, block.header.firstMicrosFraction);
+			recordBlockOffset = block.offset;
+			enterBlock(block.header);
+		}
+	}
+};
+
+/*
+	Radio packets in a log, a repeat record counting as the frames it
+	stands for
+*/
+inline uint64_t countRadioPackets(const uint8_t *log, size_t logSize)
+{
+	LogReader reader(log, logSize);
+	log_record_t record;
+	uint64_t packets = 0;
+	while (reader.next(record))
+	{
+		if (record.type >= OUTPUT_TYPE_RADIO_PACKET_37 && record.type <= OUTPUT_TYPE_RADIO_PACKET_39)
+			packets++;
+
+		log_repeat_t repeat;
+		if (record.type == OUTPUT_TYPE_RADIO_REPEAT && decodeRepeat(record.payload, record.length, repeat))
+			for (uint8_t i = 0; i < LOG_REPEAT_CHANNELS; i++)
+				packets += repeat.channels[i].count;
+	}
+	return packets;
+}
+
+// Records a version 0 boundary must be followed by, and the time they
+// may span
+#define LOG_CHUNK_RESYNC_RECORDS (8)
+#define LOG_CHUNK_RESYNC_MILLIS (60000)
+#define LOG_CHUNK_RESYNC_WINDOW (4096)
+
+/*
+	Whether the records of a version 0 log look to start at p
+*/
+inline bool logRecordsStartAt(const uint8_t *data, size_t size, size_t p)
+{
+	size_t window = std::min<size_t>(LOG_CHUNK_RESYNC_WINDOW, size - p);
+	LogReader probe(data + p, window);
+	if (probe.version() != 0)
+		return false;
+
+	log_record_t record;
+	uint32_t firstMillis = 0;
+	uint32_t previousMillis = 0;
+	int records = 0;
+	while (records < LOG_CHUNK_RESYNC_RECORDS && probe.next(record))
+	{
+		if (record.microsFraction >= 1000)
+			return false;
+		if (records == 0)
+			firstMillis = record.millis;
+		else if (record.millis < previousMillis || record.millis - firstMillis > LOG_CHUNK_RESYNC_MILLIS)
+			return false;
+		previousMillis = record.millis;
+		records++;
+	}
+
+	// Fewer records are fine if they run exactly to the end of the file
+	return records == LOG_CHUNK_RESYNC_RECORDS || (window == size - p && probe.skippedBytes == 0 && records > 0);
+}
+
+#endif // __LOGREADER_H_
@@ -0,0 +1,128 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "logrecover.h"
+#include "mappedfile.h"
+
+/*
+	Writes a clean copy of a damaged capture log, such as one cut short
+	when the battery ran out, holding everything that can still be read
+	(see logrecover.h), and reports each stretch of the input left out.
+	The input is never changed.
+
+	Usage:
+		logrecover [-o OUTPUT] [--report FILE] FILE
+
+	The output defaults to FILE with ".recovered.bin" in place of its
+	extension, the report to standard output. Exits with 0 if nothing was
+	lost, 3 if the clean file lacks something, 1 if there was nothing to
+	recover or it could not be written.
+*/
+
+static std::string defaultOutput(const char *input)
+{
+	std::string path = input;
+	size_t dot = path.rfind('.');
+	if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+		path.resize(dot);
+	return path + ".recovered.bin";
+}
+
+int main(int argc, char **argv)
+{
+	const char *outputPath = nullptr;
+	const char *reportPath = nullptr;
+	const char *path = nullptr;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "-o"))
+			outputPath = argv[++i];
+		else if (i + 1 < argc && !strcmp(argv[i], "--report"))
+			reportPath = argv[++i];
+		else if (!path)
+			path = argv[i];
+		else
+			usage = true;
+	}
+
+	if (!path || usage)
+	{
+		fprintf(stderr, "usage: logrecover [-o OUTPUT] [--report FILE] FILE\n");
+		return 2;
+	}
+
+	MappedFile file;
+	if (!file.open(path))
+	{
+		perror(path);
+		return 1;
+	}
+
+	LogRecovery recovery(file.data(), file.size());
+	if (!recovery.recoverable())
+	{
+		fprintf(stderr, "%s: file header damaged or format not supported\n", path);
+		return 1;
+	}
+
+	std::string output = outputPath ? outputPath : defaultOutput(path);
+	if (output == path)
+	{
+		fprintf(stderr, "%s: refusing to write over the input\n", path);
+		return 1;
+	}
+
+	FILE *out = fopen(output.c_str(), "wb");
+	if (!out)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+	static char outBuffer[1 << 20];
+	setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+	bool written = recovery.recover(out);
+	if (fclose(out) != 0 || !written)
+	{
+		perror(output.c_str());
+		return 1;
+	}
+
+	FILE *report = reportPath ? fopen(reportPath, "w") : stdout;
+	if (!report)
+	{
+		perror(reportPath);
+		return 1;
+	}
+
+	fprintf(report, "%s: version %u, %zu bytes\n", path, recovery.version(), file.size());
+	for (const log_loss_t &loss : recovery.losses)
+	{
+		fprintf(report, "  at %10" PRIu64 ": %10" PRIu64 " bytes, %s", loss.offset, loss.length, logLossName(loss.reason));
+		if (loss.reason == LOG_LOSS_UNRESOLVED_FRAMES)
+			fprintf(report, " (%" PRIu32 ")", loss.records);
+		else if (loss.records)
+			fprintf(report, ", %" PRIu32 " records before it kept", loss.records);
+		fprintf(report, "\n");
+	}
+
+	if (recovery.version())
+		fprintf(report, "%" PRIu32 " blocks kept as they were, %" PRIu32 " sealed again without %" PRIu32
+						" frames, %" PRIu32 " partial with %" PRIu32 " records\n",
+				recovery.blocksKept, recovery.blocksRewritten, recovery.framesDropped,
+				recovery.blocksSalvaged, recovery.recordsSalvaged);
+	else
+		fprintf(report, "%" PRIu64 " records kept\n", recovery.recordsKept);
+	fprintf(report, "%" PRIu64 " bytes lost in %zu places; wrote %s, %" PRIu64 " bytes\n",
+			recovery.lostBytes, recovery.losses.size(), output.c_str(), recovery.bytesWritten);
+
+	if (report != stdout)
+		fclose(report);
+	return recovery.losses.empty() ? 0 : 3;
+}
@@ -0,0 +1,674 @@
+#ifndef __LOGRECOVER_H_
+#define __LOGRECOVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "blockcompress.h"
+#include "logchunks.h"
+#include "logformat.h"
+#include "packet.h"
+
+/*
+	Salvaging what can be read of a damaged capture log into a clean one,
+	for files cut short by power loss mid-write and the like.
+
+	Logs with blocks are carried over block by block. Blocks whose CRC
+	holds are copied as they are. A block whose CRC fails, the usual
+	state of the last block of a torn file, keeps the records at its
+	front as long as each parses, looks like what the firmware writes
+	and follows the one before in time; they are sealed again as a block
+	of their own. Nothing checks the bytes inside those records, which is
+	sound for a torn write, where whole sectors are missing, but not for
+	damage in place. Compressed blocks cannot be cut short, so a damaged
+	one is dropped whole, as is anything between valid blocks.
+
+	Once something is dropped, the reader of the clean file no longer
+	knows the address slots defined in it, so frames referring to them
+	are left out of the blocks that follow until the next table reset,
+	and those blocks sealed again.
+
+	Version 0 logs are carried over record by record with the same checks,
+	finding the next run of plausible records after anything that fails.
+
+	Every stretch of input not carried over is reported.
+*/
+
+// Largest jump in time between neighbouring records taken as plausible
+#define LOG_RECOVER_TIME_WINDOW_MICROS (60000000ULL)
+
+enum
+{
+	LOG_LOSS_DAMAGED,
+	LOG_LOSS_CUT_SHORT,
+	LOG_LOSS_PARTIAL_BLOCK,
+	// Frames left out of a valid block, at the block's offset
+	LOG_LOSS_UNRESOLVED_FRAMES,
+};
+
+typedef struct
+{
+	uint64_t offset;
+	uint64_t length;
+	uint8_t reason;
+	// Records kept from a partial block, or frames dropped
+	uint32_t records;
+} log_loss_t;
+
+inline const char *logLossName(uint8_t reason)
+{
+	switch (reason)
+	{
+	case LOG_LOSS_DAMAGED:
+		return "damaged";
+	case LOG_LOSS_CUT_SHORT:
+		return "cut short";
+	case LOG_LOSS_PARTIAL_BLOCK:
+		return "rest of a damaged block";
+	case LOG_LOSS_UNRESOLVED_FRAMES:
+		return "frames referring to lost address slots";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+	A record as stored, with its absolute time
+*/
+typedef struct
+{
+	uint8_t type;
+	uint64_t time;
+	// The time stamp, then what follows it, stored as it is
+	const uint8_t *stamp;
+	const uint8_t *body;
+	size_t bodyLength;
+} log_raw_record_t;
+
+/*
+	Whether a radio frame's headers agree with its logged length. Only
+	the bytes up to the address are looked at, as frames stored with an
+	address slot have the address taken out after them.
+*/
+inline bool framePlausible(const uint8_t *frame, size_t stored, uint32_t length)
+{
+	packet_header_t header;
+	if (length < sizeof(header) || stored < sizeof(header))
+		return false;
+
+	memcpy(&header, frame, sizeof(header));
+	if (sizeof(header) + header.length != length)
+		return false;
+
+	switch (header.tag)
+	{
+	case TAG_DATA:
+		// Radio header, then a PDU header whose length byte fits the rest
+		return stored >= LOG_ADDRESS_OFFSET &&
+			   frame[sizeof(header) + offsetof(radio_t, channel)] <= 39 &&
+			   frame[LOG_ADDRESS_OFFSET - 1] <= length - LOG_ADDRESS_OFFSET;
+
+	case TAG_MSG_RESET_COMPLETE:
+	case TAG_MSG_CONNECT_REQUEST:
+	case TAG_MSG_CONNECTION_EVENT:
+	case TAG_MSG_CONN_PARAM_UPDATE:
+	case TAG_MSG_CHAN_MAP_UPDATE:
+	case TAG_MSG_TERMINATE:
+	case TAG_MSG_LOG:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/*
+	Whether an NMEA record holds something like a sentence
+*/
+inline bool sentencePlausible(const uint8_t *sentence, size_t length)
+{
+	if (length == 0 || (sentence[0] != '$' && sentence[0] != '!'))
+		return false;
+
+	for (size_t i = 1; i < length; i++)
+		if ((sentence[i] < 0x20 || sentence[i] > 0x7E) && sentence[i] != '\r' && sentence[i] != '\n')
+			return false;
+	return true;
+}
+
+inline bool timePlausible(uint64_t previous, uint64_t time)
+{
+	uint64_t jump = time > previous ? time - previous : previous - time;
+	return jump <= LOG_RECOVER_TIME_WINDOW_MICROS;
+}
+
+/*
+	Parse the record at p as stored in a log of the given version, time
+	being that of the record before it. Strict parsing also checks the
+	payload looks like what the firmware writes. Returns the record's
+	size, or 0 if it runs past limit or is not a record.
+*/
+inline size_t parseRawRecord(const uint8_t *p, const uint8_t *limit, uint16_t version, uint64_t time,
+							 bool strict, log_raw_record_t &record)
+{
+	const uint8_t *start = p;
+	if (p == limit)
+		return 0;
+
+	record.type = *p++;
+	uint8_t type = record.type & ~(LOG_TYPE_ADDRESS_REF | LOG_TYPE_ADDRESS_DEFINE);
+	bool slotted = type != record.type;
+	if (slotted && (version < 4 || type < OUTPUT_TYPE_RADIO_PACKET_37 || type > OUTPUT_TYPE_RADIO_PACKET_39 ||
+					(record.type & LOG_TYPE_ADDRESS_REF && record.type & LOG_TYPE_ADDRESS_DEFINE)))
+		return 0;
+
+	record.stamp = p;
+	if (version < 2 || type == OUTPUT_TYPE_SYSTEM_TIMESTAMP)
+	{
+		uint32_t millis;
+		uint16_t microsFraction;
+		if (limit - p < 6)
+			return 0;
+
+		memcpy(&millis, p, 4);
+		memcpy(&microsFraction, p + 4, 2);
+		if (strict && microsFraction >= 1000)
+			return 0;
+		record.time = logTime(millis, microsFraction);
+		p += 6;
+	}
+	else
+	{
+		int64_t delta;
+		size_t deltaSize = decodeDelta(p, limit, delta);
+		if (!deltaSize)
+			return 0;
+		record.time = time + delta;
+		p += deltaSize;
+	}
+	record.body = p;
+
+	switch (type)
+	{
+	case OUTPUT_TYPE_SYSTEM_TIMESTAMP:
+		record.bodyLength = 0;
+		break;
+
+	case OUTPUT_TYPE_NMEA_SENTENCE:
+		if (limit - p < 1 || *p > limit - p - 1)
+			return 0;
+		if (strict && !sentencePlausible(p + 1, *p))
+			return 0;
+		record.bodyLength = 1 + *p;
+		break;
+
+	case OUTPUT_TYPE_RADIO_REPEAT:
+	{
+		log_repeat_t repeat;
+		if (version < 5 || limit - p < 1 || *p > limit - p - 1)
+			return 0;
+		if (strict && !decodeRepeat(p + 1, *p, repeat))
+			return 0;
+		record.bodyLength = 1 + *p;
+		break;
+	}
+
+	case OUTPUT_TYPE_RADIO_PACKET_37:
+	case OUTPUT_TYPE_RADIO_PACKET_38:
+	case OUTPUT_TYPE_RADIO_PACKET_39:
+	{
+		uint32_t length;
+		if (limit - p < 4 + slotted)
+			return 0;
+		memcpy(&length, p, 4);
+
+		// Frame length, the slot if any, then what is stored of the frame
+		const uint8_t *frame = p + 4 + slotted;
+		size_t stored = length;
+		if (slotted)
+		{
+			if (length < LOG_ADDRESS_OFFSET + LOG_ADDRESS_SIZE)
+				return 0;
+			if (record.type & LOG_TYPE_ADDRESS_REF)
+				stored -= LOG_ADDRESS_SIZE;
+		}
+		if (stored > (size_t)(limit - frame))
+			return 0;
+		if (strict && !framePlausible(frame, stored, length))
+			return 0;
+		record.bodyLength = frame + stored - p;
+		break;
+	}
+
+	default:
+		return 0;
+	}
+
+	return p + record.bodyLength - start;
+}
+
+/*
+	Whether the records of a version 0 log look to start at p: a run of
+	LOG_CHUNK_RESYNC_RECORDS plausible ones, or fewer running exactly to
+	the end of the data
+*/
+inline bool plausibleRecordsAt(const uint8_t *data, size_t size, size_t p)
+{
+	const uint8_t *q = data + p;
+	const uint8_t *end = data + size;
+	uint64_t time = 0;
+	int records = 0;
+
+	log_raw_record_t record;
+	while (records < LOG_CHUNK_RESYNC_RECORDS && q < end)
+	{
+		size_t length = parseRawRecord(q, end, 0, time, true, record);
+		if (!length || (records && !timePlausible(time, record.time)))
+			return false;
+		time = record.time;
+		q += length;
+		records++;
+	}
+	return records > 0;
+}
+
+class LogRecovery
+{
+private:
+	const uint8_t *data;
+	size_t size;
+	FILE *out;
+	uint16_t formatVersion;
+	log_file_header_t fileHeader;
+	size_t blockSize;
+
+	// Whether the reader of the clean file can have lost address slots,
+	// and the slots defined since
+	bool tainted;
+	bool slotKnown[256];
+	uint32_t expectedSequence;
+
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> records;
+	std::vector<uint8_t> sealed;
+	std::vector<uint16_t> hashTable;
+
+	// What keepRecords() took
+	uint16_t keptRecords;
+	uint64_t keptFirstTime;
+	size_t consumed;
+	uint32_t droppedFrames;
+	uint64_t droppedBytes;
+
+	void put(const void *bytes, size_t length)
+	{
+		if (length && fwrite(bytes, 1, length, out) != length)
+			writeFailed = true;
+		bytesWritten += length;
+	}
+
+	void lose(uint64_t offset, uint64_t length, uint8_t reason, uint32_t count = 0)
+	{
+		losses.push_back({offset, length, reason, count});
+		lostBytes += length;
+	}
+
+	/*
+		Track the address slots the reader of the clean file will know
+		as it enters a block
+	*/
+	void enterBlock(const log_block_header_t &header)
+	{
+		uint16_t resetBlocks = fileHeader.addressResetBlocks;
+		if (formatVersion < 4 || !resetBlocks || header.sequence % resetBlocks == 0)
+			tainted = false;
+		else if (header.sequence != expectedSequence)
+		{
+			tainted = true;
+			memset(slotKnown, 0, sizeof(slotKnown));
+		}
+		expectedSequence = header.sequence + 1;
+	}
+
+	/*
+		Re-encode the records of length bytes at p into records, from a
+		block starting at blockTime and holding at most count records,
+		leaving out frames referring to slots the reader will not know.
+		Strictly, records must also look plausible.
+	*/
+	void keepRecords(const uint8_t *p, size_t length, uint64_t blockTime, uint16_t count, bool strict)
+	{
+		const uint8_t *q = p;
+		const uint8_t *limit = p + length;
+		uint64_t time = blockTime;
+		uint64_t keptTime = 0;
+
+		records.clear();
+		keptRecords = 0;
+		droppedFrames = 0;
+		droppedBytes = 0;
+
+		log_raw_record_t record;
+		for (uint16_t i = 0; i < count && q < limit; i++)
+		{
+			size_t size = parseRawRecord(q, limit, formatVersion, time, strict, record);
+			if (!size || (strict && !timePlausible(time, record.time)))
+				break;
+			q += size;
+			time = record.time;
+
+			if (record.type & (LOG_TYPE_ADDRESS_REF | LOG_TYPE_ADDRESS_DEFINE))
+			{
+				uint8_t slot = record.body[4];
+				if (record.type & LOG_TYPE_ADDRESS_DEFINE)
+					slotKnown[slot] = true;
+				else if (tainted && !slotKnown[slot])
+				{
+					droppedFrames++;
+					droppedBytes += size;
+					continue;
+				}
+			}
+
+			// Absolute stamps stay, differences are from the record kept before
+			records.push_back(record.type);
+			if (formatVersion < 2 || record.type == OUTPUT_TYPE_SYSTEM_TIMESTAMP)
+				records.insert(records.end(), record.stamp, record.body);
+			else
+			{
+				uint8_t stamp[LOG_VARINT_SIZE_MAX];
+				size_t stampSize = encodeDelta(stamp, keptRecords ? (int64_t)(record.time - keptTime) : 0);
+				records.insert(records.end(), stamp, stamp + stampSize);
+			}
+			records.insert(records.end(), record.body, record.body + record.bodyLength);
+
+			if (!keptRecords)
+				keptFirstTime = record.time;
+			keptTime = record.time;
+			keptRecords++;
+		}
+
+		if (!keptRecords)
+			keptFirstTime = blockTime;
+		consumed = q - p;
+	}
+
+	/*
+		Write records as a block with the given sequence, compressed if
+		compress and that is smaller
+	*/
+	void sealBlock(uint32_t sequence, bool compress)
+	{
+		log_block_header_t header = {};
+		header.sync = LOG_BLOCK_SYNC;
+		header.sequence = sequence;
+		header.recordCount = keptRecords;
+		header.payloadLength = records.size();
+		header.firstMillis = keptFirstTime / 1000;
+		header.firstMicrosFraction = keptFirstTime % 1000;
+
+		size_t capacity = blockSize + BLOCK_COMPRESS_BOUND(blockSize);
+		sealed.assign(capacity, 0);
+		uint8_t *payload = sealed.data() + sizeof(header);
+
+		size_t compressed = compress && !records.empty() ? blockCompress(records.data(), records.size(), payload, hashTable.data()) : 0;
+		if (compressed && compressed < records.size())
+		{
+			header.payloadLength = compressed;
+			header.rawLength = records.size();
+		}
+		else
+			memcpy(payload, records.data(), records.size());
+
+		size_t stride = formatVersion >= 3 ? blockStride(header) : blockSize;
+		memset(payload + header.payloadLength, 0, stride - sizeof(header) - header.payloadLength);
+		memcpy(sealed.data(), &header, sizeof(header));
+		header.crc = blockCrc(sealed.data());
+		memcpy(sealed.data(), &header, sizeof(header));
+
+		put(sealed.data(), stride);
+	}
+
+	bool blockValid(size_t offset, const log_block_header_t &header, size_t stride) const
+	{
+		return header.sync == LOG_BLOCK_SYNC &&
+			   header.payloadLength <= blockSize - sizeof(header) &&
+			   header.rawLength <= blockSize &&
+			   stride <= size - offset &&
+			   header.crc == blockCrc(data + offset);
+	}
+
+	/*
+		Carry over a valid block, as it is unless frames have to go
+	*/
+	void keepBlock(size_t offset, const log_block_header_t &header, size_t stride)
+	{
+		enterBlock(header);
+		if (!tainted)
+		{
+			put(data + offset, stride);
+			blocksKept++;
+			return;
+		}
+
+		const uint8_t *payload = data + offset + sizeof(header);
+		size_t length = header.payloadLength;
+		if (header.rawLength)
+		{
+			int32_t decompressed = blockDecompress(payload, length, raw.data(), raw.size());
+			length = decompressed > 0 ? decompressed : 0;
+			payload = raw.data();
+		}
+
+		keepRecords(payload, length, logTime(header.firstMillis, header.firstMicrosFraction), header.recordCount, false);
+		if (!droppedFrames)
+		{
+			put(data + offset, stride);
+			blocksKept++;
+			return;
+		}
+
+		sealBlock(header.sequence, header.rawLength);
+		blocksRewritten++;
+		lose(offset, droppedBytes, LOG_LOSS_UNRESOLVED_FRAMES, droppedFrames);
+		framesDropped += droppedFrames;
+	}
+
+	/*
+		Keep what is plausible at the front of a damaged block that
+		follows the last one kept. Returns false if nothing is.
+	*/
+	bool salvageBlock(size_t offset, const log_block_header_t &header, size_t stride)
+	{
+		if (header.sync != LOG_BLOCK_SYNC || header.rawLength || header.sequence != expectedSequence ||
+			header.payloadLength > blockSize - sizeof(header) || !header.recordCount)
+			return false;
+
+		bool wasTainted = tainted;
+		bool wasKnown[256];
+		memcpy(wasKnown, slotKnown, sizeof(wasKnown));
+		uint32_t wasExpected = expectedSequence;
+
+		enterBlock(header);
+		size_t available = size - offset - sizeof(header);
+		keepRecords(data + offset + sizeof(header), header.payloadLength < available ? header.payloadLength : available,
+					logTime(header.firstMillis, header.firstMicrosFraction), header.recordCount, true);
+		if (!keptRecords)
+		{
+			tainted = wasTainted;
+			memcpy(slotKnown, wasKnown, sizeof(slotKnown));
+			expectedSequence = wasExpected;
+			return false;
+		}
+
+		sealBlock(header.sequence, false);
+		blocksSalvaged++;
+		recordsSalvaged += keptRecords;
+		uint64_t lostStart = offset + sizeof(header) + consumed;
+		uint64_t blockEnd = offset + (stride < size - offset ? stride : size - offset);
+		lose(lostStart, blockEnd - lostStart, blockEnd == size ? LOG_LOSS_CUT_SHORT : LOG_LOSS_PARTIAL_BLOCK, keptRecords);
+		if (droppedFrames)
+		{
+			lose(offset, droppedBytes, LOG_LOSS_UNRESOLVED_FRAMES, droppedFrames);
+			framesDropped += droppedFrames;
+		}
+
+		// Whatever the rest of the block defined is gone
+		tainted = formatVersion >= 4 && fileHeader.addressResetBlocks;
+		memset(slotKnown, 0, sizeof(slotKnown));
+		return true;
+	}
+
+	void recoverBlocks()
+	{
+		put(data, fileHeader.headerSize);
+		raw.resize(blockSize);
+		hashTable.resize(BLOCK_COMPRESS_HASH_SIZE);
+
+		size_t offset = fileHeader.headerSize;
+		size_t damaged = size;
+		while (size - offset >= sizeof(log_block_header_t))
+		{
+			log_block_header_t header;
+			memcpy(&header, data + offset, sizeof(header));
+			size_t stride = formatVersion >= 3 ? blockStride(header) : blockSize;
+
+			if (blockValid(offset, header, stride))
+			{
+				if (damaged < offset)
+					lose(damaged, offset - damaged, LOG_LOSS_DAMAGED);
+				damaged = size;
+				keepBlock(offset, header, stride);
+				offset += stride;
+				continue;
+			}
+
+			if (salvageBlock(offset, header, stride))
+			{
+				if (damaged < offset)
+					lose(damaged, offset - damaged, LOG_LOSS_DAMAGED);
+				damaged = size;
+				offset += stride < size - offset ? stride : size - offset;
+				continue;
+			}
+
+			if (damaged == size)
+				damaged = offset;
+			size_t step = formatVersion >= 3 ? LOG_SECTOR_SIZE : blockSize;
+			offset += step < size - offset ? step : size - offset;
+		}
+
+		if (damaged > offset)
+			damaged = offset;
+		if (damaged < size)
+			lose(damaged, size - damaged, LOG_LOSS_CUT_SHORT);
+	}
+
+	void recoverRecords()
+	{
+		const uint8_t *end = data + size;
+		size_t p = 0;
+		size_t run = 0;
+		uint64_t time = 0;
+		bool anchored = false;
+
+		log_raw_record_t record;
+		while (p < size)
+		{
+			size_t length = parseRawRecord(data + p, end, 0, time, true, record);
+			if (length && (!anchored || timePlausible(time, record.time)))
+			{
+				p += length;
+				time = record.time;
+				anchored = true;
+				recordsKept++;
+				continue;
+			}
+
+			// Copy the run of good records, then look for the next one
+			put(data + run, p - run);
+			size_t next = p;
+			while (next < size && !plausibleRecordsAt(data, size, next))
+				next++;
+			if (next > p)
+				lose(p, next - p, next == size ? LOG_LOSS_CUT_SHORT : LOG_LOSS_DAMAGED);
+			p = run = next;
+			anchored = false;
+
+			if (p < size)
+			{
+				// A run of plausible records follows, its time being what it is
+				p += parseRawRecord(data + p, end, 0, time, true, record);
+				time = record.time;
+				anchored = true;
+				recordsKept++;
+			}
+		}
+		put(data + run, p - run);
+	}
+
+public:
+	std::vector<log_loss_t> losses;
+	uint64_t lostBytes;
+	uint64_t bytesWritten;
+	bool writeFailed;
+	uint32_t blocksKept;
+	uint32_t blocksRewritten;
+	uint32_t blocksSalvaged;
+	uint32_t recordsSalvaged;
+	uint32_t framesDropped;
+	// Version 0 only
+	uint64_t recordsKept;
+
+	LogRecovery(const uint8_t *data, size_t size)
+		: data(data), size(size), out(nullptr), formatVersion(0), fileHeader(), blockSize(0),
+		  tainted(false), expectedSequence(0), keptRecords(0), keptFirstTime(0), consumed(0),
+		  droppedFrames(0), droppedBytes(0), lostBytes(0), bytesWritten(0), writeFailed(false),
+		  blocksKept(0), blocksRewritten(0), blocksSalvaged(0), recordsSalvaged(0), framesDropped(0), recordsKept(0)
+	{
+		memset(slotKnown, 0, sizeof(slotKnown));
+		if (size >= LOG_FILE_HEADER_SIZE && checkFileHeaderSector(data))
+		{
+			memcpy(&fileHeader, data, sizeof(fileHeader));
+			formatVersion = fileHeader.version;
+			blockSize = fileHeader.blockSize;
+		}
+	}
+
+	uint16_t version() const { return formatVersion; }
+
+	/*
+		Whether there is anything to recover from: a header that checks
+		out with a layout this understands, or no header at all
+	*/
+	bool recoverable() const
+	{
+		if (size >= sizeof(LOG_FILE_MAGIC) && !memcmp(data, LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC)) && formatVersion == 0)
+			return false;
+		return formatVersion <= LOG_FORMAT_VERSION &&
+			   (formatVersion == 0 || (blockSize > sizeof(log_block_header_t) && fileHeader.headerSize <= size));
+	}
+
+	/*
+		Write the clean log to stream. Returns false if the input is not
+		recoverable or writing failed.
+	*/
+	bool recover(FILE *stream)
+	{
+		if (!recoverable())
+			return false;
+
+		out = stream;
+		if (formatVersion == 0)
+			recoverRecords();
+		else
+			recoverBlocks();
+		return !writeFailed;
+	}
+};
+
+#endif // __LOGRECOVER_H_
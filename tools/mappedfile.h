@@ -0,0 +1,76 @@
+#ifndef __MAPPEDFILE_H_
+#define __MAPPEDFILE_H_
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+	A whole file mapped read-only, so a log can be read in place however
+	big it is. The kernel is told it will be read front to back, which
+	makes it read ahead in large chunks.
+*/
+class MappedFile
+{
+private:
+	uint8_t *mapping;
+	size_t length;
+
+public:
+	MappedFile() : mapping(nullptr), length(0) {}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile() { close(); }
+
+	bool open(const char *path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		length = st.st_size;
+		if (length)
+		{
+			void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED)
+			{
+				::close(fd);
+				length = 0;
+				return false;
+			}
+
+			mapping = (uint8_t *)p;
+			madvise(mapping, length, MADV_SEQUENTIAL);
+		}
+
+		::close(fd);
+		return true;
+	}
+
+	void close()
+	{
+		if (mapping)
+			munmap(mapping, length);
+		mapping = nullptr;
+		length = 0;
+	}
+
+	const uint8_t *data() const { return mapping; }
+	size_t size() const { return length; }
+};
+
+#endif // __MAPPEDFILE_H_
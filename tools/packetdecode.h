@@ -0,0 +1,97 @@
+#ifndef __PACKETDECODE_H_
+#define __PACKETDECODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logreader.h"
+#include "packet.h"
+#include "packetview.h"
+
+/*
+	The fields of a logged radio frame, pointing into the frame itself
+*/
+typedef struct
+{
+	const packet_t *packet;
+	uint8_t tag;
+
+	// Only for TAG_DATA, zero otherwise
+	uint32_t timestamp;
+	uint8_t channel;
+	uint8_t flags;
+	int16_t rssi;
+	uint32_t accessAddress;
+	uint8_t pduType;
+	bool txAddrRandom;
+	bool rxAddrRandom;
+	const uint8_t *pdu;
+	uint8_t pduLength;
+
+	// The first address in the PDU, or nullptr
+	const uint8_t *address;
+	// AD structures of advertising PDUs that carry them
+	const uint8_t *data;
+	uint8_t dataLength;
+} decoded_packet_t;
+
+/*
+	Decode the packet_t a radio sent, returning false if it is too short
+	for what its headers claim
+*/
+inline bool decodePacket(const uint8_t *frame, size_t length, decoded_packet_t &packet)
+{
+	PacketView view(frame, length);
+	packet = decoded_packet_t();
+	if (!view.hasHeader())
+		return false;
+
+	packet.packet = (const packet_t *)frame;
+	packet.tag = view.tag();
+
+	if (packet.tag != TAG_DATA)
+		return true;
+	if (!view.isRadio())
+		return false;
+
+	packet.timestamp = view.timestamp();
+	packet.channel = view.channel();
+	packet.flags = view.flags();
+	packet.rssi = view.rssi();
+	packet.accessAddress = view.accessAddress();
+	packet.pduType = view.advType();
+	packet.txAddrRandom = view.txAddrRandom();
+	packet.rxAddrRandom = view.rxAddrRandom();
+	packet.pdu = view.pdu();
+	packet.pduLength = view.pduLength();
+	if (!view.pduFits())
+		return false;
+
+	packet.address = view.address();
+	packet.data = view.adData();
+	packet.dataLength = view.adLength();
+	return true;
+}
+
+/*
+	Read every record of a log, calling callback(record, packet) with
+	packet the decoded frame of a radio packet record and nullptr for the
+	rest. Frames that do not decode are passed with a nullptr packet too.
+*/
+template <typename F>
+void decodeLog(LogReader &reader, F callback)
+{
+	log_record_t record;
+	decoded_packet_t packet;
+
+	while (reader.next(record))
+	{
+		bool radio = record.type >= OUTPUT_TYPE_RADIO_PACKET_37 && record.type <= OUTPUT_TYPE_RADIO_PACKET_39;
+		if (radio && decodePacket(record.payload, record.length, packet))
+			callback(record, &packet);
+		else
+			callback(record, (const decoded_packet_t *)nullptr);
+	}
+}
+
+#endif // __PACKETDECODE_H_
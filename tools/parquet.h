@@ -0,0 +1,605 @@
+#ifndef __PARQUET_H_
+#define __PARQUET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+	Streaming Parquet writer for flat tables of the few column types the
+	exporters need. Rows are buffered per column up to a row group, which
+	is then written as one uncompressed page per column, plainly encoded
+	or dictionary encoded, with min/max statistics. Only the file footer
+	grows with the file: a few dozen bytes per column per row group.
+
+	Metadata is in the Thrift compact protocol, written by hand here for
+	just the structures a reader needs.
+*/
+
+#define PARQUET_MAGIC "PAR1"
+
+// Physical types
+#define PARQUET_BOOLEAN (0)
+#define PARQUET_INT32 (1)
+#define PARQUET_INT64 (2)
+#define PARQUET_BYTE_ARRAY (6)
+
+// Repetition
+#define PARQUET_REQUIRED (0)
+#define PARQUET_OPTIONAL (1)
+
+// Converted (legacy logical) types
+#define PARQUET_CONVERTED_NONE (-1)
+#define PARQUET_CONVERTED_UTF8 (0)
+#define PARQUET_CONVERTED_INT_8 (15)
+#define PARQUET_CONVERTED_INT_16 (16)
+
+// Encodings
+#define PARQUET_ENCODING_PLAIN (0)
+#define PARQUET_ENCODING_RLE (3)
+#define PARQUET_ENCODING_RLE_DICTIONARY (8)
+
+// Page types
+#define PARQUET_DATA_PAGE (0)
+#define PARQUET_DICTIONARY_PAGE (2)
+
+/*
+	Thrift compact protocol encoder
+*/
+class ThriftCompact
+{
+private:
+	std::vector<int16_t> lastField;
+
+	enum
+	{
+		TYPE_TRUE = 1,
+		TYPE_FALSE = 2,
+		TYPE_I32 = 5,
+		TYPE_I64 = 6,
+		TYPE_BINARY = 8,
+		TYPE_LIST = 9,
+		TYPE_STRUCT = 12,
+	};
+
+	void varint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	void zigzag(int64_t value)
+	{
+		varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+	}
+
+	void fieldHeader(int16_t id, uint8_t type)
+	{
+		int16_t delta = id - lastField.back();
+		if (delta > 0 && delta <= 15)
+			out.push_back((uint8_t)(delta << 4 | type));
+		else
+		{
+			out.push_back(type);
+			zigzag(id);
+		}
+		lastField.back() = id;
+	}
+
+public:
+	std::vector<uint8_t> out;
+
+	ThriftCompact() : lastField(1, 0) {}
+
+	void i32(int16_t id, int32_t value)
+	{
+		fieldHeader(id, TYPE_I32);
+		zigzag(value);
+	}
+
+	void i64(int16_t id, int64_t value)
+	{
+		fieldHeader(id, TYPE_I64);
+		zigzag(value);
+	}
+
+	void boolean(int16_t id, bool value)
+	{
+		fieldHeader(id, value ? TYPE_TRUE : TYPE_FALSE);
+	}
+
+	void binary(int16_t id, const void *data, size_t length)
+	{
+		fieldHeader(id, TYPE_BINARY);
+		varint(length);
+		out.insert(out.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+	}
+
+	void string(int16_t id, const std::string &value)
+	{
+		binary(id, value.data(), value.size());
+	}
+
+	void beginStruct(int16_t id)
+	{
+		fieldHeader(id, TYPE_STRUCT);
+		lastField.push_back(0);
+	}
+
+	void endStruct()
+	{
+		out.push_back(0);
+		lastField.pop_back();
+	}
+
+	/*
+		A list field; elements are then written with the element calls
+	*/
+	void beginList(int16_t id, uint8_t elementType, size_t size)
+	{
+		fieldHeader(id, TYPE_LIST);
+		if (size < 15)
+			out.push_back((uint8_t)(size << 4 | elementType));
+		else
+		{
+			out.push_back(0xF0 | elementType);
+			varint(size);
+		}
+	}
+
+	void beginStructList(int16_t id, size_t size) { beginList(id, TYPE_STRUCT, size); }
+	void beginI32List(int16_t id, size_t size) { beginList(id, TYPE_I32, size); }
+	void beginStringList(int16_t id, size_t size) { beginList(id, TYPE_BINARY, size); }
+
+	void elementI32(int32_t value) { zigzag(value); }
+
+	void elementString(const std::string &value)
+	{
+		varint(value.size());
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	void beginElementStruct() { lastField.push_back(0); }
+	void endElementStruct() { endStruct(); }
+};
+
+/*
+	Append values with the RLE/bit-packing hybrid encoding, as a single
+	bit-packed run
+*/
+inline void parquetBitPack(std::vector<uint8_t> &out, const std::vector<uint32_t> &values, int bitWidth)
+{
+	size_t groups = (values.size() + 7) / 8;
+	uint64_t header = groups << 1 | 1;
+	while (header >= 0x80)
+	{
+		out.push_back((uint8_t)(header | 0x80));
+		header >>= 7;
+	}
+	out.push_back((uint8_t)header);
+
+	uint64_t bits = 0;
+	int used = 0;
+	for (size_t i = 0; i < groups * 8; i++)
+	{
+		bits |= (uint64_t)(i < values.size() ? values[i] : 0) << used;
+		used += bitWidth;
+		while (used >= 8)
+		{
+			out.push_back((uint8_t)bits);
+			bits >>= 8;
+			used -= 8;
+		}
+	}
+}
+
+/*
+	One column's values for the row group being built
+*/
+class ParquetColumn
+{
+private:
+	friend class ParquetWriter;
+
+	std::string name;
+	int type;
+	int repetition;
+	int converted;
+	bool dictionary;
+	bool statistics;
+
+	uint32_t rows;
+	uint32_t nulls;
+	std::vector<uint8_t> values;
+	std::vector<uint32_t> definitions;
+	// Booleans, packed 8 to a byte as they come
+	uint8_t bitCount;
+
+	std::unordered_map<std::string, uint32_t> dictionaryIndex;
+	std::vector<std::string> dictionaryValues;
+	std::vector<uint32_t> indices;
+
+	int64_t minInt;
+	int64_t maxInt;
+
+	void defined(bool present)
+	{
+		rows++;
+		if (repetition == PARQUET_OPTIONAL)
+			definitions.push_back(present);
+		if (!present)
+			nulls++;
+	}
+
+	void track(int64_t value)
+	{
+		bool first = rows - nulls == 1;
+		if (first || value < minInt)
+			minInt = value;
+		if (first || value > maxInt)
+			maxInt = value;
+	}
+
+	void clear()
+	{
+		rows = 0;
+		nulls = 0;
+		values.clear();
+		definitions.clear();
+		bitCount = 0;
+		dictionaryIndex.clear();
+		dictionaryValues.clear();
+		indices.clear();
+	}
+
+public:
+	ParquetColumn(const char *name, int type, int repetition, int converted = PARQUET_CONVERTED_NONE,
+				  bool dictionary = false, bool statistics = true)
+		: name(name), type(type), repetition(repetition), converted(converted), dictionary(dictionary),
+		  statistics(statistics), rows(0), nulls(0), bitCount(0), minInt(0), maxInt(0)
+	{
+	}
+
+	void addInt32(int32_t value)
+	{
+		defined(true);
+		values.insert(values.end(), (const uint8_t *)&value, (const uint8_t *)&value + 4);
+		track(value);
+	}
+
+	void addInt64(int64_t value)
+	{
+		defined(true);
+		values.insert(values.end(), (const uint8_t *)&value, (const uint8_t *)&value + 8);
+		track(value);
+	}
+
+	void addBoolean(bool value)
+	{
+		defined(true);
+		if (bitCount % 8 == 0)
+			values.push_back(0);
+		values.back() |= value << (bitCount % 8);
+		bitCount++;
+	}
+
+	void addBytes(const void *data, size_t length)
+	{
+		defined(true);
+		if (dictionary)
+		{
+			std::string key((const char *)data, length);
+			auto found = dictionaryIndex.find(key);
+			if (found == dictionaryIndex.end())
+			{
+				found = dictionaryIndex.emplace(key, dictionaryValues.size()).first;
+				dictionaryValues.push_back(key);
+			}
+			indices.push_back(found->second);
+			return;
+		}
+
+		uint32_t prefix = length;
+		values.insert(values.end(), (const uint8_t *)&prefix, (const uint8_t *)&prefix + 4);
+		values.insert(values.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+	}
+
+	/*
+		Add a value already in the dictionary, by its index from
+		lookup(); saves building the key for every row
+	*/
+	void addIndex(uint32_t index)
+	{
+		defined(true);
+		indices.push_back(index);
+	}
+
+	/*
+		The dictionary index of a value, adding it if it is new
+	*/
+	uint32_t lookup(const void *data, size_t length)
+	{
+		std::string key((const char *)data, length);
+		auto found = dictionaryIndex.emplace(key, dictionaryValues.size());
+		if (found.second)
+			dictionaryValues.push_back(key);
+		return found.first->second;
+	}
+
+	size_t dictionarySize() const { return dictionaryValues.size(); }
+
+	void addNull()
+	{
+		defined(false);
+	}
+};
+
+class ParquetWriter
+{
+private:
+	FILE *out;
+	uint64_t offset;
+	std::vector<ParquetColumn *> columns;
+	std::string createdBy;
+
+	// Footer built up as row groups are written
+	ThriftCompact rowGroups;
+	uint32_t rowGroupCount;
+	uint64_t totalRows;
+
+	void write(const void *data, size_t length)
+	{
+		fwrite(data, 1, length, out);
+		offset += length;
+	}
+
+	void pageHeader(int pageType, const std::vector<uint8_t> &page, uint32_t values, int encoding)
+	{
+		ThriftCompact header;
+		header.i32(1, pageType);
+		header.i32(2, page.size());
+		header.i32(3, page.size());
+		if (pageType == PARQUET_DATA_PAGE)
+		{
+			header.beginStruct(5);
+			header.i32(1, values);
+			header.i32(2, encoding);
+			header.i32(3, PARQUET_ENCODING_RLE);
+			header.i32(4, PARQUET_ENCODING_RLE);
+			header.endStruct();
+		}
+		else
+		{
+			header.beginStruct(7);
+			header.i32(1, values);
+			header.i32(2, encoding);
+			header.endStruct();
+		}
+		header.out.push_back(0);
+
+		write(header.out.data(), header.out.size());
+		write(page.data(), page.size());
+	}
+
+	// Bits for dictionary indices, at least 1
+	static int bitWidth(size_t values)
+	{
+		int width = 1;
+		while (((size_t)1 << width) < values)
+			width++;
+		return width;
+	}
+
+	void writeColumn(ParquetColumn &column, ThriftCompact &meta)
+	{
+		uint64_t start = offset;
+		uint64_t dictionaryOffset = 0;
+		std::vector<uint8_t> page;
+
+		// Statistics are kept for integers and dictionary values
+		std::string minValue;
+		std::string maxValue;
+		bool minMax = column.statistics && column.rows > column.nulls &&
+					  (column.dictionary || column.type == PARQUET_INT32 || column.type == PARQUET_INT64);
+
+		if (column.dictionary)
+		{
+			for (size_t i = 0; i < column.dictionaryValues.size(); i++)
+			{
+				const std::string &value = column.dictionaryValues[i];
+				uint32_t length = value.size();
+				page.insert(page.end(), (const uint8_t *)&length, (const uint8_t *)&length + 4);
+				page.insert(page.end(), value.begin(), value.end());
+				if (i == 0 || value < minValue)
+					minValue = value;
+				if (i == 0 || value > maxValue)
+					maxValue = value;
+			}
+			dictionaryOffset = offset;
+			pageHeader(PARQUET_DICTIONARY_PAGE, page, column.dictionaryValues.size(), PARQUET_ENCODING_PLAIN);
+			page.clear();
+		}
+		else if (minMax)
+		{
+			// Plain encoded, little endian
+			size_t size = column.type == PARQUET_INT64 ? 8 : 4;
+			minValue.assign((const char *)&column.minInt, size);
+			maxValue.assign((const char *)&column.maxInt, size);
+		}
+
+		uint64_t dataOffset = offset;
+		if (column.repetition == PARQUET_OPTIONAL)
+		{
+			std::vector<uint8_t> levels;
+			parquetBitPack(levels, column.definitions, 1);
+			uint32_t length = levels.size();
+			page.insert(page.end(), (const uint8_t *)&length, (const uint8_t *)&length + 4);
+			page.insert(page.end(), levels.begin(), levels.end());
+		}
+
+		int encoding = PARQUET_ENCODING_PLAIN;
+		if (column.dictionary)
+		{
+			int width = bitWidth(column.dictionaryValues.size());
+			page.push_back(width);
+			parquetBitPack(page, column.indices, width);
+			encoding = PARQUET_ENCODING_RLE_DICTIONARY;
+		}
+		else
+			page.insert(page.end(), column.values.begin(), column.values.end());
+
+		pageHeader(PARQUET_DATA_PAGE, page, column.rows, encoding);
+		uint64_t size = offset - start;
+
+		meta.beginElementStruct();
+		meta.i64(2, start);
+		meta.beginStruct(3);
+		meta.i32(1, column.type);
+		if (column.dictionary)
+		{
+			meta.beginI32List(2, 3);
+			meta.elementI32(PARQUET_ENCODING_PLAIN);
+			meta.elementI32(PARQUET_ENCODING_RLE);
+			meta.elementI32(PARQUET_ENCODING_RLE_DICTIONARY);
+		}
+		else
+		{
+			meta.beginI32List(2, 2);
+			meta.elementI32(PARQUET_ENCODING_PLAIN);
+			meta.elementI32(PARQUET_ENCODING_RLE);
+		}
+		meta.beginStringList(3, 1);
+		meta.elementString(column.name);
+		meta.i32(4, 0); // Uncompressed
+		meta.i64(5, column.rows);
+		meta.i64(6, size);
+		meta.i64(7, size);
+		meta.i64(9, dataOffset);
+		if (column.dictionary)
+			meta.i64(11, dictionaryOffset);
+
+		meta.beginStruct(12);
+		meta.i64(3, column.nulls);
+		if (minMax)
+		{
+			meta.binary(5, maxValue.data(), maxValue.size());
+			meta.binary(6, minValue.data(), minValue.size());
+		}
+		meta.endStruct();
+
+		meta.endStruct();
+		meta.endElementStruct();
+	}
+
+public:
+	uint64_t bytesWritten() const { return offset; }
+
+	ParquetWriter() : out(nullptr), offset(0), rowGroupCount(0), totalRows(0) {}
+
+	/*
+		Start a file with these columns, which stay owned by the caller
+		and are filled a row at a time between endRowGroup() calls
+	*/
+	void begin(FILE *stream, const std::vector<ParquetColumn *> &tableColumns, const char *application)
+	{
+		out = stream;
+		offset = 0;
+		columns = tableColumns;
+		createdBy = application;
+		rowGroups = ThriftCompact();
+		rowGroupCount = 0;
+		totalRows = 0;
+		write(PARQUET_MAGIC, 4);
+	}
+
+	uint32_t rows() const { return columns.empty() ? 0 : columns[0]->rows; }
+
+	/*
+		Write the rows added so far as a row group
+	*/
+	void endRowGroup()
+	{
+		uint32_t groupRows = rows();
+		if (!groupRows)
+			return;
+
+		uint64_t start = offset;
+		ThriftCompact meta;
+		for (ParquetColumn *column : columns)
+		{
+			writeColumn(*column, meta);
+			column->clear();
+		}
+
+		// RowGroup, as an element of FileMetaData.row_groups
+		rowGroups.beginElementStruct();
+		rowGroups.beginStructList(1, columns.size());
+		rowGroups.out.insert(rowGroups.out.end(), meta.out.begin(), meta.out.end());
+		rowGroups.i64(2, offset - start);
+		rowGroups.i64(3, groupRows);
+		rowGroups.endElementStruct();
+
+		rowGroupCount++;
+		totalRows += groupRows;
+	}
+
+	/*
+		Write the last row group and the footer
+	*/
+	void finish()
+	{
+		endRowGroup();
+
+		ThriftCompact footer;
+		footer.i32(1, 1);
+
+		footer.beginStructList(2, columns.size() + 1);
+		footer.beginElementStruct();
+		footer.string(4, "schema");
+		footer.i32(5, columns.size());
+		footer.endElementStruct();
+		for (ParquetColumn *column : columns)
+		{
+			footer.beginElementStruct();
+			footer.i32(1, column->type);
+			footer.i32(3, column->repetition);
+			footer.string(4, column->name);
+			if (column->converted != PARQUET_CONVERTED_NONE)
+				footer.i32(6, column->converted);
+			footer.endElementStruct();
+		}
+
+		footer.i64(3, totalRows);
+		footer.beginStructList(4, rowGroupCount);
+		footer.out.insert(footer.out.end(), rowGroups.out.begin(), rowGroups.out.end());
+		footer.string(6, createdBy);
+
+		// Type defined ordering for every column, without which readers
+		// do not trust min_value and max_value
+		footer.beginStructList(7, columns.size());
+		for (size_t i = 0; i < columns.size(); i++)
+		{
+			footer.beginElementStruct();
+			footer.beginStruct(1);
+			footer.endStruct();
+			footer.endElementStruct();
+		}
+		footer.out.push_back(0);
+
+		write(footer.out.data(), footer.out.size());
+		uint32_t length = footer.out.size();
+		write(&length, 4);
+		write(PARQUET_MAGIC, 4);
+	}
+};
+
+#endif // __PARQUET_H_
@@ -0,0 +1,177 @@
+#ifndef __PCAPNG_H_
+#define __PCAPNG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+	Streaming pcapng writer: a section header, interface descriptions,
+	then enhanced packet blocks, written through a stdio stream as they
+	come. Options are limited to what the exporters use. Blocks are in
+	host byte order, which the section header records for readers.
+*/
+
+#define PCAPNG_BLOCK_SECTION_HEADER (0x0A0D0D0A)
+#define PCAPNG_BLOCK_INTERFACE (0x00000001)
+#define PCAPNG_BLOCK_ENHANCED_PACKET (0x00000006)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1A2B3C4D)
+
+#define PCAPNG_OPT_END (0)
+#define PCAPNG_OPT_COMMENT (1)
+#define PCAPNG_OPT_SHB_HARDWARE (2)
+#define PCAPNG_OPT_SHB_USERAPPL (4)
+#define PCAPNG_OPT_IF_NAME (2)
+#define PCAPNG_OPT_IF_DESCRIPTION (3)
+#define PCAPNG_OPT_IF_TSRESOL (9)
+#define PCAPNG_OPT_EPB_FLAGS (2)
+
+// epb_flags: inbound, and the link layer's CRC error bit
+#define PCAPNG_EPB_INBOUND (0x00000001)
+#define PCAPNG_EPB_CRC_ERROR (0x01000000)
+
+#define LINKTYPE_USER0 (147)
+#define LINKTYPE_BLUETOOTH_LE_LL_WITH_PHDR (256)
+
+class PcapngWriter
+{
+private:
+	FILE *out;
+	uint32_t interfaces;
+
+	static size_t padded(size_t length)
+	{
+		return (length + 3) & ~(size_t)3;
+	}
+
+	void put(const void *data, size_t length)
+	{
+		fwrite(data, 1, length, out);
+	}
+
+	void put32(uint32_t value)
+	{
+		put(&value, 4);
+	}
+
+	void pad(size_t length)
+	{
+		static const uint8_t zeros[4] = {0};
+		put(zeros, padded(length) - length);
+	}
+
+	static size_t optionSize(size_t length)
+	{
+		return 4 + padded(length);
+	}
+
+	void putOption(uint16_t code, const void *data, size_t length)
+	{
+		uint16_t header[2] = {code, (uint16_t)length};
+		put(header, sizeof(header));
+		put(data, length);
+		pad(length);
+	}
+
+	void putStringOption(uint16_t code, const char *text)
+	{
+		if (text && *text)
+			putOption(code, text, strlen(text));
+	}
+
+	static size_t stringOptionSize(const char *text)
+	{
+		return text && *text ? optionSize(strlen(text)) : 0;
+	}
+
+public:
+	uint64_t packets;
+	uint64_t bytesWritten;
+
+	PcapngWriter() : out(nullptr), interfaces(0), packets(0), bytesWritten(0) {}
+
+	/*
+		Start a section on out, naming the application and the capture
+		hardware
+	*/
+	void begin(FILE *stream, const char *application, const char *hardware, const char *comment)
+	{
+		out = stream;
+		interfaces = 0;
+
+		size_t options = stringOptionSize(comment) + stringOptionSize(hardware) + stringOptionSize(application) + 4;
+		uint32_t length = 28 + options;
+
+		put32(PCAPNG_BLOCK_SECTION_HEADER);
+		put32(length);
+		put32(PCAPNG_BYTE_ORDER_MAGIC);
+		uint16_t version[2] = {1, 0};
+		put(version, sizeof(version));
+		// Section length not known in advance
+		uint64_t sectionLength = UINT64_MAX;
+		put(&sectionLength, 8);
+		putStringOption(PCAPNG_OPT_COMMENT, comment);
+		putStringOption(PCAPNG_OPT_SHB_HARDWARE, hardware);
+		putStringOption(PCAPNG_OPT_SHB_USERAPPL, application);
+		put32(PCAPNG_OPT_END);
+		put32(length);
+		bytesWritten += length;
+	}
+
+	/*
+		Describe the next interface, with microsecond timestamps. Returns
+		its id for packet().
+	*/
+	uint32_t addInterface(uint16_t linkType, const char *name, const char *description)
+	{
+		size_t options = stringOptionSize(name) + stringOptionSize(description) + optionSize(1) + 4;
+		uint32_t length = 20 + options;
+
+		put32(PCAPNG_BLOCK_INTERFACE);
+		put32(length);
+		uint16_t type[2] = {linkType, 0};
+		put(type, sizeof(type));
+		// No snap length
+		put32(0);
+		putStringOption(PCAPNG_OPT_IF_NAME, name);
+		putStringOption(PCAPNG_OPT_IF_DESCRIPTION, description);
+		uint8_t resolution = 6;
+		putOption(PCAPNG_OPT_IF_TSRESOL, &resolution, 1);
+		put32(PCAPNG_OPT_END);
+		put32(length);
+		bytesWritten += length;
+		return interfaces++;
+	}
+
+	/*
+		A packet; flags of 0 and an empty comment are left out
+	*/
+	void packet(uint32_t interface, uint64_t micros, const uint8_t *data, size_t captured,
+				uint32_t flags, const char *comment, size_t commentLength)
+	{
+		size_t options = (flags ? optionSize(4) : 0) + (commentLength ? optionSize(commentLength) : 0);
+		if (options)
+			options += 4;
+		uint32_t length = 32 + padded(captured) + options;
+
+		uint32_t fields[7] = {PCAPNG_BLOCK_ENHANCED_PACKET, length, interface,
+							  (uint32_t)(micros >> 32), (uint32_t)micros, (uint32_t)captured, (uint32_t)captured};
+		put(fields, sizeof(fields));
+		put(data, captured);
+		pad(captured);
+
+		if (commentLength)
+			putOption(PCAPNG_OPT_COMMENT, comment, commentLength);
+		if (flags)
+			putOption(PCAPNG_OPT_EPB_FLAGS, &flags, 4);
+		if (options)
+			put32(PCAPNG_OPT_END);
+		put32(length);
+
+		packets++;
+		bytesWritten += length;
+	}
+};
+
+#endif // __PCAPNG_H_
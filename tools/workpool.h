@@ -0,0 +1,159 @@
+#ifndef __WORKPOOL_H_
+#define __WORKPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	A fixed set of worker threads, each with its own queue of tasks.
+	Submitted tasks are dealt to the queues in turn; a worker takes the
+	newest task from its own queue and, when that is empty, steals the
+	oldest from another's, so uneven tasks still keep every thread busy.
+*/
+class WorkStealingPool
+{
+private:
+	typedef std::function<void()> task_t;
+
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<task_t> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> nextQueue;
+	// Tasks submitted and not yet taken, and not yet finished
+	std::atomic<size_t> queued;
+	std::atomic<size_t> unfinished;
+
+	std::mutex idleLock;
+	std::condition_variable wake;
+	std::condition_variable drained;
+	bool stopping;
+
+	bool take(size_t self, task_t &task)
+	{
+		{
+			Queue &own = *queues[self];
+			std::lock_guard<std::mutex> guard(own.lock);
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < queues.size(); i++)
+		{
+			Queue &victim = *queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				steals++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(size_t self)
+	{
+		task_t task;
+		for (;;)
+		{
+			if (take(self, task))
+			{
+				queued--;
+				task();
+				if (--unfinished == 0)
+				{
+					std::lock_guard<std::mutex> guard(idleLock);
+					drained.notify_all();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(idleLock);
+			wake.wait(guard, [&] { return stopping || queued > 0; });
+			if (stopping && queued == 0)
+				return;
+		}
+	}
+
+public:
+	std::atomic<uint64_t> steals;
+
+	explicit WorkStealingPool(size_t threadCount)
+		: nextQueue(0), queued(0), unfinished(0), stopping(false), steals(0)
+	{
+		if (threadCount == 0)
+			threadCount = 1;
+
+		for (size_t i = 0; i < threadCount; i++)
+			queues.emplace_back(new Queue);
+		for (size_t i = 0; i < threadCount; i++)
+			threads.emplace_back(&WorkStealingPool::work, this, i);
+	}
+
+	WorkStealingPool(const WorkStealingPool &) = delete;
+	WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+	/*
+		Runs every task already submitted, then stops the threads
+	*/
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(idleLock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &thread : threads)
+			thread.join();
+	}
+
+	size_t size() const { return threads.size(); }
+
+	/*
+		Wait for every task submitted so far to finish
+	*/
+	void wait()
+	{
+		std::unique_lock<std::mutex> guard(idleLock);
+		drained.wait(guard, [&] { return unfinished == 0; });
+	}
+
+	void submit(task_t task)
+	{
+		// Counted first, so a worker never takes a task it has not been
+		// told about
+		{
+			std::lock_guard<std::mutex> guard(idleLock);
+			queued++;
+			unfinished++;
+		}
+
+		Queue &queue = *queues[nextQueue++ % queues.size()];
+		{
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.tasks.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+};
+
+#endif // __WORKPOOL_H_